@@ -0,0 +1,703 @@
+/*** aho-corasick-guts.c -- aho-corasick multi-pattern matcher
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+/**
+ * Aho-Corasick automaton, stored as double-array trie.
+ *
+ * - patterns are folded to lower case (ASCII only) and sorted,
+ *   the trie is built over these keys, case-sensitive patterns
+ *   are verified against the buffer upon output
+ * - the alphabet is condensed to the characters that occur in
+ *   patterns, all other characters lead back to the root
+ * - state S's child for class C lives in slot BASE(S) + C iff
+ *   CHECK(BASE(S) + C) == S, base, check, failure and output link
+ *   of a state are interleaved so that a transition touches one
+ *   cache line
+ *
+ **/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nifty.h"
+#include "glep.h"
+#include "aho-corasick-guts.h"
+
+/* state index type */
+typedef uint_fast32_t st_t;
+
+/* check value of free slots */
+#define FREE_SLOT	((uint32_t)-1)
+/* check value of the root slot, must not coincide with a state */
+#define ROOT_SLOT	((uint32_t)-2)
+
+#define TBL_INIZ	(4096U)
+
+struct acst_s {
+	/** offset of this state's children */
+	uint32_t base;
+	/** parent state of this slot, or FREE_SLOT */
+	uint32_t check;
+	/** failure link */
+	uint32_t fail;
+	/** nearest state with outputs along the failure links, or 0 */
+	uint32_t dict;
+};
+
+struct acout_s {
+	/** patterns ending in this state, range into PATS */
+	uint32_t beg;
+	uint32_t end;
+};
+
+struct glepcc_s {
+	/** character to alphabet class, 0 for characters not in any pattern */
+	uint8_t cls[0x100U];
+	/** number of classes (excluding 0) */
+	size_t ncls;
+	/** length of the longest pattern */
+	size_t maxn;
+
+	/** number of slots */
+	size_t z;
+	/** states */
+	struct acst_s *st;
+	/** outputs */
+	struct acout_s *out;
+
+	/** patterns in key order */
+	size_t npats;
+	glod_pat_t *pats;
+
+	/** non-zero if states and outputs live in a database */
+	int mapped;
+};
+
+/* database record of the above, arrays by offset */
+struct ccrec_s {
+	uint8_t cls[0x100U];
+	uint64_t ncls;
+	uint64_t maxn;
+	uint64_t z;
+	uint64_t st;
+	uint64_t out;
+	uint64_t npats;
+	/** pattern indices in key order */
+	uint64_t pidx;
+};
+
+#if defined __INTEL_COMPILER
+# define auto	static
+#endif	/* __INTEL_COMPILER */
+
+
+/* aux */
+static inline uint8_t
+fold(uint8_t c)
+{
+	return (uint8_t)(c >= 'A' && c <= 'Z' ? c | 0x20U : c);
+}
+
+static inline bool
+xpuncsp(const char c)
+{
+/* looks for <=' ', '!', ',', '.', ':', ';', '?' '\'', '"', '`', '-' */
+
+	/* check for <=SPC, !, " */
+	if ((non_ascii_wordsep_p || c >= '\0') && c <= '"') {
+		return true;
+	}
+
+	/* check for '() */
+	if (c >= '\'' && c <= ')') {
+		return true;
+	}
+
+	/* check for ,-. */
+	if (c >= ',' && c <= '.') {
+		return true;
+	}
+
+	/* check for :; */
+	if (c == ':' || c == ';') {
+		return true;
+	}
+
+	/* check for ?` */
+	if (c == '?' || c == '`') {
+		return true;
+	}
+
+	/* otherwise it's nothing */
+	return false;
+}
+
+static int
+key_cmp(const void *x, const void *y)
+{
+/* compare the folded patterns X and Y, prefixes go first */
+	const glod_pat_t *px = x;
+	const glod_pat_t *py = y;
+	const uint8_t *sx = (const uint8_t*)px->p;
+	const uint8_t *sy = (const uint8_t*)py->p;
+
+	for (size_t i = 0U; i < px->n && i < py->n; i++) {
+		if (fold(sx[i]) != fold(sy[i])) {
+			return fold(sx[i]) < fold(sy[i]) ? -1 : 1;
+		}
+	}
+	return (px->n > py->n) - (px->n < py->n);
+}
+
+
+/* double-array construction */
+struct acnode_s {
+	/** state */
+	st_t s;
+	/** depth */
+	size_t d;
+	/** keys below this state */
+	size_t lo;
+	size_t hi;
+};
+
+struct acbld_s {
+	struct glepcc_s *cc;
+	/* states in breadth-first order */
+	struct acnode_s *q;
+	size_t nq;
+	size_t zq;
+
+	/* free slots below the frontier, doubly linked in ascending order,
+	 * only the last HOLE_MAXN of them are kept, older ones are given
+	 * up on so that placing a state costs bounded time */
+	uint32_t *hn;
+	uint32_t *hp;
+	uint32_t head;
+	uint32_t tail;
+	size_t nholes;
+	/* all slots from here on are free */
+	size_t front;
+};
+
+#define HOLE_MAXN	(1024U)
+/* link value for slots not in the hole list and for the list ends */
+#define HOLE_NIL	((uint32_t)-1)
+
+static int
+grow(struct acbld_s *restrict b, size_t z)
+{
+	struct glepcc_s *cc = b->cc;
+	size_t nu;
+
+	if (LIKELY(z <= cc->z)) {
+		return 0;
+	}
+	for (nu = cc->z ? cc->z : TBL_INIZ; nu < z; nu *= 2U);
+	with (void *st = realloc(cc->st, nu * sizeof(*cc->st))) {
+		if (UNLIKELY(st == NULL)) {
+			return -1;
+		}
+		cc->st = st;
+	}
+	with (void *out = realloc(cc->out, nu * sizeof(*cc->out))) {
+		if (UNLIKELY(out == NULL)) {
+			return -1;
+		}
+		cc->out = out;
+	}
+	with (void *hn = realloc(b->hn, nu * sizeof(*b->hn))) {
+		if (UNLIKELY(hn == NULL)) {
+			return -1;
+		}
+		b->hn = hn;
+	}
+	with (void *hp = realloc(b->hp, nu * sizeof(*b->hp))) {
+		if (UNLIKELY(hp == NULL)) {
+			return -1;
+		}
+		b->hp = hp;
+	}
+	for (size_t i = cc->z; i < nu; i++) {
+		cc->st[i] = (struct acst_s){.check = FREE_SLOT};
+		cc->out[i] = (struct acout_s){0U};
+		b->hn[i] = b->hp[i] = HOLE_NIL;
+	}
+	cc->z = nu;
+	return 0;
+}
+
+static void
+hole_del(struct acbld_s *restrict b, uint32_t i)
+{
+	const uint32_t n = b->hn[i];
+	const uint32_t p = b->hp[i];
+
+	if (p != HOLE_NIL) {
+		b->hn[p] = n;
+	} else if (b->head == i) {
+		b->head = n;
+	} else {
+		/* not in the list */
+		return;
+	}
+	if (n != HOLE_NIL) {
+		b->hp[n] = p;
+	} else {
+		b->tail = p;
+	}
+	b->hn[i] = b->hp[i] = HOLE_NIL;
+	b->nholes--;
+	return;
+}
+
+static void
+hole_add(struct acbld_s *restrict b, uint32_t i)
+{
+	b->hp[i] = b->tail;
+	b->hn[i] = HOLE_NIL;
+	if (b->tail != HOLE_NIL) {
+		b->hn[b->tail] = i;
+	} else {
+		b->head = i;
+	}
+	b->tail = i;
+	if (++b->nholes > HOLE_MAXN) {
+		hole_del(b, b->head);
+	}
+	return;
+}
+
+static void
+use(struct acbld_s *restrict b, st_t t, st_t s)
+{
+/* make slot T a child of S */
+	b->cc->st[t].check = (uint32_t)s;
+	if (t < b->front) {
+		hole_del(b, (uint32_t)t);
+		return;
+	}
+	for (size_t i = b->front; i < t; i++) {
+		hole_add(b, (uint32_t)i);
+	}
+	b->front = t + 1U;
+	return;
+}
+
+static int
+enq(struct acbld_s *restrict b, struct acnode_s n)
+{
+	if (UNLIKELY(b->nq >= b->zq)) {
+		const size_t nu = b->zq ? b->zq * 2U : TBL_INIZ;
+		void *q = realloc(b->q, nu * sizeof(*b->q));
+
+		if (UNLIKELY(q == NULL)) {
+			return -1;
+		}
+		b->q = q;
+		b->zq = nu;
+	}
+	b->q[b->nq++] = n;
+	return 0;
+}
+
+static ssize_t
+place(struct acbld_s *restrict b, const uint8_t *cs, size_t ncs)
+{
+/* find a base so that all slots BASE + CS[i] are free,
+ * CS is sorted in ascending order */
+	const size_t span = cs[ncs - 1U] - cs[0U];
+	size_t pos;
+
+	for (uint32_t i = b->head; i != HOLE_NIL; i = b->hn[i]) {
+		bool fitp = true;
+
+		if (i < cs[0U]) {
+			continue;
+		} else if (UNLIKELY(grow(b, i + span + 1U) < 0)) {
+			return -1;
+		}
+		for (size_t j = 1U; j < ncs; j++) {
+			if (b->cc->st[i - cs[0U] + cs[j]].check != FREE_SLOT) {
+				fitp = false;
+				break;
+			}
+		}
+		if (fitp) {
+			return i - cs[0U];
+		}
+	}
+	/* nothing fits, go beyond the frontier */
+	pos = b->front > cs[0U] ? b->front : cs[0U];
+	if (UNLIKELY(grow(b, pos + span + 1U) < 0)) {
+		return -1;
+	}
+	return pos - cs[0U];
+}
+
+static int
+build(struct acbld_s *restrict b)
+{
+/* build the trie breadth-first, so shallow states, which are the
+ * ones visited most, end up next to each other */
+	struct glepcc_s *cc = b->cc;
+
+	if (UNLIKELY(enq(b, (struct acnode_s){0U, 0U, 0U, cc->npats}) < 0)) {
+		return -1;
+	}
+	for (size_t k = 0U; k < b->nq; k++) {
+		const struct acnode_s n = b->q[k];
+		uint8_t cs[0x100U];
+		size_t ncs = 0U;
+		size_t lo = n.lo;
+		ssize_t base;
+
+		/* keys of length D end here */
+		cc->out[n.s].beg = lo;
+		for (; lo < n.hi && cc->pats[lo].n == n.d; lo++);
+		cc->out[n.s].end = lo;
+
+		/* collect the children, keys are sorted so are the classes */
+		for (size_t i = lo; i < n.hi; i++) {
+			const uint8_t c = cc->cls[(uint8_t)cc->pats[i].p[n.d]];
+
+			if (!ncs || cs[ncs - 1U] != c) {
+				cs[ncs++] = c;
+			}
+		}
+		if (!ncs) {
+			cc->st[n.s].base = 0U;
+			continue;
+		} else if (UNLIKELY((base = place(b, cs, ncs)) < 0)) {
+			return -1;
+		}
+		cc->st[n.s].base = (uint32_t)base;
+		for (size_t i = 0U, j = lo; i < ncs; i++) {
+			const size_t beg = j;
+			const st_t t = base + cs[i];
+
+			for (; j < n.hi &&
+				     cc->cls[(uint8_t)cc->pats[j].p[n.d]] == cs[i];
+			     j++);
+			use(b, t, n.s);
+			if (UNLIKELY(enq(b, (struct acnode_s){
+						t, n.d + 1U, beg, j}) < 0)) {
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void
+mklinks(struct acbld_s *restrict b)
+{
+/* compute failure and output links, states are visited breadth-first
+ * so the failure links of shorter prefixes are known */
+	struct glepcc_s *cc = b->cc;
+
+	for (size_t k = 1U; k < b->nq; k++) {
+		const st_t t = b->q[k].s;
+		const st_t s = cc->st[t].check;
+		const size_t c = t - cc->st[s].base;
+		st_t f = 0U;
+
+		if (s) {
+			for (f = cc->st[s].fail;; f = cc->st[f].fail) {
+				const st_t x = cc->st[f].base + c;
+
+				if (cc->st[x].check == f) {
+					f = x;
+					break;
+				} else if (!f) {
+					break;
+				}
+			}
+		}
+		cc->st[t].fail = (uint32_t)f;
+		cc->st[t].dict = cc->out[t].beg < cc->out[t].end
+			? (uint32_t)t : cc->st[f].dict;
+	}
+	return;
+}
+
+
+/* glep.h engine api */
+glepcc_t
+aho_corasick_cc(glod_pats_t g)
+{
+	struct glepcc_s *res;
+	struct acbld_s b = {
+		.head = HOLE_NIL, .tail = HOLE_NIL, .front = 1U,
+	};
+	uint8_t seen[0x100U] = {0U};
+	size_t maxb = 0U;
+
+	/* get us some memory to chew on */
+	if (UNLIKELY((res = calloc(1, sizeof(*res))) == NULL)) {
+		return NULL;
+	}
+	b.cc = res;
+	res->pats = malloc(g->npats * sizeof(*res->pats));
+	if (UNLIKELY(res->pats == NULL)) {
+		goto bugger;
+	}
+	for (size_t i = 0U; i < g->npats; i++) {
+		const glod_pat_t p = g->pats[i];
+
+		if (UNLIKELY(!p.n)) {
+			continue;
+		}
+		for (size_t j = 0U; j < p.n; j++) {
+			seen[fold((uint8_t)p.p[j])] = 1U;
+		}
+		if (p.n > res->maxn) {
+			res->maxn = p.n;
+		}
+		res->pats[res->npats++] = p;
+	}
+	/* classes in the order of the folded characters */
+	for (size_t c = 0U; c < countof(seen); c++) {
+		if (seen[c]) {
+			seen[c] = (uint8_t)++res->ncls;
+		}
+	}
+	for (size_t c = 0U; c < countof(res->cls); c++) {
+		res->cls[c] = seen[fold((uint8_t)c)];
+	}
+	qsort(res->pats, res->npats, sizeof(*res->pats), key_cmp);
+
+	if (UNLIKELY(grow(&b, TBL_INIZ) < 0)) {
+		goto bugger;
+	}
+	res->st[0U].check = ROOT_SLOT;
+	if (UNLIKELY(build(&b) < 0)) {
+		goto bugger;
+	}
+	/* make sure BASE + C stays within bounds for every state */
+	for (size_t i = 0U; i < res->z; i++) {
+		if (res->st[i].check != FREE_SLOT && res->st[i].base > maxb) {
+			maxb = res->st[i].base;
+		}
+	}
+	if (UNLIKELY(grow(&b, maxb + res->ncls + 1U) < 0)) {
+		goto bugger;
+	}
+	mklinks(&b);
+	free(b.q);
+	free(b.hn);
+	free(b.hp);
+	return res;
+
+bugger:
+	free(b.q);
+	free(b.hn);
+	free(b.hp);
+	aho_corasick_fr(res);
+	return NULL;
+}
+
+/**
+ * Free our context object. */
+void
+aho_corasick_fr(glepcc_t g)
+{
+	with (struct glepcc_s *pg = deconst(g)) {
+		if (!pg->mapped && pg->st != NULL) {
+			free(pg->st);
+		}
+		if (!pg->mapped && pg->out != NULL) {
+			free(pg->out);
+		}
+		if (pg->pats != NULL) {
+			free(pg->pats);
+		}
+		free(pg);
+	}
+	return;
+}
+
+size_t
+aho_corasick_wr(gdbw_t w, glepcc_t g)
+{
+	struct ccrec_s r = {
+		.ncls = g->ncls,
+		.maxn = g->maxn,
+		.z = g->z,
+		.npats = g->npats,
+	};
+	uint32_t *pidx;
+
+	if (UNLIKELY((pidx = malloc(g->npats * sizeof(*pidx) + 1U)) == NULL)) {
+		return 0U;
+	}
+	for (size_t i = 0U; i < g->npats; i++) {
+		pidx[i] = g->pats[i].idx;
+	}
+	memcpy(r.cls, g->cls, sizeof(r.cls));
+	r.st = gdbw_put(w, g->st, g->z * sizeof(*g->st));
+	r.out = gdbw_put(w, g->out, g->z * sizeof(*g->out));
+	r.pidx = gdbw_put(w, pidx, g->npats * sizeof(*pidx));
+	free(pidx);
+	if (UNLIKELY(!r.st || !r.out || !r.pidx)) {
+		return 0U;
+	}
+	return gdbw_put(w, &r, sizeof(r));
+}
+
+glepcc_t
+aho_corasick_rd(gdb_t d, size_t o, glod_pats_t g)
+{
+/* G must be the patterns that were compiled into the record at O,
+ * the trie is used in place, only the key-ordered patterns are
+ * reassembled from G */
+	const struct ccrec_s *r;
+	const uint32_t *pidx;
+	struct glepcc_s *res;
+
+	if (UNLIKELY((r = gdb_get(d, o, sizeof(*r))) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((pidx = gdb_get(
+				     d, r->pidx,
+				     r->npats * sizeof(*pidx))) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((res = calloc(1, sizeof(*res))) == NULL)) {
+		return NULL;
+	}
+	memcpy(res->cls, r->cls, sizeof(res->cls));
+	res->ncls = r->ncls;
+	res->maxn = r->maxn;
+	res->z = r->z;
+	res->st = deconst(gdb_get(d, r->st, r->z * sizeof(*res->st)));
+	res->out = deconst(gdb_get(d, r->out, r->z * sizeof(*res->out)));
+	res->mapped = 1;
+	if (UNLIKELY(res->st == NULL || res->out == NULL)) {
+		goto bugger;
+	}
+	res->pats = malloc(r->npats * sizeof(*res->pats) + 1U);
+	if (UNLIKELY(res->pats == NULL)) {
+		goto bugger;
+	}
+	for (size_t i = 0U; i < r->npats; i++) {
+		if (UNLIKELY(pidx[i] >= g->npats)) {
+			goto bugger;
+		}
+		res->pats[res->npats++] = g->pats[pidx[i]];
+	}
+	return res;
+
+bugger:
+	aho_corasick_fr(res);
+	return NULL;
+}
+
+int
+aho_corasick_gr(gcnt_t *restrict cnt, ghits_t hits,
+		glepcc_t g, const char *buf, size_t bsz)
+{
+	const unsigned char *const bp = (const unsigned char*)buf;
+	/* matches must start before EP, the rest belongs to the next chunk */
+	const size_t ep = bsz < CHUNKZ ? bsz : CHUNKZ - MWNDWZ;
+	const size_t ez = ep + g->maxn - 1U < bsz ? ep + g->maxn - 1U : bsz;
+	const struct acst_s *const st = g->st;
+	st_t s = 0U;
+	int nmtch = 0;
+
+	auto void
+	report(st_t o, size_t i)
+	{
+		/* all patterns along the output links of O end at I */
+		for (; o; o = st[st[o].fail].dict) {
+			for (size_t j = g->out[o].beg; j < g->out[o].end; j++) {
+				const glod_pat_t p = g->pats[j];
+				const size_t sp = i + 1U - p.n;
+
+				if (UNLIKELY(sp >= ep)) {
+					/* belongs to the next chunk */
+					continue;
+				}
+				gpst_vrfy(p.idx);
+				if (!p.fl.ci && memcmp(bp + sp, p.p, p.n)) {
+					/* only equal when folded */
+					continue;
+				} else if (!p.fl.left && sp && !xpuncsp(bp[sp - 1U])) {
+					continue;
+				} else if (!p.fl.right &&
+					   i + 1U < bsz && !xpuncsp(bp[i + 1U])) {
+					continue;
+				}
+				/* MATCH */
+				cnt[p.idx]++;
+				nmtch++;
+				if (UNLIKELY(hits != NULL)) {
+					ghits_add(hits, p.idx, sp);
+				}
+			}
+		}
+		return;
+	}
+
+	for (size_t i = 0U; i < ez; i++) {
+		const st_t c = g->cls[bp[i]];
+
+		if (UNLIKELY(!c)) {
+			/* not in any pattern */
+			s = 0U;
+			continue;
+		}
+		for (;;) {
+			const st_t t = st[s].base + c;
+
+			if (st[t].check == s) {
+				s = t;
+				break;
+			} else if (!s) {
+				break;
+			}
+			s = st[s].fail;
+		}
+		if (UNLIKELY(st[s].dict)) {
+			report(st[s].dict, i);
+		}
+	}
+	return nmtch;
+}
+
+/* aho-corasick-guts.c ends here */
@@ -0,0 +1,14 @@
+#if !defined INCLUDED_aho_corasick_guts_h_
+#define INCLUDED_aho_corasick_guts_h_
+
+#include "glep.h"
+#include "glep-db.h"
+
+extern glepcc_t aho_corasick_cc(glod_pats_t);
+extern int aho_corasick_gr(gcnt_t *restrict, ghits_t, glepcc_t, const char *b, size_t z);
+extern void aho_corasick_fr(glepcc_t);
+
+extern size_t aho_corasick_wr(gdbw_t, glepcc_t);
+extern glepcc_t aho_corasick_rd(gdb_t, size_t o, glod_pats_t);
+
+#endif	/* INCLUDED_aho_corasick_guts_h_ */
@@ -1,4 +1,4 @@
-/*** freundt-javaux-guts.c -- freundt-javaux multi-pattern matcher
+/*** freundt-rabin-karp-guts.c -- prefix-oriented Rabin-Karp matcher
  *
  * Copyright (C) 2013-2015 Sebastian Freundt
  *
@@ -37,61 +37,98 @@
 /**
  * This algorithm is a prefix-oriented variant of Rabin-Karp
  *
- * - we distinguish small patterns (of lengths 1 to 3) and
- * - patterns (lengths >= 4)
- * - calculate the hash (xor cross sum) of patterns
+ * - patterns shorter than 4 octets are left to other engines
+ * - the first 4 octets of each pattern, folded to lower case, are
+ *   its prefix, the prefixes are hashed into a table of cells
+ * - the text is run through a rolling 4-octet window, folded the
+ *   same way, and every window whose hash bucket isn't empty has
+ *   its cells' patterns verified
+ *
+ * Unlike Wu-Manber there's no skipping, every octet is looked at
+ * exactly once, but there's also no dependency on the length of the
+ * shortest pattern which makes it the engine of choice for sets of
+ * short-ish patterns with rare prefixes.
  *
  **/
 #if defined HAVE_CONFIG_H
 # include "config.h"
 #endif	/* HAVE_CONFIG_H */
 #include <unistd.h>
-#include <stdarg.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
 #include "nifty.h"
 #include "glep.h"
+#include "freundt-rabin-karp-guts.h"
 
 /* type for xfixes (suffix, prefix, infix, etc.) */
-typedef uint_fast32_t xfix4_t;
+typedef uint32_t xfix4_t;
 /* type for small xfixes (suffix, prefix, infix, etc.) */
 typedef uint_fast8_t xfix1_t;
+/* hash type */
+typedef uint_fast32_t hx_t;
 
 #if !defined CHAR_BIT
 # define CHAR_BIT	(8U)
 #endif	/* CHAR_BIT */
 
+/* bounds for the size of the bucket table, as powers of 2 */
+#define TBL_MINB	(10U)
+#define TBL_MAXB	(20U)
+
+/* cost model for the planner, in ns per KiB of text as measured on
+ * english news text, the scan itself and the surcharge for each octet
+ * that hits an occupied bucket (scaled by 1 / probability) */
+#define COST_SCAN	(1460U)
+#define COST_HINT	(17000U)
+
 /* compiled cell, big prefix */
 struct ccc4_s {
-	/** prefix */
+	/** prefix, folded to lower case */
 	xfix4_t pre;
 	/** index into pattern array */
-	size_t idx;
-};
-
-struct ccc1_s {
-	/** prefix */
-	xfix1_t pre;
-	/** index into pattern array */
-	size_t idx;
+	uint32_t idx;
 };
 
 struct glepcc_s {
-	/** size of 4octet-prefix map */
+	/** size of the bucket table, as power of 2, and as such */
+	unsigned int zb;
+	size_t z;
+	/** number of cells */
 	size_t nc;
-	/* hinter */
-	size_t hints[256U];
-	/** map from 4octet-prefix to pattern index */
-	struct ccc4_s c[];
+	/** offset of each bucket's first cell in C, Z + 1 entries */
+	uint32_t *hints;
+	/** map from 4octet-prefix to pattern index, in bucket order */
+	struct ccc4_s *c;
+
+	/* the original pats */
+	glod_pats_t p;
+	/* non-zero if the tables live in a database */
+	int mapped;
+
+	/* octets that hit an occupied bucket, for --engine-stats,
+	 * fingerprint matches among them and actual matches */
+	uint64_t ncand;
+	uint64_t nvrfy;
+	uint64_t nmtch;
+};
+
+/* database record of the above, tables by offset */
+struct ccrec_s {
+	uint32_t zb;
+	uint32_t nc;
+	uint64_t hints;
+	uint64_t c;
 };
 
 #if defined __INTEL_COMPILER
 # define auto	static
 #endif	/* __INTEL_COMPILER */
 
-
+
 /* aux */
 static uint_fast8_t xlcase[] = {
 #define x(c)	(c) + 0U, (c) + 1U, (c) + 2U, (c) + 3U
@@ -101,23 +138,46 @@ static uint_fast8_t xlcase[] = {
 	'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',
 	'p', 'q', 'r', 's', 't', 'u', 'v', 'w',
 	'x', 'y', 'z', 'Z' + 1U, 'Z' + 2U, 'Z' + 3U, 'Z' + 4U, 'Z' + 5U,
-	y('Z' + 6U + 0U), y('Z' + 6U + 16U), y('Z' + 6U + 32U),
+	y('Z' + 6U + 0U), y('Z' + 6U + 16U), /* <- that's all ASCIIs  */
+	y('Z' + 6U + 32U), y('Z' + 6U + 48U),
+	y('Z' + 6U + 64U), y('Z' + 6U + 80U),
+	y('Z' + 6U + 96U), y('Z' + 6U + 112U),
+	y('Z' + 6U + 128U), y('Z' + 6U + 144U),
 #undef x
 #undef y
 };
 
 static inline bool
-xalnump(const unsigned char c)
+xpuncsp(const char c)
 {
-/* if c is 0-9A-Za-z */
-	switch (c) {
-	case '0' ... '9':
-	case 'A' ... 'Z':
-	case 'a' ... 'z':
+/* looks for <=' ', '!', ',', '.', ':', ';', '?' '\'', '"', '`', '-' */
+
+	/* check for <=SPC, !, " */
+	if ((non_ascii_wordsep_p || c >= '\0') && c <= '"') {
+		return true;
+	}
+
+	/* check for '() */
+	if (c >= '\'' && c <= ')') {
+		return true;
+	}
+
+	/* check for ,-. */
+	if (c >= ',' && c <= '.') {
+		return true;
+	}
+
+	/* check for :; */
+	if (c == ':' || c == ';') {
+		return true;
+	}
+
+	/* check for ?` */
+	if (c == '?' || c == '`') {
 		return true;
-	default:
-		break;
 	}
+
+	/* otherwise it's nothing */
 	return false;
 }
 
@@ -125,45 +185,28 @@ xalnump(const unsigned char c)
 # pragma warning (disable:981)
 #endif	/* __INTEL_COMPILER */
 
-static size_t
-xcmp(const char *s1, const unsigned char *s2)
+static bool
+xicmp(const char *s1, const unsigned char *s2, size_t n)
 {
-/* compare S1 to S2, allowing S1 to end prematurely,
- * return S1's length if strings are equal and 0 otherwise. */
+/* compare the N octets of S1 and S2 case-insensitively */
 	register const uint8_t *p1 = (const uint8_t*)s1;
 	register const uint8_t *p2 = (const uint8_t*)s2;
 
-	do {
-		if (UNLIKELY(!*p1)) {
-			return p1 - (const uint8_t*)s1;
+	for (const uint8_t *const ep = p1 + n; p1 < ep; p1++, p2++) {
+		if (xlcase[*p1] != xlcase[*p2]) {
+			return false;
 		}
-	} while (*p1++ == *p2++);
-	return 0U;
-}
-
-static size_t
-xicmp(const char *s1, const unsigned char *s2)
-{
-/* compare S1 to S2 case-insensitively, allowing S1 to end prematurely,
- * return S1's length if strings are equal and 0 otherwise. */
-	register const uint8_t *p1 = (const uint8_t*)s1;
-	register const uint8_t *p2 = (const uint8_t*)s2;
-
-	do {
-		if (UNLIKELY(!*p1)) {
-			return p1 - (const uint8_t*)s1;
-		}
-	} while (xlcase[*p1++] == xlcase[*p2++]);
-	return 0U;
+	}
+	return true;
 }
 
-static inline __attribute__((const, pure)) xfix1_t
+static inline __attribute__((pure)) xfix1_t
 prefix1(const char s[static 1U])
 {
-	return (xfix1_t)*s;
+	return (xfix1_t)xlcase[(unsigned char)*s];
 }
 
-static inline __attribute__((const, pure)) xfix4_t
+static inline __attribute__((pure)) xfix4_t
 prefix4(const char s[static 4U])
 {
 	xfix1_t s0 = prefix1(s + 0U);
@@ -174,142 +217,268 @@ prefix4(const char s[static 4U])
 	return (((s0 << CHAR_BIT) | s1) << CHAR_BIT | s2) << CHAR_BIT | s3;
 }
 
-static inline __attribute__((const, pure)) xfix4_t
+static inline __attribute__((const)) xfix4_t
 roll4(xfix4_t r, xfix1_t nu)
 {
 	register xfix4_t n = nu;
 	return ((r << CHAR_BIT) | n) & 0xffffffffU;
 }
 
-static inline __attribute__((const, pure)) xfix1_t
-prefix421(xfix4_t f)
+static inline __attribute__((pure)) hx_t
+prefixh(glepcc_t ctx, xfix4_t f)
 {
-	return (f >> 24U) & 0xffU;
+/* multiplicative hashing of prefix F into the bucket table */
+	return (hx_t)((uint32_t)(f * 0x9e3779b1U) >> (32U - ctx->zb));
 }
 
-
-/* sorter */
-#define T	struct ccc4_s
-
-static inline __attribute__((const, pure)) bool
-compare(T c1, T c2)
+static unsigned int
+find_zb(size_t nc)
 {
-	return c1.pre < c2.pre;
+/* keep the table no more than an eighth full */
+	unsigned int zb = TBL_MINB;
+
+	while (zb < TBL_MAXB && ((size_t)1U << zb) < 8U * nc) {
+		zb++;
+	}
+	return zb;
 }
 
-#include "wikisort.c"
 
-static void
-sort_ccc4(struct ccc4_s *restrict c, size_t nc)
+/* glep.h engine api */
+size_t
+rabin_karp_cost(glod_pats_t g)
 {
-	WikiSort(c, nc);
-	return;
-}
+/* estimate the scanning cost of G in ns per KiB of text, every octet
+ * costs a roll and a hint look-up, the octets that land in an occupied
+ * bucket, that's about nc / z of them, cost a cell walk on top */
+	size_t nc = 0U;
 
-
-/* glep.h engine api */
-#include <stdio.h>
+	for (size_t i = 0U; i < g->npats; i++) {
+		nc += g->pats[i].n >= sizeof(xfix4_t);
+	}
+	if (UNLIKELY(!nc)) {
+		return 0U;
+	}
+	return COST_SCAN + ((COST_HINT * nc) >> find_zb(nc));
+}
 
-int
-glep_cc(gleps_t g)
+glepcc_t
+rabin_karp_cc(glod_pats_t g)
 {
 	struct glepcc_s *res;
 
-	res = malloc(sizeof(*res) + 256U * sizeof(*res->c));
-	res->nc = 0U;
-
-	/* calc hashes */
+	if (UNLIKELY((res = calloc(1, sizeof(*res))) == NULL)) {
+		return NULL;
+	}
 	for (size_t i = 0U; i < g->npats; i++) {
-		const glep_pat_t pat = g->pats[i];
-		size_t z = pat.n;
-
-		if (UNLIKELY(z == 0UL)) {
-			;
-		} else if (LIKELY(z < sizeof(res->c->pre))) {
-			;
-		} else {
-			xfix4_t pre = prefix4(pat.s);
-
-			if (!(res->nc % 256U)) {
-				size_t nu = (res->nc + 256U) * sizeof(*res->c);
-				res = realloc(res, sizeof(*res) + nu);
-			}
-			res->c[res->nc++] = (struct ccc4_s){pre, i};
-		}
+		res->nc += g->pats[i].n >= sizeof(res->c->pre);
 	}
-
-	/* sort cell array */
-	sort_ccc4(res->c, res->nc);
-
-	if (!(res->nc % 256U)) {
-		size_t nu = (res->nc + 1U) * sizeof(*res->c);
-		res = realloc(res, sizeof(*res) + nu);
+	res->zb = find_zb(res->nc);
+	res->z = (size_t)1U << res->zb;
+	res->hints = calloc(res->z + 1U, sizeof(*res->hints));
+	res->c = malloc((res->nc + 1U) * sizeof(*res->c));
+	res->p = g;
+
+	if (UNLIKELY(res->hints == NULL || res->c == NULL)) {
+		rabin_karp_fr(res);
+		return NULL;
 	}
-	res->c[res->nc++] = (struct ccc4_s){0xffffffffU, g->npats};
 
-	memset(res->hints, 0, sizeof(res->hints));
-	for (size_t i = 0; i < res->nc; i++) {
-		xfix1_t h = prefix421(res->c[i].pre);
+	/* count cells per bucket, then integrate and distribute,
+	 * back to front so every bucket's cells end up in pattern order */
+	for (size_t i = 0U; i < g->npats; i++) {
+		const glod_pat_t pat = g->pats[i];
 
-		if (res->hints[h] == 0U) {
-			res->hints[h] = i + 1U;
+		if (UNLIKELY(pat.n < sizeof(res->c->pre))) {
+			/* small pattern, not for us */
+			continue;
 		}
+		res->hints[prefixh(res, prefix4(pat.p)) + 1U]++;
 	}
+	for (size_t i = 1U; i <= res->z; i++) {
+		res->hints[i] += res->hints[i - 1U];
+	}
+	with (uint32_t *fill = malloc((res->z + 1U) * sizeof(*fill))) {
+		if (UNLIKELY(fill == NULL)) {
+			rabin_karp_fr(res);
+			return NULL;
+		}
+		memcpy(fill, res->hints, (res->z + 1U) * sizeof(*fill));
+		for (size_t i = 0U; i < g->npats; i++) {
+			const glod_pat_t pat = g->pats[i];
 
-	with (struct gleps_s *pg = deconst(g)) {
-		pg->ctx = res;
+			if (UNLIKELY(pat.n < sizeof(res->c->pre))) {
+				continue;
+			}
+			with (xfix4_t pre = prefix4(pat.p)) {
+				const hx_t h = prefixh(res, pre);
+
+				res->c[fill[h]++] = (struct ccc4_s){
+					pre, (uint32_t)i,
+				};
+			}
+		}
+		free(fill);
 	}
-	return 0;
+	return res;
 }
 
 /**
  * Free our context object. */
 void
-glep_fr(gleps_t g)
+rabin_karp_fr(glepcc_t g)
 {
-	with (struct gleps_s *pg = deconst(g)) {
-		if (LIKELY(pg->ctx != NULL)) {
-			free(pg->ctx);
+	with (struct glepcc_s *pg = deconst(g)) {
+		if (UNLIKELY(pg == NULL)) {
+			break;
+		} else if (pg->mapped) {
+			free(pg);
+			break;
+		}
+		if (pg->hints != NULL) {
+			free(pg->hints);
+		}
+		if (pg->c != NULL) {
+			free(pg->c);
 		}
+		free(pg);
 	}
 	return;
 }
 
 int
-glep_gr(glep_mset_t ms, gleps_t g, const char *buf, size_t bsz)
+rabin_karp_gr(gcnt_t *restrict cnt, ghits_t hits,
+	      glepcc_t g, const char *buf, size_t bsz)
 {
-	const struct glepcc_s *cc = g->ctx;
-	register xfix4_t rh = 0U;
+	const unsigned char *const bp = (const unsigned char*)buf;
+	/* matches must start before EP, the rest belongs to the next chunk */
+	const size_t ep = bsz < CHUNKZ ? bsz : CHUNKZ - MWNDWZ;
+	const struct ccc4_s *const c = g->c;
+	const uint32_t *const hints = g->hints;
+	register xfix4_t rh;
+	uint_fast64_t ncand = 0U;
+	uint_fast64_t nvrfy = 0U;
+	int nmtch = 0;
+
+	if (UNLIKELY(bsz < sizeof(rh))) {
+		return 0;
+	}
+	/* preload the window with the first 3 octets */
+	rh = prefix1(buf + 0U);
+	rh = roll4(rh, prefix1(buf + 1U));
+	rh = roll4(rh, prefix1(buf + 2U));
 
-	for (const char *bp = buf, *const ep = buf + bsz; bp < ep; bp++) {
-		const xfix1_t c = prefix1(bp);
-		/* update rolling hash and determine hinter hash*/
-		const xfix1_t h = (rh = roll4(rh, c), prefix421(rh));
+	for (size_t sp = 0U, i = 3U; sp < ep && i < bsz; sp++, i++) {
+		/* update rolling hash and determine bucket */
+		const hx_t h = (rh = roll4(rh, prefix1(buf + i)), prefixh(g, rh));
 
-		if (!cc->hints[h]) {
+		if (LIKELY(hints[h] == hints[h + 1U])) {
 			continue;
 		}
-		for (size_t i = cc->hints[h] - 1U; i < cc->nc; i++) {
-			if (LIKELY(cc->c[i].pre < rh)) {
-				;
-			} else if (cc->c[i].pre > rh) {
-				break;
-			} else {
-				size_t j = cc->c[i].idx;
-				glep_pat_t p = g->pats[j];
-
-				if (0) {
-				match:
-					glep_mset_set(ms, i);
-				} else if (UNLIKELY(xcmp(p.s + 4U, bp + 1U))) {
-					goto match;
-				} else if (p.fl.ci && xicmp(p.s + 4U, bp + 1U)) {
-					goto match;
-				}
+		ncand++;
+		for (size_t j = hints[h]; j < hints[h + 1U]; j++) {
+			const glod_pat_t p = g->p->pats[c[j].idx];
+
+			if (c[j].pre != rh) {
+				continue;
+			}
+			nvrfy++;
+			gpst_vrfy(p.idx);
+			if (UNLIKELY(sp + p.n > bsz)) {
+				continue;
+			} else if (!p.fl.ci && memcmp(bp + sp, p.p, p.n)) {
+				continue;
+			} else if (p.fl.ci && !xicmp(p.p + 4U, bp + i + 1U,
+						     p.n - 4U)) {
+				continue;
+			} else if (!p.fl.left && sp && !xpuncsp(bp[sp - 1U])) {
+				continue;
+			} else if (!p.fl.right &&
+				   sp + p.n < bsz && !xpuncsp(bp[sp + p.n])) {
+				continue;
 			}
+			/* MATCH */
+			cnt[p.idx]++;
+			nmtch++;
+			if (UNLIKELY(hits != NULL)) {
+				ghits_add(hits, p.idx, sp);
+			}
+		}
+	}
+	if (UNLIKELY(engine_stats_p)) {
+		__atomic_add_fetch(&g->ncand, ncand, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g->nvrfy, nvrfy, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g->nmtch, nmtch, __ATOMIC_RELAXED);
+	}
+	return nmtch;
+}
+
+uint64_t
+rabin_karp_ncand(glepcc_t g)
+{
+/* number of bucket hits, requires engine_stats_p */
+	return g->ncand;
+}
+
+void
+rabin_karp_stats(glepcc_t g)
+{
+	fprintf(stderr, "rabin-karp\tbucket hits\t%" PRIu64 "\n", g->ncand);
+	fprintf(stderr, "rabin-karp\tverified\t%" PRIu64 "\n", g->nvrfy);
+	fprintf(stderr, "rabin-karp\tmatches\t%" PRIu64 "\n", g->nmtch);
+	return;
+}
+
+size_t
+rabin_karp_wr(gdbw_t w, glepcc_t g)
+{
+	struct ccrec_s r = {
+		.zb = g->zb,
+		.nc = (uint32_t)g->nc,
+		.hints = gdbw_put(w, g->hints, (g->z + 1U) * sizeof(*g->hints)),
+		.c = gdbw_put(w, g->c, (g->nc + 1U) * sizeof(*g->c)),
+	};
+
+	if (UNLIKELY(!r.hints || !r.c)) {
+		return 0U;
+	}
+	return gdbw_put(w, &r, sizeof(r));
+}
+
+glepcc_t
+rabin_karp_rd(gdb_t d, size_t o, glod_pats_t g)
+{
+	const struct ccrec_s *r;
+	struct glepcc_s *res;
+
+	if (UNLIKELY((r = gdb_get(d, o, sizeof(*r))) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY(r->zb < TBL_MINB || r->zb > TBL_MAXB)) {
+		return NULL;
+	} else if (UNLIKELY((res = calloc(1, sizeof(*res))) == NULL)) {
+		return NULL;
+	}
+	res->zb = r->zb;
+	res->z = (size_t)1U << r->zb;
+	res->nc = r->nc;
+	res->hints = deconst(
+		gdb_get(d, r->hints, (res->z + 1U) * sizeof(*res->hints)));
+	res->c = deconst(gdb_get(d, r->c, (res->nc + 1U) * sizeof(*res->c)));
+	res->p = g;
+	res->mapped = 1;
+
+	if (UNLIKELY(res->hints == NULL || res->c == NULL)) {
+		free(res);
+		return NULL;
+	}
+	/* cells must refer to patterns of G */
+	for (size_t i = 0U; i < res->nc; i++) {
+		if (UNLIKELY(res->c[i].idx >= g->npats)) {
+			free(res);
+			return NULL;
 		}
 	}
-	return 0;
+	return res;
 }
 
-/* freundt-javaux-guts.c ends here */
+/* freundt-rabin-karp-guts.c ends here */
@@ -0,0 +1,17 @@
+#if !defined INCLUDED_freundt_rabin_karp_guts_h_
+#define INCLUDED_freundt_rabin_karp_guts_h_
+
+#include "glep.h"
+#include "glep-db.h"
+
+extern glepcc_t rabin_karp_cc(glod_pats_t);
+extern int rabin_karp_gr(gcnt_t *restrict, ghits_t, glepcc_t, const char *b, size_t z);
+extern void rabin_karp_fr(glepcc_t);
+extern size_t rabin_karp_cost(glod_pats_t);
+extern uint64_t rabin_karp_ncand(glepcc_t);
+extern void rabin_karp_stats(glepcc_t);
+
+extern size_t rabin_karp_wr(gdbw_t, glepcc_t);
+extern glepcc_t rabin_karp_rd(gdb_t, size_t o, glod_pats_t);
+
+#endif	/* INCLUDED_freundt_rabin_karp_guts_h_ */
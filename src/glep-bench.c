@@ -0,0 +1,418 @@
+/*** glep-bench.c -- throughput of glep engines
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include "glep.h"
+#include "glep-simd-guts.h"
+#include "wu-manber-guts.h"
+#include "freundt-rabin-karp-guts.h"
+#include "aho-corasick-guts.h"
+#include "pats.h"
+#include "nifty.h"
+
+/* nanoseconds per second */
+#define NSEC		(1000000000ULL)
+
+/* the engines want these */
+bool non_ascii_wordsep_p = false;
+bool engine_stats_p = false;
+struct gpst_s *pat_stats = NULL;
+
+static const struct engine_s {
+	const char *name;
+	/* range of pattern lengths the engine is fit for */
+	size_t minn;
+	size_t maxn;
+	glepcc_t(*cc)(glod_pats_t);
+	int(*gr)(gcnt_t *restrict, ghits_t, glepcc_t, const char*, size_t);
+	void(*fr)(glepcc_t);
+	/* number of candidates, or NULL if the engine has no notion */
+	uint64_t(*ncand)(glepcc_t);
+	/* pin a variant, or NULL if the engine has none */
+	int(*pin)(const char*);
+} engines[] = {
+	{"simd", 1U, 8U,
+	 glep_simd_cc, glep_simd_gr, glep_simd_fr, glep_simd_ncand,
+	 glep_simd_pin},
+	{"wm", 3U, 255U,
+	 wu_manber_cc, wu_manber_gr, wu_manber_fr, wu_manber_ncand,
+	 wu_manber_pin},
+	{"rk", 4U, 255U,
+	 rabin_karp_cc, rabin_karp_gr, rabin_karp_fr, rabin_karp_ncand,
+	 NULL},
+	{"ac", 1U, 255U,
+	 aho_corasick_cc, aho_corasick_gr, aho_corasick_fr, NULL,
+	 NULL},
+};
+
+static const char *const variants[] = {"seq", "64", "128", "256", "512"};
+
+/* pattern set specs */
+struct spec_s {
+	size_t npats;
+	size_t minn;
+	size_t maxn;
+	unsigned int ci;
+};
+
+
+static char*
+gen_corpus(size_t z)
+{
+/* generate Z bytes of words and punctuation resembling news text */
+	static const char alpha[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+		"abcdefghijklmnopqrstuvwxyzeeeeeaaaiiiooonnnrrrsss"
+		"0123456789";
+	static const char *const seps[] = {" ", " ", " ", ", ", ". ", "\n"};
+	char *res;
+
+	if (UNLIKELY((res = malloc(z)) == NULL)) {
+		return NULL;
+	}
+	for (size_t i = 0U; i < z;) {
+		const size_t wz = 1U + rand() % 9U;
+		const char *s = seps[rand() % countof(seps)];
+
+		for (size_t j = 0U; j < wz && i < z; j++) {
+			res[i++] = alpha[rand() % (sizeof(alpha) - 1U)];
+		}
+		for (; *s && i < z; s++) {
+			res[i++] = *s;
+		}
+	}
+	return res;
+}
+
+static glod_pats_t
+gen_pats(const char *corp, size_t z, struct spec_s sp)
+{
+/* generate patterns as per SP, half of them are lifted off word starts
+ * in the corpus CORP of size Z so there's something to find, the other
+ * half are random letters, case-insensitive ones are upcased so they
+ * only match as such, some of them are pre-, suf- or infixes */
+	static const char alpha[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	struct glod_pats_s *res;
+	char *s;
+
+	res = calloc(1, sizeof(*res) + sp.npats * sizeof(*res->pats));
+	if (UNLIKELY(res == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((s = malloc(sp.npats * (sp.maxn + 1U))) == NULL)) {
+		free(res);
+		return NULL;
+	}
+	for (size_t i = 0U; i < sp.npats; i++, s += sp.maxn + 1U) {
+		const size_t n = sp.minn + rand() % (sp.maxn - sp.minn + 1U);
+		const unsigned int r = rand();
+		const bool ci = r % 100U < sp.ci;
+
+		if (r / 100U % 2U && z > 2U * n) {
+			/* start at a word so the left boundary holds */
+			size_t o = rand() % (z - 2U * n);
+
+			for (; o < z - n - 1U && corp[o] > ' '; o++);
+			memcpy(s, corp + o + 1U, n);
+		} else {
+			for (size_t j = 0U; j < n; j++) {
+				s[j] = alpha[rand() % (sizeof(alpha) - 1U)];
+			}
+		}
+		for (size_t j = 0U; ci && j < n; j++) {
+			if (s[j] >= 'a' && s[j] <= 'z') {
+				s[j] = (char)(s[j] - 'a' + 'A');
+			}
+		}
+		s[n] = '\0';
+		res->pats[i] = (glod_pat_t){
+			.fl.ci = ci,
+			.fl.left = !(r / 200U % 5U),
+			.fl.right = !(r / 1000U % 5U),
+			.n = n,
+			.p = s,
+			.idx = i,
+		};
+	}
+	res->npats = sp.npats;
+	return res;
+}
+
+static void
+free_pats(glod_pats_t p)
+{
+	with (struct glod_pats_s *pp = deconst(p)) {
+		free(deconst(pp->pats[0U].p));
+		free(pp);
+	}
+	return;
+}
+
+static double
+now(void)
+{
+	struct timespec tsp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tsp);
+	return (double)tsp.tv_sec + (double)tsp.tv_nsec / (double)NSEC;
+}
+
+static inline uint64_t
+tsc(void)
+{
+/* time stamp counter, or 0 where there's none */
+#if defined __x86_64__ || defined __i386__
+	return __builtin_ia32_rdtsc();
+#else  /* !x86 */
+	return 0U;
+#endif	/* x86 */
+}
+
+static int
+scan(gcnt_t *restrict cnt, const struct engine_s *e, glepcc_t cc,
+     const char *corp, size_t z)
+{
+/* present the corpus chunk by chunk, like glep does */
+	int nmtch = 0;
+
+	for (size_t o = 0U; o < z; o += CHUNKZ - MWNDWZ) {
+		const size_t bz = z - o < CHUNKZ ? z - o : CHUNKZ;
+
+		nmtch += e->gr(cnt, NULL, cc, corp + o, bz);
+	}
+	return nmtch;
+}
+
+static int
+bench(const char *corp, size_t z, const struct engine_s *e,
+      const char *variant, glod_pats_t p, struct spec_s sp)
+{
+	glepcc_t cc;
+	gcnt_t *cnt;
+	uint64_t c;
+	double t;
+	int nmtch;
+
+	if (UNLIKELY((cc = e->cc(p)) == NULL)) {
+		return -1;
+	} else if (UNLIKELY((cnt = calloc(p->npats, sizeof(*cnt))) == NULL)) {
+		e->fr(cc);
+		return -1;
+	}
+
+	/* timed run, without the counters */
+	engine_stats_p = false;
+	t = now();
+	c = tsc();
+	scan(cnt, e, cc, corp, z);
+	c = tsc() - c;
+	t = now() - t;
+
+	printf("%s\t%s\t%zu\t%zu-%zu\t%u\t%zu\t%.6f\t%.3f\t%.3f",
+	       e->name, variant, sp.npats, sp.minn, sp.maxn, sp.ci,
+	       z, t, (double)z / t / (double)NSEC, (double)c / (double)z);
+
+	if (e->ncand != NULL) {
+		/* counted run */
+		engine_stats_p = true;
+		nmtch = scan(cnt, e, cc, corp, z);
+		engine_stats_p = false;
+		with (const uint64_t nc = e->ncand(cc)) {
+			printf("\t%.3f", (double)(nc * 1024U) / (double)z);
+			if (!nc) {
+				/* no candidates, nothing to divide by */
+				puts("\t-\t-");
+				break;
+			}
+			printf("\t%g\t%.2f\n", (double)nmtch / (double)nc,
+			       t * (double)NSEC / (double)nc);
+		}
+	} else {
+		puts("\t-\t-\t-");
+	}
+
+	free(cnt);
+	e->fr(cc);
+	return 0;
+}
+
+static bool
+listp(const char *list, const char *x)
+{
+/* check if X is in the comma-separated LIST, NULL means everything */
+	const size_t xz = strlen(x);
+
+	if (list == NULL) {
+		return true;
+	}
+	for (const char *lp = list; (lp = strstr(lp, x)) != NULL; lp += xz) {
+		if ((lp == list || lp[-1] == ',') &&
+		    (lp[xz] == ',' || lp[xz] == '\0')) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static int
+bench_spec(const char *corp, size_t z, struct spec_s sp,
+	   const char *englst, const char *varlst)
+{
+	glod_pats_t p;
+	int rc = 0;
+
+	if (UNLIKELY((p = gen_pats(corp, z, sp)) == NULL)) {
+		return -1;
+	}
+	for (size_t i = 0U; i < countof(engines) && rc >= 0; i++) {
+		const struct engine_s *e = engines + i;
+
+		if (!listp(englst, e->name)) {
+			continue;
+		} else if (sp.minn < e->minn || sp.maxn > e->maxn) {
+			/* not fit for these patterns */
+			continue;
+		} else if (e->pin == NULL) {
+			rc = bench(corp, z, e, "-", p, sp);
+			continue;
+		}
+		for (size_t j = 0U; j < countof(variants) && rc >= 0; j++) {
+			if (!listp(varlst, variants[j])) {
+				continue;
+			} else if (e->pin(variants[j]) < 0) {
+				/* not compiled in or not supported */
+				continue;
+			}
+			rc = bench(corp, z, e, variants[j], p, sp);
+		}
+	}
+	free_pats(p);
+	return rc;
+}
+
+
+#include "glep-bench.yucc"
+
+int
+main(int argc, char *argv[])
+{
+	yuck_t argi[1U];
+	const char *npats = "1,10,100,1000,5000";
+	const char *lens = "1-4,3-8,4-16";
+	const char *cis = "10";
+	size_t z = 16U * 1024U * 1024U;
+	char *corp;
+	int rc = 0;
+
+	if (yuck_parse(argi, argc, argv)) {
+		rc = 1;
+		goto out;
+	}
+
+	if (argi->npats_arg) {
+		npats = argi->npats_arg;
+	}
+	if (argi->length_arg) {
+		lens = argi->length_arg;
+	}
+	if (argi->ci_arg) {
+		cis = argi->ci_arg;
+	}
+	if (argi->size_arg) {
+		z = strtoul(argi->size_arg, NULL, 10) * 1024U * 1024U;
+	}
+	srand(argi->seed_arg ? strtoul(argi->seed_arg, NULL, 10) : 1U);
+
+	if (UNLIKELY((corp = gen_corpus(z)) == NULL)) {
+		rc = 1;
+		goto out;
+	}
+	puts("engine\tvariant\tnpats\tlength\tci%\tbytes\tsecs\tGB/s\t"
+	     "cyc/B\tcand/KB\tmtch/cand\tns/cand");
+	for (const char *lp = lens; *lp && !rc;) {
+		char *on;
+		struct spec_s sp = {.minn = strtoul(lp, &on, 10)};
+
+		sp.maxn = *on == '-' ? strtoul(on + 1U, &on, 10) : sp.minn;
+		if (!sp.minn || sp.maxn < sp.minn || sp.maxn > 255U ||
+		    (*on && *on != ',')) {
+			/* garbage in the list */
+			rc = 1;
+			break;
+		}
+		for (lp = on; *lp == ','; lp++);
+
+		for (const char *cp = cis; *cp && !rc;) {
+			sp.ci = strtoul(cp, &on, 10);
+			if (sp.ci > 100U || (*on && *on != ',')) {
+				rc = 1;
+				break;
+			}
+			for (cp = on; *cp == ','; cp++);
+
+			for (const char *np = npats; *np;) {
+				sp.npats = strtoul(np, &on, 10);
+
+				if (sp.npats &&
+				    bench_spec(corp, z, sp,
+					       argi->engine_arg,
+					       argi->variant_arg) < 0) {
+					rc = 1;
+					break;
+				}
+				for (np = on; *np == ','; np++);
+				if (on == np && *np) {
+					/* garbage in the list */
+					rc = 1;
+					break;
+				}
+			}
+		}
+	}
+	free(corp);
+
+out:
+	yuck_free(argi);
+	return rc;
+}
+
+/* glep-bench.c ends here */
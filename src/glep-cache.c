@@ -0,0 +1,515 @@
+/*** glep-cache.c -- persistent per-file result cache
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include "glep-cache.h"
+#include "fops.h"
+#include "nifty.h"
+
+#define CACHE_MAGIC	"glepcch2"
+#define CACHE_MAGICZ	(sizeof(CACHE_MAGIC) - 1U)
+
+/* record header, followed by the file name and the output, the lot
+ * NUL-padded to a multiple of 8 octets, CSUM is the FNV-1a hash of
+ * all that with CSUM itself taken as 0 */
+struct gcrec_s {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	/** modification time in nanoseconds */
+	int64_t mtime;
+	uint64_t cookie;
+	uint32_t fnz;
+	uint32_t outz;
+	uint32_t flags;
+	uint32_t csum;
+};
+
+/* the file had matches */
+#define FL_FOUND	(1U)
+
+struct gcslot_s {
+	const struct gcrec_s *r;
+	/* the file changed, a newer record is on its way */
+	bool stale_p;
+};
+
+struct gcache_s {
+	char *fn;
+	uint64_t cookie;
+	/* files modified after this aren't put, see gcache_put() */
+	time_t t0;
+	glodfn_t f;
+	/* octets of the file that make up whole records */
+	size_t valid;
+	/* records in the file, and distinct files among them */
+	size_t nrec;
+	size_t nlive;
+	/* open addressing, ZTBL is a power of 2 */
+	struct gcslot_s *tbl;
+	size_t ztbl;
+
+	/* records put since opening */
+	pthread_mutex_t mtx;
+	char *nu;
+	size_t nnu;
+	size_t znu;
+};
+
+
+static inline size_t
+rec_len(const struct gcrec_s *r)
+{
+	return sizeof(*r) + ((r->fnz + r->outz + 7U) & ~7U);
+}
+
+static uint32_t
+rec_csum(const struct gcrec_s *r)
+{
+	struct gcrec_s h = *r;
+	const unsigned char *p = (const void*)&h;
+	uint32_t x = 0x811c9dc5U;
+
+	h.csum = 0U;
+	for (size_t i = 0U; i < sizeof(h); i++) {
+		x ^= p[i];
+		x *= 0x01000193U;
+	}
+	p = (const void*)(r + 1U);
+	for (size_t i = 0U, n = rec_len(r) - sizeof(*r); i < n; i++) {
+		x ^= p[i];
+		x *= 0x01000193U;
+	}
+	return x;
+}
+
+static inline int64_t
+mtime_ns(const struct stat *st)
+{
+	return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+static uint64_t
+hash_id(uint64_t dev, uint64_t ino, uint64_t cookie, const char *fn, size_t fz)
+{
+/* FNV-1a over the identity of a record */
+	uint64_t h = 0xcbf29ce484222325ULL;
+	const uint64_t k[] = {dev, ino, cookie};
+
+	for (size_t i = 0U; i < sizeof(k); i++) {
+		h ^= ((const unsigned char*)k)[i];
+		h *= 0x100000001b3ULL;
+	}
+	for (size_t i = 0U; i < fz; i++) {
+		h ^= (unsigned char)fn[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static inline bool
+same_p(const struct gcrec_s *r,
+       uint64_t dev, uint64_t ino, uint64_t cookie, const char *fn, size_t fz)
+{
+	return r->dev == dev && r->ino == ino && r->cookie == cookie &&
+		r->fnz == fz && !memcmp(r + 1U, fn, fz);
+}
+
+static struct gcslot_s*
+find_slot(struct gcache_s *c,
+	  uint64_t dev, uint64_t ino, uint64_t cookie, const char *fn, size_t fz)
+{
+/* return the slot of the file with the given identity, or the empty
+ * slot where it would go */
+	const size_t m = c->ztbl - 1U;
+
+	for (size_t i = hash_id(dev, ino, cookie, fn, fz) & m;; i = (i + 1U) & m) {
+		const struct gcrec_s *r = c->tbl[i].r;
+
+		if (r == NULL || same_p(r, dev, ino, cookie, fn, fz)) {
+			return c->tbl + i;
+		}
+	}
+}
+
+static int
+load(struct gcache_s *c)
+{
+/* index the records in C's file, newer records of a file supersede
+ * older ones */
+	const char *d = c->f.fb.d;
+	const size_t z = c->f.fb.z;
+	size_t off;
+
+	if (z < CACHE_MAGICZ || memcmp(d, CACHE_MAGIC, CACHE_MAGICZ - 1U)) {
+		/* not ours, we better not touch it */
+		errno = EINVAL;
+		return -1;
+	} else if (d[CACHE_MAGICZ - 1U] != CACHE_MAGIC[CACHE_MAGICZ - 1U]) {
+		/* ours but of another version, start afresh */
+		c->ztbl = 64U;
+		c->tbl = calloc(c->ztbl, sizeof(*c->tbl));
+		return c->tbl != NULL ? 0 : -1;
+	}
+	for (off = CACHE_MAGICZ; off + sizeof(struct gcrec_s) <= z;) {
+		const struct gcrec_s *r = (const void*)(d + off);
+
+		if (off + rec_len(r) > z || rec_csum(r) != r->csum) {
+			/* torn, or garbled, this and everything after
+			 * it goes with the next rewrite */
+			break;
+		}
+		c->nrec++;
+		off += rec_len(r);
+	}
+	c->valid = off;
+
+	for (c->ztbl = 64U; c->ztbl < 2U * c->nrec; c->ztbl *= 2U);
+	if (UNLIKELY((c->tbl = calloc(c->ztbl, sizeof(*c->tbl))) == NULL)) {
+		return -1;
+	}
+	for (off = CACHE_MAGICZ; off < c->valid;) {
+		const struct gcrec_s *r = (const void*)(d + off);
+		struct gcslot_s *s = find_slot(
+			c, r->dev, r->ino, r->cookie,
+			(const char*)(r + 1U), r->fnz);
+
+		c->nlive += s->r == NULL;
+		s->r = r;
+		off += rec_len(r);
+	}
+	return 0;
+}
+
+
+gcache_t
+gcache_open(const char *fn, uint64_t cookie)
+{
+	struct gcache_s *res;
+	struct stat st;
+
+	if (UNLIKELY((res = calloc(1U, sizeof(*res))) == NULL)) {
+		return NULL;
+	}
+	res->f.fd = -1;
+	res->cookie = cookie;
+	res->t0 = time(NULL);
+	pthread_mutex_init(&res->mtx, NULL);
+	if (UNLIKELY((res->fn = strdup(fn)) == NULL)) {
+		goto nope;
+	}
+	if (stat(fn, &st) < 0) {
+		if (errno != ENOENT) {
+			goto nope;
+		}
+		st.st_size = 0;
+	}
+	if (!st.st_size) {
+		/* start afresh */
+		res->ztbl = 64U;
+		if (UNLIKELY((res->tbl = calloc(
+				      res->ztbl, sizeof(*res->tbl))) == NULL)) {
+			goto nope;
+		}
+		return res;
+	} else if ((res->f = mmap_fn(fn, O_RDONLY)).fd < 0) {
+		goto nope;
+	} else if (load(res) < 0) {
+		goto nope;
+	}
+	return res;
+
+nope:
+	with (int e = errno) {
+		if (res->f.fd >= 0) {
+			munmap_fn(res->f);
+		}
+		pthread_mutex_destroy(&res->mtx);
+		free(res->tbl);
+		free(res->fn);
+		free(res);
+		errno = e;
+	}
+	return NULL;
+}
+
+static int
+wr_all(int fd, const void *buf, size_t z)
+{
+	for (size_t o = 0U; o < z;) {
+		ssize_t nwr = write(fd, (const char*)buf + o, z - o);
+
+		if (UNLIKELY(nwr < 0 && errno == EINTR)) {
+			continue;
+		} else if (UNLIKELY(nwr <= 0)) {
+			return -1;
+		}
+		o += nwr;
+	}
+	return 0;
+}
+
+static int
+wr_recs(struct gcache_s *c, FILE *fp)
+{
+/* write the still valid records of C's file and the ones put since
+ * opening C to FP */
+	if (fwrite(CACHE_MAGIC, 1U, CACHE_MAGICZ, fp) < CACHE_MAGICZ) {
+		return -1;
+	}
+	for (size_t i = 0U; i < c->ztbl; i++) {
+		const struct gcrec_s *r = c->tbl[i].r;
+
+		if (r == NULL || c->tbl[i].stale_p) {
+			continue;
+		} else if (fwrite(r, 1U, rec_len(r), fp) < rec_len(r)) {
+			return -1;
+		}
+	}
+	if (fwrite(c->nu, 1U, c->nnu, fp) < c->nnu) {
+		return -1;
+	}
+	return 0;
+}
+
+static int
+lock_cache(const char *fn, struct stat *st)
+{
+/* open FN for appending and lock it, return the descriptor and FN's
+ * status in ST, a rewrite might replace FN while we wait for the lock
+ * in which case we try again with the new file */
+	int fd;
+
+	while ((fd = open(fn, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+			  0666)) >= 0) {
+		struct stat now;
+
+		if (flock(fd, LOCK_EX) < 0 || fstat(fd, st) < 0) {
+			break;
+		} else if (stat(fn, &now) == 0 &&
+			   now.st_dev == st->st_dev &&
+			   now.st_ino == st->st_ino) {
+			return fd;
+		}
+		/* renamed over, unlocks */
+		close(fd);
+	}
+	if (fd >= 0) {
+		with (int e = errno) {
+			close(fd);
+			errno = e;
+		}
+	}
+	return -1;
+}
+
+static int
+rewr_cache(struct gcache_s *c, const struct stat *st)
+{
+/* rewrite C's file, which we hold the lock of, others keep seeing the
+ * old file till the rename */
+	const size_t fz = strlen(c->fn);
+	char *tmp;
+	FILE *fp;
+	int fd;
+	int rc;
+
+	if (UNLIKELY((tmp = malloc(fz + 8U)) == NULL)) {
+		return -1;
+	}
+	memcpy(tmp, c->fn, fz);
+	memcpy(tmp + fz, ".XXXXXX", 8U);
+	if ((fd = mkstemp(tmp)) < 0) {
+		free(tmp);
+		return -1;
+	} else if ((fp = fdopen(fd, "wb")) == NULL) {
+		close(fd);
+		unlink(tmp);
+		free(tmp);
+		return -1;
+	}
+	/* mkstemp() is rather strict */
+	fchmod(fd, st->st_mode & 0777);
+	rc = wr_recs(c, fp);
+	if (fclose(fp) < 0 || rc < 0 || rename(tmp, c->fn) < 0) {
+		unlink(tmp);
+		rc = -1;
+	}
+	free(tmp);
+	return rc;
+}
+
+static int
+wr_cache(struct gcache_s *c)
+{
+/* append the new records to C's file, or rewrite it if most of its
+ * records are superseded or the last of them is torn, concurrent runs
+ * take turns by means of a lock on the file */
+	size_t ndead = c->nrec - c->nlive;
+	struct stat st;
+	int fd;
+	int rc;
+
+	for (size_t i = 0U; i < c->ztbl; i++) {
+		ndead += c->tbl[i].stale_p;
+	}
+	if (!c->nnu) {
+		/* stale records go when there's something new */
+		return 0;
+	} else if ((fd = lock_cache(c->fn, &st)) < 0) {
+		return -1;
+	}
+	if (c->valid && c->valid == c->f.fb.z && ndead <= c->nrec / 2U &&
+	    (size_t)st.st_size >= c->valid) {
+		/* in one go, even without working locks the records
+		 * stay in one piece then */
+		rc = wr_all(fd, c->nu, c->nnu);
+	} else {
+		rc = rewr_cache(c, &st);
+	}
+	/* the lock goes with the descriptor */
+	with (int e = errno) {
+		close(fd);
+		errno = e;
+	}
+	return rc;
+}
+
+int
+gcache_close(gcache_t c)
+{
+	int rc = wr_cache(c);
+
+	if (c->f.fd >= 0) {
+		munmap_fn(c->f);
+	}
+	pthread_mutex_destroy(&c->mtx);
+	free(c->nu);
+	free(c->tbl);
+	free(c->fn);
+	free(c);
+	return rc;
+}
+
+ssize_t
+gcache_get(gcache_t c, const char *fn, const struct stat *st,
+	   const char **out, bool *found)
+{
+	const size_t fz = strlen(fn);
+	struct gcslot_s *s = find_slot(
+		c, st->st_dev, st->st_ino, c->cookie, fn, fz);
+
+	if (s->r == NULL) {
+		return -1;
+	} else if (s->r->size != (uint64_t)st->st_size ||
+		   s->r->mtime != mtime_ns(st)) {
+		/* distinct files have distinct slots */
+		s->stale_p = true;
+		return -1;
+	}
+	*out = (const char*)(s->r + 1U) + fz;
+	*found = s->r->flags & FL_FOUND;
+	return s->r->outz;
+}
+
+int
+gcache_put(gcache_t c, const char *fn, const struct stat *st,
+	   const char *out, size_t z, bool found)
+{
+	const size_t fz = strlen(fn);
+	struct gcrec_s r = {
+		.dev = st->st_dev,
+		.ino = st->st_ino,
+		.size = st->st_size,
+		.mtime = mtime_ns(st),
+		.cookie = c->cookie,
+		.fnz = fz,
+		.outz = z,
+		.flags = found ? FL_FOUND : 0U,
+	};
+	size_t rz;
+	int rc = 0;
+
+	if (st->st_mtime >= c->t0 - 1) {
+		/* the file might change again within the granularity of
+		 * its timestamp, unnoticed by size and mtime */
+		return 0;
+	} else if (UNLIKELY(fz > UINT32_MAX || z > UINT32_MAX)) {
+		return 0;
+	}
+	rz = rec_len(&r);
+	pthread_mutex_lock(&c->mtx);
+	if (UNLIKELY(c->nnu + rz > c->znu)) {
+		size_t nu = c->znu ? 2U * c->znu : 65536U;
+		char *b;
+
+		for (; c->nnu + rz > nu; nu *= 2U);
+		if (UNLIKELY((b = realloc(c->nu, nu)) == NULL)) {
+			rc = -1;
+			goto out;
+		}
+		c->nu = b;
+		c->znu = nu;
+	}
+	with (struct gcrec_s *p = (void*)(c->nu + c->nnu)) {
+		char *q = (char*)(p + 1U);
+
+		*p = r;
+		memcpy(q, fn, fz);
+		if (z) {
+			memcpy(q + fz, out, z);
+		}
+		memset(q + fz + z, 0, rz - sizeof(r) - fz - z);
+		p->csum = rec_csum(p);
+	}
+	c->nnu += rz;
+out:
+	pthread_mutex_unlock(&c->mtx);
+	return rc;
+}
+
+/* glep-cache.c ends here */
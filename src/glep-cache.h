@@ -0,0 +1,86 @@
+/*** glep-cache.h -- persistent per-file result cache
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_glep_cache_h_
+#define INCLUDED_glep_cache_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/**
+ * A result cache maps a file, identified by its name, device and inode
+ * and by a cookie standing for the patterns and the output options, to
+ * the output glep produced for it last time, along with the size and
+ * modification time the file had then.
+ *
+ * The cache file is a log of such records, new ones are appended and
+ * supersede older ones of the same file.  It's used mapped, lookups
+ * go through a hash table built upon opening it.  Concurrent runs take
+ * turns writing it by means of a lock on the file, and records failing
+ * their checksum are ignored, along with anything after them. */
+typedef struct gcache_s *gcache_t;
+
+
+/**
+ * Open the cache in file FN, or start one if FN doesn't exist,
+ * only records made with COOKIE are of interest. */
+extern gcache_t gcache_open(const char *fn, uint64_t cookie);
+
+/**
+ * Write the records put since opening cache C and free its resources. */
+extern int gcache_close(gcache_t c);
+
+/**
+ * Look up file FN, whose status is ST, in cache C.
+ * Return -1 if FN isn't cached or has changed since, the length of the
+ * cached output otherwise, which is stored in OUT then, FOUND is set to
+ * whether there were matches. */
+extern ssize_t
+gcache_get(gcache_t c, const char *fn, const struct stat *st,
+	   const char **out, bool *found);
+
+/**
+ * Put the Z octets of output OUT for file FN, whose status was ST,
+ * into cache C, FOUND indicates whether there were matches.
+ * This can be called from multiple threads. */
+extern int
+gcache_put(gcache_t c, const char *fn, const struct stat *st,
+	   const char *out, size_t z, bool found);
+
+#endif	/* INCLUDED_glep_cache_h_ */
@@ -0,0 +1,213 @@
+/*** glep-db.c -- compiled pattern databases
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include "glep-db.h"
+#include "fops.h"
+#include "nifty.h"
+
+#define GDB_MAGIC	"glepdb\0\0"
+#define GDB_VERS	(3U)
+#define GDB_BOM		(0x0102030405060708ULL)
+
+struct gdbhdr_s {
+	char magic[8U];
+	/** GDB_BOM in the writer's byte order */
+	uint64_t bom;
+	uint32_t vers;
+	/** the writer's sizeof(size_t) */
+	uint32_t wordz;
+	/** total size of the database */
+	uint64_t z;
+	/** offset of the root blob */
+	uint64_t root;
+};
+
+struct gdbw_s {
+	char *d;
+	size_t n;
+	size_t z;
+};
+
+struct gdb_s {
+	glodfn_t f;
+	struct gdbhdr_s h;
+};
+
+
+gdbw_t
+make_gdbw(void)
+{
+	struct gdbw_s *res;
+
+	if (UNLIKELY((res = malloc(sizeof(*res))) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((res->d = calloc(1U, 4096U)) == NULL)) {
+		free(res);
+		return NULL;
+	}
+	/* leave room for the header */
+	res->n = sizeof(struct gdbhdr_s);
+	res->z = 4096U;
+	return res;
+}
+
+void
+free_gdbw(gdbw_t w)
+{
+	free(w->d);
+	free(w);
+	return;
+}
+
+size_t
+gdbw_put(gdbw_t w, const void *buf, size_t z)
+{
+	const size_t o = (w->n + GDB_ALGN - 1U) / GDB_ALGN * GDB_ALGN;
+
+	if (UNLIKELY(o + z > w->z)) {
+		size_t nu;
+		char *d;
+
+		for (nu = w->z * 2U; o + z > nu; nu *= 2U);
+		if (UNLIKELY((d = realloc(w->d, nu)) == NULL)) {
+			return 0U;
+		}
+		w->d = d;
+		w->z = nu;
+	}
+	/* zero the padding so databases are reproducible */
+	memset(w->d + w->n, 0, o - w->n);
+	memcpy(w->d + o, buf, z);
+	w->n = o + z;
+	return o;
+}
+
+int
+gdbw_write(gdbw_t w, size_t root, const char *fn)
+{
+	int fd;
+	int rc = 0;
+
+	with (struct gdbhdr_s *h = (void*)w->d) {
+		memcpy(h->magic, GDB_MAGIC, sizeof(h->magic));
+		h->bom = GDB_BOM;
+		h->vers = GDB_VERS;
+		h->wordz = sizeof(size_t);
+		h->z = w->n;
+		h->root = root;
+	}
+	if (UNLIKELY((fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)) {
+		return -1;
+	}
+	for (ssize_t nwr, o = 0; o < (ssize_t)w->n; o += nwr) {
+		if (UNLIKELY((nwr = write(fd, w->d + o, w->n - o)) <= 0)) {
+			rc = -1;
+			break;
+		}
+	}
+	if (UNLIKELY(close(fd) < 0)) {
+		rc = -1;
+	}
+	return rc;
+}
+
+
+gdb_t
+gdb_open(const char *fn)
+{
+	struct gdb_s *res;
+
+	if (UNLIKELY((res = malloc(sizeof(*res))) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((res->f = mmap_fn(fn, O_RDONLY)).fd < 0)) {
+		goto bugger;
+	} else if (UNLIKELY(res->f.fb.z < sizeof(res->h))) {
+		goto bugger;
+	}
+	memcpy(&res->h, res->f.fb.d, sizeof(res->h));
+	if (memcmp(res->h.magic, GDB_MAGIC, sizeof(res->h.magic)) ||
+	    res->h.bom != GDB_BOM ||
+	    res->h.vers != GDB_VERS ||
+	    res->h.wordz != sizeof(size_t) ||
+	    res->h.z != res->f.fb.z ||
+	    res->h.root >= res->h.z) {
+		goto bugger;
+	}
+	/* blobs are read from start to end, mostly */
+	madvise(res->f.fb.d, res->f.fb.z, MADV_WILLNEED);
+	return res;
+
+bugger:
+	if (res->f.fd >= 0) {
+		munmap_fn(res->f);
+	}
+	free(res);
+	return NULL;
+}
+
+void
+gdb_close(gdb_t d)
+{
+	with (struct gdb_s *pd = deconst(d)) {
+		munmap_fn(pd->f);
+		free(pd);
+	}
+	return;
+}
+
+size_t
+gdb_root(gdb_t d)
+{
+	return d->h.root;
+}
+
+const void*
+gdb_get(gdb_t d, size_t o, size_t z)
+{
+	if (UNLIKELY(o > d->h.z || z > d->h.z - o)) {
+		return NULL;
+	}
+	return (const char*)d->f.fb.d + o;
+}
+
+/* glep-db.c ends here */
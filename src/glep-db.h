@@ -0,0 +1,90 @@
+/*** glep-db.h -- compiled pattern databases
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_glep_db_h_
+#define INCLUDED_glep_db_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Databases are files of 64-byte aligned blobs, a header at offset 0
+ * points to the root blob.  Blobs refer to each other by offset only,
+ * so a database can be mapped anywhere and used in place.
+ *
+ * Databases are not meant to be portable, the header records the
+ * byte order and word size of the writer and readers insist on them. */
+typedef struct gdbw_s *gdbw_t;
+typedef const struct gdb_s *gdb_t;
+
+/* alignment of blobs */
+#define GDB_ALGN	(64U)
+
+
+/**
+ * Create a database writer. */
+extern gdbw_t make_gdbw(void);
+
+/**
+ * Free resources associated with database writer W. */
+extern void free_gdbw(gdbw_t w);
+
+/**
+ * Append Z bytes of BUF to W, return the blob's offset or 0 on failure. */
+extern size_t gdbw_put(gdbw_t w, const void *buf, size_t z);
+
+/**
+ * Write W to file FN with the blob at offset ROOT as root blob. */
+extern int gdbw_write(gdbw_t w, size_t root, const char *fn);
+
+/**
+ * Map database FN, return NULL if FN is no database. */
+extern gdb_t gdb_open(const char *fn);
+
+/**
+ * Unmap database D. */
+extern void gdb_close(gdb_t d);
+
+/**
+ * Return the offset of the root blob of D. */
+extern size_t gdb_root(gdb_t d);
+
+/**
+ * Return a pointer to the Z bytes at offset O in D, or NULL if out of
+ * bounds. */
+extern const void *gdb_get(gdb_t d, size_t o, size_t z);
+
+#endif	/* INCLUDED_glep_db_h_ */
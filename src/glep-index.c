@@ -0,0 +1,787 @@
+/*** glep-index.c -- trigram index of a corpus
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "glep-index.h"
+#include "glep-db.h"
+#include "unpack.h"
+#include "fops.h"
+#include "nifty.h"
+
+/* number of trigrams */
+#define NTRI		(1U << 24U)
+/* read buffer while indexing */
+#define BUFZ		(1024U * 1024U)
+
+#define IDX_DB		"index.gdb"
+#define IDX_POST	"postings"
+/* the trigrams of every file in turn while indexing */
+#define IDX_SPILL	"postings.tmp"
+
+/* file table entry */
+struct gidxfile_s {
+	/** offset of the name in the names blob */
+	uint64_t name;
+	uint64_t size;
+	/** in nanoseconds, directories change within the second */
+	int64_t mtime;
+	uint32_t flags;
+	/** number of distinct trigrams */
+	uint32_t ntri;
+};
+
+/* the file's trigrams aren't indexed */
+#define FL_RAW		(1U)
+
+/* root record of the database */
+struct gidxroot_s {
+	/** struct gidxfile_s[nfiles] */
+	uint64_t nfiles;
+	uint64_t files;
+	/** the file names, NUL-terminated */
+	uint64_t names;
+	uint64_t namez;
+	/** trigrams with postings, ascending, uint32_t[ntri] */
+	uint64_t ntri;
+	uint64_t tri;
+	/** start of each trigram's postings, uint64_t[ntri + 1U] */
+	uint64_t pbeg;
+	/** number of postings, i.e. file ids */
+	uint64_t npost;
+	/** the directory relative file names are relative to, absolute,
+	 * an offset into the names blob */
+	uint64_t root;
+	/** the directories walked, struct gidxfile_s[ndirs] */
+	uint64_t ndirs;
+	uint64_t dirs;
+};
+
+struct gidxw_s {
+	char *dir;
+	FILE *spill;
+
+	struct gidxfile_s *files;
+	size_t nfiles;
+	size_t zfiles;
+	struct gidxfile_s *dirs;
+	size_t ndirs;
+	size_t zdirs;
+	size_t root;
+	char *names;
+	size_t namen;
+	size_t namez;
+
+	/* number of files each trigram occurs in */
+	uint64_t *cnt;
+	/* trigrams of the current file, as bitset and as list */
+	uint64_t *seen;
+	uint32_t *ltri;
+	size_t nltri;
+	char *buf;
+};
+
+struct gidx_s {
+	gdb_t db;
+	glodfn_t post;
+	const struct gidxroot_s *r;
+	const struct gidxfile_s *files;
+	const struct gidxfile_s *dirs;
+	const char *names;
+	/* the names of files and directories prefixed with the root, if
+	 * it's not the current directory */
+	char **rebased;
+	const uint32_t *tri;
+	const uint64_t *pbeg;
+	const uint32_t *pst;
+};
+
+
+static inline int64_t
+mtime(const struct stat *st)
+{
+	return (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+static inline uint32_t
+fold(unsigned char c)
+{
+	return (unsigned int)c - 'A' < 26U ? c + 0x20U : c;
+}
+
+static char*
+dirfn(const char *dir, const char *fn)
+{
+	const size_t dz = strlen(dir);
+	const size_t fz = strlen(fn);
+	char *res;
+
+	if (UNLIKELY((res = malloc(dz + 1U + fz + 1U)) == NULL)) {
+		return NULL;
+	}
+	memcpy(res, dir, dz);
+	res[dz] = '/';
+	memcpy(res + dz + 1U, fn, fz + 1U);
+	return res;
+}
+
+static FILE*
+fopen_in(const char *dir, const char *fn, const char *mode)
+{
+	char *path = dirfn(dir, fn);
+	FILE *res;
+
+	if (UNLIKELY(path == NULL)) {
+		return NULL;
+	}
+	res = fopen(path, mode);
+	free(path);
+	return res;
+}
+
+static int
+unlink_in(const char *dir, const char *fn)
+{
+	char *path = dirfn(dir, fn);
+	int rc;
+
+	if (UNLIKELY(path == NULL)) {
+		return -1;
+	}
+	rc = unlink(path);
+	free(path);
+	return rc;
+}
+
+static ssize_t
+add_name(struct gidxw_s *w, const char *fn)
+{
+/* put FN into the names blob, return its offset */
+	const size_t fz = strlen(fn) + 1U;
+	const size_t res = w->namen;
+
+	if (UNLIKELY(w->namen + fz > w->namez)) {
+		size_t nu = w->namez ? 2U * w->namez : 65536U;
+		char *n;
+
+		for (; w->namen + fz > nu; nu *= 2U);
+		if (UNLIKELY((n = realloc(w->names, nu)) == NULL)) {
+			return -1;
+		}
+		w->names = n;
+		w->namez = nu;
+	}
+	memcpy(w->names + w->namen, fn, fz);
+	w->namen += fz;
+	return res;
+}
+
+static int
+add_ent(struct gidxfile_s **tbl, size_t *n, size_t *z,
+	ssize_t name, const struct stat *st)
+{
+/* append the table entry for the file at offset NAME to TBL */
+	if (UNLIKELY(name < 0)) {
+		return -1;
+	} else if (UNLIKELY(*n >= *z)) {
+		const size_t nu = *z ? 2U * *z : 1024U;
+		struct gidxfile_s *f = realloc(*tbl, nu * sizeof(*f));
+
+		if (UNLIKELY(f == NULL)) {
+			return -1;
+		}
+		*tbl = f;
+		*z = nu;
+	}
+	(*tbl)[(*n)++] = (struct gidxfile_s){
+		.name = name,
+		.size = st->st_size,
+		.mtime = mtime(st),
+	};
+	return 0;
+}
+
+static int
+add_file(struct gidxw_s *w, const char *fn, const struct stat *st)
+{
+	return add_ent(&w->files, &w->nfiles, &w->zfiles, add_name(w, fn), st);
+}
+
+static void
+add_tri(struct gidxw_s *w, const char *bp, const char *ep, uint32_t *t, size_t *n)
+{
+/* note down the trigrams in BP..EP, T and N carry the trigram so far
+ * and the number of octets seen across calls */
+	uint32_t x = *t;
+	size_t k = *n;
+
+	for (; bp < ep; bp++, k++) {
+		x = (x << 8U | fold(*bp)) & (NTRI - 1U);
+		if (k < 2U) {
+			continue;
+		} else if (w->seen[x / 64U] & (1ULL << (x % 64U))) {
+			continue;
+		}
+		w->seen[x / 64U] |= 1ULL << (x % 64U);
+		w->ltri[w->nltri++] = x;
+	}
+	*t = x;
+	*n = k;
+	return;
+}
+
+
+gidxw_t
+make_gidxw(const char *dir)
+{
+	struct gidxw_s *res;
+
+	if (mkdir(dir, 0777) < 0 && errno != EEXIST) {
+		return NULL;
+	} else if (UNLIKELY((res = calloc(1U, sizeof(*res))) == NULL)) {
+		return NULL;
+	}
+	res->dir = strdup(dir);
+	res->cnt = calloc(NTRI, sizeof(*res->cnt));
+	res->seen = calloc(NTRI / 64U, sizeof(*res->seen));
+	res->ltri = malloc(NTRI * sizeof(*res->ltri));
+	res->buf = malloc(BUFZ);
+	res->spill = fopen_in(dir, IDX_SPILL, "w+");
+	if (UNLIKELY(res->dir == NULL || res->cnt == NULL ||
+		     res->seen == NULL || res->ltri == NULL ||
+		     res->buf == NULL || res->spill == NULL)) {
+		goto nope;
+	}
+	/* names are stored as given, the root makes sense of them */
+	with (char *cwd = realpath(".", NULL)) {
+		const ssize_t o = cwd != NULL ? add_name(res, cwd) : -1;
+
+		free(cwd);
+		if (UNLIKELY(o < 0)) {
+			goto nope;
+		}
+		res->root = o;
+	}
+	return res;
+
+nope:
+	if (res->spill != NULL) {
+		fclose(res->spill);
+		unlink_in(dir, IDX_SPILL);
+	}
+	free(res->names);
+	free(res->buf);
+	free(res->ltri);
+	free(res->seen);
+	free(res->cnt);
+	free(res->dir);
+	free(res);
+	return NULL;
+}
+
+int
+gidxw_add(gidxw_t w, const char *fn)
+{
+	struct gidxfile_s *f;
+	struct stat st;
+	uint32_t t = 0U;
+	size_t k = 0U;
+	ssize_t nrd;
+	int rc = 0;
+	int fd;
+
+	if (UNLIKELY((fd = open(fn, O_RDONLY)) < 0)) {
+		return -1;
+	} else if (UNLIKELY(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))) {
+		close(fd);
+		return -1;
+	} else if (UNLIKELY(add_file(w, fn, &st) < 0)) {
+		close(fd);
+		return -1;
+	}
+	f = w->files + w->nfiles - 1U;
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	w->nltri = 0U;
+	while ((nrd = read(fd, w->buf, BUFZ)) > 0) {
+		if (!k && unpack_sniff(w->buf, nrd) != UNPACK_NONE) {
+			/* we'd have to decompress it, scan it always */
+			f->flags |= FL_RAW;
+			break;
+		}
+		add_tri(w, w->buf, w->buf + nrd, &t, &k);
+	}
+	if (UNLIKELY(nrd < 0)) {
+		/* scan it always, that'll tell the user */
+		f->flags |= FL_RAW;
+		rc = -1;
+	}
+	close(fd);
+
+	for (size_t i = 0U; i < w->nltri; i++) {
+		const uint32_t x = w->ltri[i];
+
+		w->seen[x / 64U] &= ~(1ULL << (x % 64U));
+		w->cnt[x]++;
+	}
+	if (f->flags & FL_RAW) {
+		/* forget about the trigrams then */
+		for (size_t i = 0U; i < w->nltri; i++) {
+			w->cnt[w->ltri[i]]--;
+		}
+		w->nltri = 0U;
+	}
+	f->ntri = (uint32_t)w->nltri;
+	if (UNLIKELY(fwrite(w->ltri, sizeof(*w->ltri), w->nltri, w->spill) <
+		     w->nltri)) {
+		return -1;
+	}
+	return rc;
+}
+
+int
+gidxw_add_dir(gidxw_t w, const char *dn)
+{
+	struct stat st;
+
+	if (UNLIKELY(stat(dn, &st) < 0 || !S_ISDIR(st.st_mode))) {
+		return -1;
+	}
+	return add_ent(&w->dirs, &w->ndirs, &w->zdirs, add_name(w, dn), &st);
+}
+
+static int
+wr_post(struct gidxw_s *w, uint64_t npost)
+{
+/* turn the trigram lists in the spill file into posting lists,
+ * W's counters hold the position of each trigram's next posting */
+	const size_t pz = (npost + 1U) * sizeof(uint32_t);
+	char *path = dirfn(w->dir, IDX_POST);
+	uint32_t *pst;
+	int rc = 0;
+	int fd;
+
+	if (UNLIKELY(path == NULL)) {
+		return -1;
+	}
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	free(path);
+	if (UNLIKELY(fd < 0)) {
+		return -1;
+	} else if (UNLIKELY(ftruncate(fd, pz) < 0)) {
+		close(fd);
+		return -1;
+	}
+	pst = mmap(NULL, pz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (UNLIKELY(pst == MAP_FAILED)) {
+		return -1;
+	}
+
+	rewind(w->spill);
+	for (size_t i = 0U; i < w->nfiles; i++) {
+		const size_t n = w->files[i].ntri;
+
+		if (UNLIKELY(fread(w->ltri, sizeof(*w->ltri), n, w->spill) < n)) {
+			rc = -1;
+			break;
+		}
+		/* files come in order, so posting lists come out sorted */
+		for (size_t j = 0U; j < n; j++) {
+			pst[w->cnt[w->ltri[j]]++] = (uint32_t)i;
+		}
+	}
+	munmap(pst, pz);
+	return rc;
+}
+
+int
+gidxw_fin(gidxw_t w)
+{
+	/* stands in for empty tables, blobs can't be empty */
+	static const struct gidxfile_s nil;
+	struct gidxroot_s r = {
+		.nfiles = w->nfiles, .root = w->root, .ndirs = w->ndirs,
+	};
+	uint32_t *tri = NULL;
+	uint64_t *pbeg = NULL;
+	uint64_t npost = 0U;
+	gdbw_t d = NULL;
+	char *path = NULL;
+	int rc = -1;
+
+	if (UNLIKELY(w->nfiles > UINT32_MAX)) {
+		errno = EFBIG;
+		goto out;
+	}
+	for (size_t x = 0U; x < NTRI; x++) {
+		r.ntri += !!w->cnt[x];
+	}
+	tri = malloc((r.ntri + 1U) * sizeof(*tri));
+	pbeg = malloc((r.ntri + 1U) * sizeof(*pbeg));
+	if (UNLIKELY(tri == NULL || pbeg == NULL)) {
+		goto out;
+	}
+	for (size_t x = 0U, i = 0U; x < NTRI; x++) {
+		if (w->cnt[x]) {
+			const uint64_t n = w->cnt[x];
+
+			tri[i] = (uint32_t)x;
+			pbeg[i++] = npost;
+			/* now the position of the next posting */
+			w->cnt[x] = npost;
+			npost += n;
+		}
+	}
+	pbeg[r.ntri] = r.npost = npost;
+	if (UNLIKELY(fflush(w->spill) || wr_post(w, npost) < 0)) {
+		goto out;
+	}
+
+	if (UNLIKELY((d = make_gdbw()) == NULL)) {
+		goto out;
+	}
+	r.files = gdbw_put(d, w->nfiles ? w->files : &nil,
+			   w->nfiles * sizeof(*w->files) + 1U);
+	r.dirs = gdbw_put(d, w->ndirs ? w->dirs : &nil,
+			  w->ndirs * sizeof(*w->dirs) + 1U);
+	r.names = gdbw_put(d, w->names, w->namen + 1U);
+	r.namez = w->namen;
+	r.tri = gdbw_put(d, tri, r.ntri * sizeof(*tri) + 1U);
+	r.pbeg = gdbw_put(d, pbeg, (r.ntri + 1U) * sizeof(*pbeg));
+	if (UNLIKELY(!r.files || !r.dirs || !r.names || !r.tri || !r.pbeg)) {
+		goto out;
+	} else if (UNLIKELY((path = dirfn(w->dir, IDX_DB)) == NULL)) {
+		goto out;
+	}
+	rc = gdbw_write(d, gdbw_put(d, &r, sizeof(r)), path);
+
+out:
+	if (d != NULL) {
+		free_gdbw(d);
+	}
+	free(path);
+	free(pbeg);
+	free(tri);
+	fclose(w->spill);
+	unlink_in(w->dir, IDX_SPILL);
+	free(w->buf);
+	free(w->ltri);
+	free(w->seen);
+	free(w->cnt);
+	free(w->names);
+	free(w->dirs);
+	free(w->files);
+	free(w->dir);
+	free(w);
+	return rc;
+}
+
+
+static const char*
+stored(gidx_t x, size_t i)
+{
+/* the name of file I as stored, I past the files means directories */
+	const struct gidxfile_s *f = i < x->r->nfiles
+		? x->files + i : x->dirs + (i - x->r->nfiles);
+
+	return f->name < x->r->namez ? x->names + f->name : "";
+}
+
+static int
+rebase(struct gidx_s *x)
+{
+/* with the root other than the current directory prefix the relative
+ * names of files and directories with it */
+	const char *root = x->names + x->r->root;
+	const size_t rz = strlen(root);
+	const size_t n = x->r->nfiles + x->r->ndirs;
+	size_t z = n * sizeof(*x->rebased);
+	char *cwd;
+	char *p;
+
+	if (UNLIKELY((cwd = realpath(".", NULL)) == NULL)) {
+		return -1;
+	} else if (!strcmp(cwd, root)) {
+		free(cwd);
+		return 0;
+	}
+	free(cwd);
+	for (size_t i = 0U; i < n; i++) {
+		const char *fn = stored(x, i);
+
+		z += rz + 1U + strlen(fn) + 1U;
+	}
+	/* the pointers, then the names */
+	if (UNLIKELY((x->rebased = malloc(z)) == NULL)) {
+		return -1;
+	}
+	p = (char*)(x->rebased + n);
+	for (size_t i = 0U; i < n; i++) {
+		const char *fn = stored(x, i);
+		size_t fz;
+
+		x->rebased[i] = p;
+		if (*fn != '/') {
+			/* ./ is just noise after the root */
+			for (; fn[0U] == '.' && fn[1U] == '/'; fn += 2U);
+			memcpy(p, root, rz);
+			p[rz] = '/';
+			p += rz + 1U;
+		}
+		fz = strlen(fn) + 1U;
+		memcpy(p, fn, fz);
+		p += fz;
+	}
+	return 0;
+}
+
+gidx_t
+gidx_open(const char *dir)
+{
+	struct gidx_s *res;
+	char *path;
+	const struct gidxroot_s *r;
+
+	if (UNLIKELY((res = calloc(1U, sizeof(*res))) == NULL)) {
+		return NULL;
+	}
+	res->post.fd = -1;
+	if (UNLIKELY((path = dirfn(dir, IDX_DB)) == NULL)) {
+		goto nope;
+	}
+	res->db = gdb_open(path);
+	free(path);
+	if (res->db == NULL) {
+		goto nope;
+	} else if ((r = gdb_get(res->db, gdb_root(res->db),
+				sizeof(*r))) == NULL) {
+		goto nope;
+	}
+	res->r = r;
+	res->files = gdb_get(res->db, r->files,
+			     r->nfiles * sizeof(*res->files));
+	res->dirs = gdb_get(res->db, r->dirs, r->ndirs * sizeof(*res->dirs));
+	res->names = gdb_get(res->db, r->names, r->namez + 1U);
+	res->tri = gdb_get(res->db, r->tri, r->ntri * sizeof(*res->tri));
+	res->pbeg = gdb_get(res->db, r->pbeg,
+			    (r->ntri + 1U) * sizeof(*res->pbeg));
+	if (res->files == NULL || res->dirs == NULL || res->names == NULL ||
+	    res->tri == NULL || res->pbeg == NULL ||
+	    res->pbeg[r->ntri] != r->npost ||
+	    r->root >= r->namez || res->names[r->root] != '/') {
+		goto nope;
+	} else if (UNLIKELY(rebase(res) < 0)) {
+		goto nope;
+	} else if (UNLIKELY((path = dirfn(dir, IDX_POST)) == NULL)) {
+		goto nope;
+	}
+	res->post = mmap_fn(path, O_RDONLY);
+	free(path);
+	if (res->post.fd < 0 ||
+	    res->post.fb.z < r->npost * sizeof(*res->pst)) {
+		goto nope;
+	}
+	res->pst = res->post.fb.d;
+	return res;
+
+nope:
+	gidx_close(res);
+	return NULL;
+}
+
+void
+gidx_close(gidx_t x)
+{
+	with (struct gidx_s *px = deconst(x)) {
+		if (px->post.fd >= 0) {
+			munmap_fn(px->post);
+		}
+		if (px->db != NULL) {
+			gdb_close(px->db);
+		}
+		free(px->rebased);
+		free(px);
+	}
+	return;
+}
+
+size_t
+gidx_nfiles(gidx_t x)
+{
+	return x->r->nfiles;
+}
+
+static const char*
+name(gidx_t x, size_t i)
+{
+/* the name of file I, or of directory I - nfiles, to go by */
+	return x->rebased != NULL ? x->rebased[i] : stored(x, i);
+}
+
+const char*
+gidx_file(gidx_t x, size_t i)
+{
+	return name(x, i);
+}
+
+bool
+gidx_fresh_p(gidx_t x, size_t i)
+{
+	const struct gidxfile_s *f = x->files + i;
+	struct stat st;
+
+	if (f->flags & FL_RAW) {
+		return false;
+	} else if (stat(gidx_file(x, i), &st) < 0) {
+		/* gone, nothing to scan */
+		return true;
+	}
+	return (uint64_t)st.st_size == f->size && mtime(&st) == f->mtime;
+}
+
+const char*
+gidx_stale(gidx_t x)
+{
+	for (size_t i = 0U; i < x->r->ndirs; i++) {
+		const char *dn = name(x, x->r->nfiles + i);
+		struct stat st;
+
+		if (stat(dn, &st) < 0 || mtime(&st) != x->dirs[i].mtime) {
+			return dn;
+		}
+	}
+	return NULL;
+}
+
+static ssize_t
+tri_find(gidx_t x, uint32_t t)
+{
+	size_t lo = 0U;
+	size_t hi = x->r->ntri;
+
+	while (lo < hi) {
+		const size_t mid = (lo + hi) / 2U;
+
+		if (x->tri[mid] < t) {
+			lo = mid + 1U;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo < x->r->ntri && x->tri[lo] == t ? (ssize_t)lo : -1;
+}
+
+static int
+ix_cmp(const void *a, const void *b, void *clo)
+{
+/* order trigram indices by the length of their posting lists */
+	const uint64_t *pbeg = clo;
+	const size_t i = *(const size_t*)a;
+	const size_t j = *(const size_t*)b;
+	const uint64_t ni = pbeg[i + 1U] - pbeg[i];
+	const uint64_t nj = pbeg[j + 1U] - pbeg[j];
+
+	return (ni > nj) - (ni < nj);
+}
+
+ssize_t
+gidx_cand(uint64_t *c, gidx_t x, const char *p, size_t z, bool ci)
+{
+	size_t ix[z + 1U];
+	size_t nix = 0U;
+	uint32_t *res;
+	size_t nres;
+
+	for (size_t i = 2U; i < z; i++) {
+		const unsigned char *q = (const unsigned char*)p + i - 2U;
+		const uint32_t t = fold(q[0U]) << 16U |
+			fold(q[1U]) << 8U | fold(q[2U]);
+		ssize_t k;
+
+		if (ci && (q[0U] | q[1U] | q[2U]) >= 0x80U) {
+			/* we can't tell the cases of those apart */
+			continue;
+		} else if ((k = tri_find(x, t)) < 0) {
+			/* no file has it */
+			return 0;
+		}
+		ix[nix++] = k;
+	}
+	if (!nix) {
+		return -1;
+	}
+	/* intersect, shortest lists first */
+	qsort_r(ix, nix, sizeof(*ix), ix_cmp, deconst(x->pbeg));
+	nres = x->pbeg[ix[0U] + 1U] - x->pbeg[ix[0U]];
+	if (UNLIKELY((res = malloc((nres + 1U) * sizeof(*res))) == NULL)) {
+		return -1;
+	}
+	memcpy(res, x->pst + x->pbeg[ix[0U]], nres * sizeof(*res));
+	for (size_t k = 1U; k < nix && nres; k++) {
+		const uint32_t *pp = x->pst + x->pbeg[ix[k]];
+		const uint32_t *const ep = x->pst + x->pbeg[ix[k] + 1U];
+		size_t n = 0U;
+
+		for (size_t i = 0U; i < nres && pp < ep;) {
+			if (res[i] < *pp) {
+				i++;
+			} else if (res[i] > *pp) {
+				pp++;
+			} else {
+				res[n++] = res[i++];
+				pp++;
+			}
+		}
+		nres = n;
+	}
+	for (size_t i = 0U; i < nres; i++) {
+		c[res[i] / 64U] |= 1ULL << (res[i] % 64U);
+	}
+	free(res);
+	return nres;
+}
+
+/* glep-index.c ends here */
@@ -0,0 +1,115 @@
+/*** glep-index.h -- trigram index of a corpus
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_glep_index_h_
+#define INCLUDED_glep_index_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/**
+ * A trigram index maps every trigram of a corpus, with ASCII letters
+ * folded to lower case, to the files it occurs in.  Files containing
+ * a pattern must contain all of its trigrams, so intersecting their
+ * posting lists yields the files worth scanning.
+ *
+ * An index lives in a directory: a glep-db database with the file
+ * table and the trigram table, and the posting lists, in a file of
+ * their own as they can be huge.  Both are used in place, mapped.
+ *
+ * Relative file names are taken relative to the directory the index
+ * was made in, no matter where it's used. */
+typedef struct gidxw_s *gidxw_t;
+typedef const struct gidx_s *gidx_t;
+
+
+/**
+ * Start an index in directory DIR, which is created if need be. */
+extern gidxw_t make_gidxw(const char *dir);
+
+/**
+ * Add file FN to the index W, names are stored as given.
+ * Compressed files are added without trigrams, they're always
+ * candidates. */
+extern int gidxw_add(gidxw_t w, const char *fn);
+
+/**
+ * Note that directory DN has been walked for the index W, files
+ * added to it later on are noticed that way, see gidx_stale(). */
+extern int gidxw_add_dir(gidxw_t w, const char *dn);
+
+/**
+ * Write the index W, and free its resources. */
+extern int gidxw_fin(gidxw_t w);
+
+/**
+ * Map the index in directory DIR, return NULL if there's none. */
+extern gidx_t gidx_open(const char *dir);
+
+/**
+ * Unmap index X. */
+extern void gidx_close(gidx_t x);
+
+/**
+ * Return the number of files in index X. */
+extern size_t gidx_nfiles(gidx_t x);
+
+/**
+ * Return the name of file I in index X. */
+extern const char *gidx_file(gidx_t x, size_t i);
+
+/**
+ * Return true if file I is still what it was upon indexing, judging
+ * by its size and modification time, and if its trigrams were indexed,
+ * or if it's gone. */
+extern bool gidx_fresh_p(gidx_t x, size_t i);
+
+/**
+ * Return the name of a directory walked for index X that changed since,
+ * it may have files the index knows nothing about, or NULL if there's
+ * none. */
+extern const char *gidx_stale(gidx_t x);
+
+/**
+ * Set the bits of files in bitmap C which might contain the Z octets
+ * of P, ignoring case if CI.
+ * Return -1 if P has no trigrams to go by, every file might contain it
+ * then, and the number of files marked otherwise. */
+extern ssize_t gidx_cand(uint64_t *c, gidx_t x, const char *p, size_t z, bool ci);
+
+#endif	/* INCLUDED_glep_index_h_ */
@@ -0,0 +1,327 @@
+/*** glep-out.c -- bulk output of glep's results
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "glep-out.h"
+#include "nifty.h"
+
+/* size of the output buffer, one write() per OUTZ octets */
+#define OUTZ		(64U * 1024U)
+
+static struct {
+	pthread_mutex_t mtx;
+	int fd;
+	/* flush after every report, like stdio on terminals */
+	bool tty_p;
+	/* lock depth, records get reported amidst hits */
+	size_t nlck;
+	/* errno of the first failed write, nothing's written after it */
+	int err;
+	/* with --format=bin, ids handed out so far and the current one */
+	uint32_t nfid;
+	uint32_t fid;
+	size_t n;
+	char b[OUTZ];
+} out = {
+	.mtx = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP, .fd = STDOUT_FILENO,
+};
+
+static __thread struct gcap_s *cap;
+
+static void
+cap_mem(const char *s, size_t z)
+{
+	if (UNLIKELY(cap->n + z > cap->z) && !cap->oom_p) {
+		size_t nu = cap->z ? 2U * cap->z : 4096U;
+		char *b;
+
+		for (; cap->n + z > nu; nu *= 2U);
+		if (UNLIKELY((b = realloc(cap->b, nu)) == NULL)) {
+			/* not cacheable then */
+			cap->oom_p = true;
+		} else {
+			cap->b = b;
+			cap->z = nu;
+		}
+	}
+	if (LIKELY(!cap->oom_p)) {
+		memcpy(cap->b + cap->n, s, z);
+		cap->n += z;
+	}
+	return;
+}
+
+void
+out_flush(void)
+{
+	const int e = errno;
+
+	for (size_t i = 0U; !out.err && i < out.n;) {
+		const ssize_t nwr = write(out.fd, out.b + i, out.n - i);
+
+		if (nwr > 0) {
+			i += nwr;
+		} else if (nwr < 0 && errno == EINTR) {
+			continue;
+		} else {
+			/* truncated output is no output, main() says so */
+			out.err = nwr < 0 ? errno : EIO;
+		}
+	}
+	out.n = 0U;
+	errno = e;
+	return;
+}
+
+void
+out_mem(const char *s, size_t z)
+{
+	if (UNLIKELY(cap != NULL)) {
+		cap_mem(s, z);
+	}
+	while (UNLIKELY(out.n + z > sizeof(out.b))) {
+		const size_t k = sizeof(out.b) - out.n;
+
+		memcpy(out.b + out.n, s, k);
+		out.n += k;
+		s += k;
+		z -= k;
+		out_flush();
+	}
+	memcpy(out.b + out.n, s, z);
+	out.n += z;
+	return;
+}
+
+void
+out_chr(char c)
+{
+	if (UNLIKELY(cap != NULL)) {
+		cap_mem(&c, 1U);
+	}
+	if (UNLIKELY(out.n >= sizeof(out.b))) {
+		out_flush();
+	}
+	out.b[out.n++] = c;
+	return;
+}
+
+void
+out_ulong(size_t x)
+{
+	char b[24U];
+	size_t i = sizeof(b);
+
+	do {
+		b[--i] = (char)('0' + x % 10U);
+	} while (x /= 10U);
+	out_mem(b + i, sizeof(b) - i);
+	return;
+}
+
+static size_t
+utf8_len(const unsigned char *s)
+{
+/* length of the well-formed UTF-8 sequence at S, 0 if there's none */
+	unsigned char lo = 0x80U;
+	unsigned char hi = 0xbfU;
+	size_t n;
+
+	if (s[0U] < 0x80U) {
+		return 1U;
+	} else if (s[0U] < 0xc2U) {
+		return 0U;
+	} else if (s[0U] < 0xe0U) {
+		n = 2U;
+	} else if (s[0U] < 0xf0U) {
+		n = 3U;
+		lo = s[0U] == 0xe0U ? 0xa0U : lo;
+		hi = s[0U] == 0xedU ? 0x9fU : hi;
+	} else if (s[0U] < 0xf5U) {
+		n = 4U;
+		lo = s[0U] == 0xf0U ? 0x90U : lo;
+		hi = s[0U] == 0xf4U ? 0x8fU : hi;
+	} else {
+		return 0U;
+	}
+	/* the terminating NUL fails these checks */
+	if (s[1U] < lo || s[1U] > hi) {
+		return 0U;
+	}
+	for (size_t i = 2U; i < n; i++) {
+		if (s[i] < 0x80U || s[i] > 0xbfU) {
+			return 0U;
+		}
+	}
+	return n;
+}
+
+void
+out_json(const char *s)
+{
+	static const char hx[] = "0123456789abcdef";
+
+	out_chr('"');
+	for (const char *sp = s;; sp++) {
+		const unsigned char c = *sp;
+		size_t n;
+
+		if (c >= 0x20U && c < 0x80U && c != '"' && c != '\\') {
+			continue;
+		} else if (c >= 0x80U &&
+			   (n = utf8_len((const unsigned char*)sp)) > 0U) {
+			sp += n - 1U;
+			continue;
+		}
+		out_mem(s, sp - s);
+		if (!c) {
+			break;
+		}
+		s = sp + 1;
+		switch (c) {
+		case '"':
+		case '\\':
+			out_chr('\\');
+			out_chr(c);
+			break;
+		case '\n':
+			out_mem("\\n", 2U);
+			break;
+		case '\t':
+			out_mem("\\t", 2U);
+			break;
+		default:
+			out_mem("\\u00", 4U);
+			out_chr(hx[c >> 4U]);
+			out_chr(hx[c & 0xfU]);
+			break;
+		}
+	}
+	out_chr('"');
+	return;
+}
+
+void
+out_lock(void)
+{
+	pthread_mutex_lock(&out.mtx);
+	if (!out.nlck++) {
+		out.fid = UINT32_MAX;
+	}
+	return;
+}
+
+void
+out_unlock(void)
+{
+	if (!--out.nlck && out.tty_p) {
+		out_flush();
+	}
+	pthread_mutex_unlock(&out.mtx);
+	return;
+}
+
+void
+out_bin(uint32_t pidx, uint64_t cnt, const char *fn, size_t rno)
+{
+	if (out.fid == UINT32_MAX) {
+		char lbl[24U];
+		size_t lz = 0U;
+		const size_t fz = strlen(fn);
+		struct grec_s r;
+
+		if (rno) {
+			lz = snprintf(lbl, sizeof(lbl), "\t%zu", rno);
+		}
+		out.fid = out.nfid++;
+		r = (struct grec_s){out.fid, UINT32_MAX, fz + lz};
+		out_mem((const char*)&r, sizeof(r));
+		out_mem(fn, fz);
+		out_mem(lbl, lz);
+		for (size_t k = (fz + lz) % sizeof(r); k && k < sizeof(r); k++) {
+			out_chr('\0');
+		}
+	}
+	if (pidx != UINT32_MAX) {
+		const struct grec_s r = {out.fid, pidx, cnt};
+
+		out_mem((const char*)&r, sizeof(r));
+	}
+	return;
+}
+
+void
+out_init(int fd)
+{
+	/* isatty() leaves ENOTTY behind for error() to pick up */
+	const int e = errno;
+
+	out.fd = fd;
+	out.tty_p = isatty(fd);
+	errno = e;
+	return;
+}
+
+int
+out_err(void)
+{
+	return out.err;
+}
+
+void
+out_capture(struct gcap_s *k)
+{
+	cap = k;
+	return;
+}
+
+struct gcap_s*
+out_captured(void)
+{
+	return cap;
+}
+
+/* glep-out.c ends here */
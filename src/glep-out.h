@@ -0,0 +1,119 @@
+/*** glep-out.h -- bulk output of glep's results
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_glep_out_h_
+#define INCLUDED_glep_out_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/**
+ * Bulk output, results of all workers go through one buffer in which
+ * integers are formatted by hand and which is written with one write()
+ * per buffer-full.  Reports spanning several calls are bracketed by
+ * out_lock() and out_unlock(). */
+
+/* --format=bin records, in native byte order, a file's name comes as a
+ * record with pattern index UINT32_MAX and the name's length as count,
+ * followed by the name NUL-padded to a multiple of the record size,
+ * pattern indices refer to PATTERN-FILE, with yields it's the index of
+ * the yield's first pattern */
+struct grec_s {
+	uint32_t fid;
+	uint32_t pidx;
+	uint64_t cnt;
+};
+
+/* with --cache, the output for the file a thread is scanning is
+ * collected on the side, see out_capture() */
+struct gcap_s {
+	struct stat st;
+	bool found_p;
+	bool oom_p;
+	size_t n;
+	size_t z;
+	char *b;
+};
+
+
+/**
+ * Send the output to FD, flushing after every report if FD is a tty. */
+extern void out_init(int fd);
+
+/**
+ * Return the errno of the first failed write, or 0.  Nothing gets
+ * written after that. */
+extern int out_err(void);
+
+extern void out_flush(void);
+extern void out_mem(const char *s, size_t z);
+extern void out_chr(char c);
+extern void out_ulong(size_t x);
+
+/**
+ * Output S as json string, octets that aren't part of well-formed UTF-8
+ * come out as \u00XX, i.e. they're taken as Latin-1. */
+extern void out_json(const char *s);
+
+extern void out_lock(void);
+extern void out_unlock(void);
+
+/**
+ * Emit a --format=bin record, preceded by FN's name record, or that of
+ * record RNO of FN if RNO is non-0, if it's the first for FN in this
+ * report.  A PIDX of UINT32_MAX emits just the name record. */
+extern void out_bin(uint32_t pidx, uint64_t cnt, const char *fn, size_t rno);
+
+/**
+ * Have the calling thread's output collected in K as well, or no
+ * longer if K is NULL. */
+extern void out_capture(struct gcap_s *k);
+
+/**
+ * Return where the calling thread's output is collected, or NULL. */
+extern struct gcap_s *out_captured(void);
+
+
+static inline void
+out_str(const char *s)
+{
+	out_mem(s, strlen(s));
+	return;
+}
+
+#endif	/* INCLUDED_glep_out_h_ */
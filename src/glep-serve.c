@@ -0,0 +1,419 @@
+/*** glep-serve.c -- scan service over unix sockets
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "glep-serve.h"
+#include "nifty.h"
+
+/* longest request line of a client */
+#define LINEZ	(8192U)
+/* size of the buffer results are copied through */
+#define COPYZ	(64U * 1024U)
+
+static volatile sig_atomic_t serve_quit;
+/* the connection's status descriptor, in the child serving it */
+static int serve_stfd = -1;
+
+
+static void
+__attribute__((format(printf, 1, 2)))
+error(const char *fmt, ...)
+{
+	va_list vap;
+
+	/* keep messages from concurrent workers in one piece */
+	flockfile(stderr);
+	va_start(vap, fmt);
+	vfprintf(stderr, fmt, vap);
+	va_end(vap);
+	if (errno) {
+		fputs(": ", stderr);
+		fputs(strerror(errno), stderr);
+	}
+	fputc('\n', stderr);
+	funlockfile(stderr);
+	return;
+}
+
+static void
+serve_sig(int UNUSED(signum))
+{
+	serve_quit = 1;
+	return;
+}
+
+static size_t
+serve_fds(struct msghdr *m, int fds[], size_t nfds)
+{
+/* append descriptors passed along M to FDS, of which there are NFDS */
+	for (struct cmsghdr *cm = CMSG_FIRSTHDR(m);
+	     cm != NULL; cm = CMSG_NXTHDR(m, cm)) {
+		const int *fp = (const int*)CMSG_DATA(cm);
+		size_t n;
+
+		if (cm->cmsg_level != SOL_SOCKET ||
+		    cm->cmsg_type != SCM_RIGHTS) {
+			continue;
+		}
+		n = (cm->cmsg_len - CMSG_LEN(0U)) / sizeof(*fp);
+		for (size_t i = 0U; i < n; i++) {
+			if (UNLIKELY(nfds >= GSERVE_MAXFDS)) {
+				close(fp[i]);
+				continue;
+			}
+			fds[nfds++] = fp[i];
+		}
+	}
+	return nfds;
+}
+
+static int
+send_fds(int s, const char *ln, size_t lz, const int fds[], size_t nfds)
+{
+/* send the LZ octets of line LN along with the NFDS descriptors FDS */
+	union {
+		struct cmsghdr h;
+		char b[CMSG_SPACE(2U * sizeof(int))];
+	} cm;
+	struct iovec iov = {deconst(ln), lz};
+	struct msghdr m = {
+		.msg_iov = &iov, .msg_iovlen = 1U,
+		.msg_control = cm.b, .msg_controllen = CMSG_SPACE(
+			nfds * sizeof(*fds)),
+	};
+	struct cmsghdr *cp = CMSG_FIRSTHDR(&m);
+
+	cp->cmsg_level = SOL_SOCKET;
+	cp->cmsg_type = SCM_RIGHTS;
+	cp->cmsg_len = CMSG_LEN(nfds * sizeof(*fds));
+	memcpy(CMSG_DATA(cp), fds, nfds * sizeof(*fds));
+	return sendmsg(s, &m, MSG_NOSIGNAL) < 0 ? -1 : 0;
+}
+
+static void*
+copier(void *arg)
+{
+/* copy the results off the socket at ARG to stdout */
+	const int s = *(const int*)arg;
+	char buf[COPYZ];
+	ssize_t nrd;
+
+	while ((nrd = read(s, buf, sizeof(buf))) > 0) {
+		fwrite(buf, 1, nrd, stdout);
+	}
+	return nrd < 0 ? arg : NULL;
+}
+
+
+int
+gserve_feed(int s, gserve_req_f req, void *clo)
+{
+	char buf[LINEZ];
+	size_t bz = 0U;
+	int fds[GSERVE_MAXFDS];
+	size_t nfds = 0U;
+	bool eor_p = false;
+	int rc = 0;
+
+	while (!eor_p) {
+		union {
+			struct cmsghdr h;
+			char b[CMSG_SPACE(GSERVE_MAXFDS * sizeof(int))];
+		} cm;
+		struct iovec iov = {buf + bz, sizeof(buf) - bz};
+		struct msghdr m = {
+			.msg_iov = &iov, .msg_iovlen = 1U,
+			.msg_control = cm.b, .msg_controllen = sizeof(cm.b),
+		};
+		const char *bp = buf;
+		size_t ifd = 0U;
+		char *lp;
+		ssize_t nrd;
+
+		if ((nrd = recvmsg(s, &m, MSG_CMSG_CLOEXEC)) <= 0) {
+			rc = nrd < 0 ? -1 : rc;
+			break;
+		}
+		nfds = serve_fds(&m, fds, nfds);
+		bz += nrd;
+
+		for (; (lp = memchr(bp, '\n', buf + bz - bp)) != NULL;
+		     bp = lp + 1U) {
+			if (lp == bp) {
+				/* end of requests */
+				eor_p = true;
+				break;
+			} else if (lp == bp + 1U && *bp == '!') {
+				if (UNLIKELY(ifd + 2U > nfds)) {
+					error("Error: no descriptors passed "
+					      "for status");
+					rc = -1;
+					continue;
+				}
+				/* our stderr is the client's now */
+				dup2(fds[ifd], STDERR_FILENO);
+				close(fds[ifd++]);
+				if (serve_stfd >= 0) {
+					close(serve_stfd);
+				}
+				serve_stfd = fds[ifd++];
+				continue;
+			} else if (*bp == '\t' && ifd >= nfds) {
+				error("Error: no descriptor passed for `%.*s'",
+				      (int)(lp - bp - 1), bp + 1U);
+				rc = -1;
+				continue;
+			}
+			*lp = '\0';
+			if (req(bp + (*bp == '\t'),
+				*bp == '\t' ? fds[ifd++] : -1, clo) < 0) {
+				rc = -1;
+			}
+		}
+		/* keep the descriptors and the partial line not used up */
+		nfds -= ifd;
+		memmove(fds, fds + ifd, nfds * sizeof(*fds));
+		if (UNLIKELY(bp == buf && bz >= sizeof(buf))) {
+			error("Error: request line too long");
+			rc = -1;
+			break;
+		}
+		bz -= bp - buf;
+		memmove(buf, bp, bz);
+	}
+	/* descriptors nobody asked for */
+	for (size_t i = 0U; i < nfds; i++) {
+		close(fds[i]);
+	}
+	return rc;
+}
+
+int
+gserve(const char *fn, gserve_conn_f conn, void *clo)
+{
+	struct sockaddr_un sa = {.sun_family = AF_UNIX};
+	struct sigaction sig = {.sa_handler = serve_sig};
+	int rc;
+	int s;
+
+	if (UNLIKELY(strlen(fn) >= sizeof(sa.sun_path))) {
+		errno = ENAMETOOLONG;
+		return -1;
+	} else if (UNLIKELY((s = socket(AF_UNIX,
+					SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)) {
+		return -1;
+	}
+	strcpy(sa.sun_path, fn);
+	if ((rc = bind(s, (struct sockaddr*)&sa, sizeof(sa))) < 0 &&
+	    errno == EADDRINUSE) {
+		/* could be the remains of a server gone */
+		const int t = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+		if (t >= 0 &&
+		    connect(t, (struct sockaddr*)&sa, sizeof(sa)) < 0 &&
+		    errno == ECONNREFUSED) {
+			unlink(fn);
+		}
+		if (t >= 0) {
+			close(t);
+		}
+		rc = bind(s, (struct sockaddr*)&sa, sizeof(sa));
+	}
+	if (UNLIKELY(rc < 0 || listen(s, SOMAXCONN) < 0)) {
+		with (int e = errno) {
+			close(s);
+			errno = e;
+		}
+		return -1;
+	}
+
+	/* children are reaped automatically, signals make us quit */
+	signal(SIGCHLD, SIG_IGN);
+	sigaction(SIGINT, &sig, NULL);
+	sigaction(SIGTERM, &sig, NULL);
+
+	while (!serve_quit) {
+		int c;
+
+		if ((c = accept4(s, NULL, NULL, SOCK_CLOEXEC)) < 0) {
+			continue;
+		}
+		switch (fork()) {
+		case -1:
+			error("Error: cannot fork to serve connection");
+			break;
+		case 0:
+			/* child, the results go to the client */
+			close(s);
+			signal(SIGCHLD, SIG_DFL);
+			dup2(c, STDOUT_FILENO);
+			close(c);
+			rc = conn(clo) < 0;
+			/* results first, then the status */
+			close(STDOUT_FILENO);
+			if (serve_stfd >= 0) {
+				const char st = (char)rc;
+
+				while (write(serve_stfd, &st, 1U) < 0 &&
+				       errno == EINTR);
+			}
+			_exit(rc);
+		default:
+			break;
+		}
+		close(c);
+	}
+	close(s);
+	unlink(fn);
+	return 0;
+}
+
+int
+gserve_connect(const char *sn, char *const fns[], size_t nfns,
+	       const char *stdin_fn)
+{
+	struct sockaddr_un sa = {.sun_family = AF_UNIX};
+	pthread_t cpy;
+	void *cprc;
+	int rc = 0;
+	int st[2U];
+	int s;
+
+	if (UNLIKELY(strlen(sn) >= sizeof(sa.sun_path))) {
+		errno = 0;
+		error("Error: socket name `%s' too long", sn);
+		return -1;
+	} else if (UNLIKELY((s = socket(AF_UNIX,
+					SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)) {
+		error("Error: cannot create socket");
+		return -1;
+	}
+	strcpy(sa.sun_path, sn);
+	if (UNLIKELY(connect(s, (struct sockaddr*)&sa, sizeof(sa)) < 0)) {
+		error("Error: cannot connect to `%s'", sn);
+		close(s);
+		return -1;
+	} else if (UNLIKELY(pipe2(st, O_CLOEXEC) < 0)) {
+		error("Error: cannot create status pipe");
+		close(s);
+		return -1;
+	}
+	/* our stderr for the server's messages, and the status pipe,
+	 * only the server's copy of the latter is to stay open */
+	with (const int fds[] = {STDERR_FILENO, st[1U]}) {
+		if (UNLIKELY(send_fds(s, "!\n", 2U, fds, 2U) < 0)) {
+			error("Error: cannot talk to `%s'", sn);
+			rc = -1;
+		}
+		close(st[1U]);
+	}
+	if (UNLIKELY(rc < 0)) {
+		close(st[0U]);
+		close(s);
+		return -1;
+	} else if (UNLIKELY(pthread_create(&cpy, NULL, copier, &s))) {
+		error("Error: cannot spawn copier thread");
+		close(st[0U]);
+		close(s);
+		return -1;
+	}
+
+	for (size_t i = 0U; i < (nfns ? nfns : 1U); i++) {
+		const char *fn = nfns ? fns[i] : stdin_fn;
+		const size_t fz = strlen(fn);
+		char ln[fz + 2U];
+		int fd;
+
+		if (!nfns) {
+			fd = STDIN_FILENO;
+		} else if (UNLIKELY((fd = open(fn, O_RDONLY)) < 0)) {
+			error("Error: cannot open file `%s'", fn);
+			rc = -1;
+			continue;
+		}
+		/* tab, name, newline, and the descriptor along with it */
+		ln[0U] = '\t';
+		memcpy(ln + 1U, fn, fz);
+		ln[fz + 1U] = '\n';
+		if (UNLIKELY(send_fds(s, ln, sizeof(ln), &fd, 1U) < 0)) {
+			error("Error: cannot send request for `%s'", fn);
+			rc = -1;
+		}
+		if (nfns) {
+			close(fd);
+		}
+	}
+	/* that's all the requests */
+	shutdown(s, SHUT_WR);
+
+	pthread_join(cpy, &cprc);
+	if (UNLIKELY(cprc != NULL)) {
+		rc = -1;
+	}
+	/* the server's verdict, none at all means it's gone */
+	with (char x) {
+		ssize_t n;
+
+		while ((n = read(st[0U], &x, 1U)) < 0 && errno == EINTR);
+		if (UNLIKELY(n <= 0)) {
+			errno = 0;
+			error("Error: no status from `%s'", sn);
+			rc = -1;
+		} else if (x) {
+			/* the server told about it on our stderr */
+			rc = -1;
+		}
+	}
+	close(st[0U]);
+	close(s);
+	return rc;
+}
+
+/* glep-serve.c ends here */
@@ -0,0 +1,86 @@
+/*** glep-serve.h -- scan service over unix sockets
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_glep_serve_h_
+#define INCLUDED_glep_serve_h_
+
+#include <stddef.h>
+
+/**
+ * The scan service, see --serve and --connect.
+ *
+ * Clients send one request per line, either the name of a file for the
+ * server to open, or a tab followed by the name to report the descriptor
+ * passed along the line (SCM_RIGHTS) as, an empty line or EOF ends the
+ * requests, the results are sent back and the connection is closed.
+ * A line of just a ! passes two descriptors, error messages go to the
+ * first, and once everything's been sent back a single octet goes to
+ * the second, 0 if all went well. */
+
+/* most descriptors pending of a client */
+#define GSERVE_MAXFDS	(256U)
+
+/**
+ * Serve the connection on stdout, in the child of its own. */
+typedef int(*gserve_conn_f)(void *clo);
+
+/**
+ * Take up the request for file FN, to be read off FD, or opened by
+ * name if FD is -1.  FD is the callee's then. */
+typedef int(*gserve_req_f)(const char *fn, int fd, void *clo);
+
+
+/**
+ * Listen on the unix socket FN and serve every connection by calling
+ * CONN(CLO) in a child of its own, with the connection as its stdout,
+ * the child's exit status is CONN's verdict.  Return when SIGINT or
+ * SIGTERM comes in, 0 then, or -1 with errno set if FN is no good. */
+extern int gserve(const char *fn, gserve_conn_f conn, void *clo);
+
+/**
+ * Read the requests off the connection S and hand them to REQ along
+ * with CLO.  Return 0 if all went well, -1 otherwise. */
+extern int gserve_feed(int s, gserve_req_f req, void *clo);
+
+/**
+ * Hand FNS, or stdin, to be reported as STDIN_FN, if NFNS is 0, to the
+ * server listening on SN and copy the results to stdout as they come.
+ * Return 0 if all went well, on either side, -1 otherwise. */
+extern int
+gserve_connect(const char *sn, char *const fns[], size_t nfns,
+	       const char *stdin_fn);
+
+#endif	/* INCLUDED_glep_serve_h_ */
@@ -40,6 +40,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
+#include <inttypes.h>
 #include <assert.h>
 #if defined HAVE_MMINTRIN_H
 # include <mmintrin.h>
@@ -510,24 +511,121 @@ typedef uint64_t accu_t;
 #endif	/* HAVE__MM512_CMPEQ_EPI8_MASK || HAVE__MM512_CMP_EPI8_MASK */
 
 
-#define USE_CACHE
-/* the alphabet we're dealing with */
-static char pchars[0x100U];
-static size_t npchars;
-#if defined USE_CACHE
-static size_t ncchars;
-#endif	/* USE_CACHE */
-/* offs is pchars inverted mapping C == PCHARS[OFFS[C]] */
-static uint8_t offs[0x100U];
+/* maximum number of elements in a recoded pattern,
+ * i.e. 4 characters and 2 boundaries */
+#define MAX_DEPTH	(8U)
+/* longest pattern that goes into the shared-prefix tree */
+#define TRIE_MAXN	(2U)
+
+/* width of the fingerprints in bytes, i.e. the shortest pattern that
+ * goes to the fingerprint matcher */
+#define TEDDY_K		(3U)
+/* longest pattern that goes to the fingerprint matcher */
+#define TEDDY_MAXN	(8U)
+/* number of buckets, i.e. bits in a fingerprint */
+#define TEDDY_NB	(8U)
+
+/* phases of a scan as timed for --stats */
+enum {
+	PHASE_TEDDY,
+	PHASE_DECOMP,
+	PHASE_DMATCH,
+	PHASE_DCOUNT,
+	NPHASES
+};
+
+/* cost model for the planner, in ns per KiB of text as measured on
+ * english news text, the tree's scan plus a little per pattern, the
+ * fingerprint scan plus the surcharge per bucket hit and octet */
+#define COST_TRIE	(400U)
+#define COST_TRIE_PAT	(60U)
+#define COST_TEDDY	(340U)
+#define COST_TEDDY_HIT	(5060U)
+
+/* node of the shared-prefix tree, nodes are stored in preorder */
+struct dnode_s {
+	/** element, offset into the alphabet or 0 for puncs */
+	uint8_t c;
+	/** for case-insensitive letters, offset of the other case */
+	uint8_t o;
+	/** depth of this node, i.e. the level of its bitmask */
+	uint8_t d;
+	/** shift of this element relative to the first character */
+	uint8_t sh;
+	/** index of the first node not in this node's subtree */
+	uint32_t skip;
+	/** patterns ending in this node, range into PIDX */
+	uint32_t pbeg;
+	uint32_t pend;
+};
+
+/* fingerprinted pattern, verified against one 8-byte load X
+ * as (X & MSK | CIM) == VAL */
+struct tpat_s {
+	uint64_t val;
+	uint64_t msk;
+	/** 0x20 in the bytes of case-insensitive letters */
+	uint64_t cim;
+	/** counter index */
+	uint32_t idx;
+	uint8_t n;
+	uint8_t left;
+	uint8_t right;
+};
+
+struct glepcc_s {
+	/* the alphabet we're dealing with */
+	char pchars[0x100U];
+	size_t npchars;
+	/* offs is pchars inverted mapping C == PCHARS[OFFS[C]] */
+	uint8_t offs[0x100U];
+
+	/* shared-prefix tree over the recoded patterns */
+	size_t nnodes;
+	struct dnode_s *nodes;
+	/* counter indices of the patterns in tree order */
+	unsigned int *pidx;
+
+	/* nibble fingerprints, bit B of FLO[K][X] is set iff a pattern in
+	 * bucket B has X as low nibble in its K-th byte, FHI likewise */
+	uint8_t flo[TEDDY_K][16U];
+	uint8_t fhi[TEDDY_K][16U];
+	/* fingerprinted patterns, bucket B is range BKT[B] to BKT[B + 1] */
+	uint32_t bkt[TEDDY_NB + 1U];
+	struct tpat_s *tpats;
+
+	/* non-zero if nodes, pidx and tpats live in a database */
+	int mapped;
+
+	/* fingerprint hits, for --engine-stats */
+	uint64_t ncand;
+	/* nanoseconds spent per phase, for --stats */
+	uint64_t tsec[NPHASES];
+};
+
+/* database record of the above, arrays by offset */
+struct ccrec_s {
+	char pchars[0x100U];
+	uint8_t offs[0x100U];
+	uint64_t npchars;
+	uint64_t nnodes;
+	uint64_t nodes;
+	uint64_t npidx;
+	uint64_t pidx;
+	uint8_t flo[TEDDY_K][16U];
+	uint8_t fhi[TEDDY_K][16U];
+	uint32_t bkt[TEDDY_NB + 1U];
+	uint64_t tpats;
+};
 
 static void
-add_pchar(unsigned char c)
+add_pchar(struct glepcc_s *restrict cc, unsigned char c)
 {
-	if (offs[c]) {
+	if (cc->offs[c]) {
 		return;
 	}
-	offs[c] = ++npchars;
-	pchars[offs[c]] = c;
+	cc->offs[c] = ++cc->npchars;
+	cc->pchars[cc->offs[c]] = c;
 	return;
 }
 
@@ -670,8 +768,11 @@ shiftl(accu_t *restrict tgt, const accu_t *src, size_t ssz)
 }
 
 static inline unsigned int
-shiftr_and(accu_t *restrict tgt, const accu_t *src, size_t ssz, size_t n)
+shiftr_and(
+	accu_t *restrict tgt, const accu_t *par, const accu_t *src,
+	size_t ssz, size_t n)
 {
+/* calc TGT = PAR & SRC >> N, return the number of non-naught cells */
 	unsigned int i = n / ACCU_BITS;
 	unsigned int sh = n % ACCU_BITS;
 	unsigned int j = 0U;
@@ -679,7 +780,7 @@ shiftr_and(accu_t *restrict tgt, const accu_t *src, size_t ssz, size_t n)
 
 	for (const accu_t msk = ((accu_t)1U << sh) - 1U;
 	     i < ssz - 1U; i++, j++) {
-		if (!tgt[j]) {
+		if (!(tgt[j] = par[j])) {
 			continue;
 		}
 		tgt[j] &= src[i] >> sh |
@@ -688,7 +789,7 @@ shiftr_and(accu_t *restrict tgt, const accu_t *src, size_t ssz, size_t n)
 			res++;
 		}
 	}
-	if (tgt[j] && (tgt[j] &= src[i] >> sh)) {
+	if ((tgt[j] = par[j]) && (tgt[j] &= src[i] >> sh)) {
 		res++;
 	}
 	for (j++; j < ssz; j++) {
@@ -699,9 +800,11 @@ shiftr_and(accu_t *restrict tgt, const accu_t *src, size_t ssz, size_t n)
 
 static inline unsigned int
 shiftr_and_ci(
-	accu_t *restrict tgt, const accu_t *s1, const accu_t *s2,
+	accu_t *restrict tgt, const accu_t *par,
+	const accu_t *s1, const accu_t *s2,
 	size_t ssz, size_t n)
 {
+/* calc TGT = PAR & (S1 | S2) >> N, return the number of non-naught cells */
 	unsigned int i = n / ACCU_BITS;
 	unsigned int sh = n % ACCU_BITS;
 	unsigned int j = 0U;
@@ -709,7 +812,7 @@ shiftr_and_ci(
 
 	for (const accu_t msk = ((accu_t)1U << sh) - 1U;
 	     i < ssz - 1U; i++, j++) {
-		if (!tgt[j]) {
+		if (!(tgt[j] = par[j])) {
 			continue;
 		}
 		tgt[j] &=
@@ -721,7 +824,7 @@ shiftr_and_ci(
 			res++;
 		}
 	}
-	if (tgt[j] && (tgt[j] &= (s1[i] >> sh) | (s2[i] >> sh))) {
+	if ((tgt[j] = par[j]) && (tgt[j] &= (s1[i] >> sh) | (s2[i] >> sh))) {
 		res++;
 	}
 	for (j++; j < ssz; j++) {
@@ -731,106 +834,34 @@ shiftr_and_ci(
 }
 
 static void
-dmatch(accu_t *restrict tgt,
-       accu_t (*const src)[0x100U], size_t ssz,
-       const uint8_t s[], size_t z)
+dfirst(accu_t *restrict tgt,
+       accu_t (*const src)[0x100U], size_t ssz, struct dnode_s n)
 {
 /* this is matching on the fully decomposed buffer
  * we say a character C matches at position I iff SRC[C] & (1U << i)
- * we say a string S[] matches if all characters S[i] match
- * note the characters are offsets according to the PCHARS alphabet. */
-	size_t i;
-
-#if defined USE_CACHE
-	if (!*s && pchars[s[1U]] >= 'a' && pchars[s[1U]] <= 'z') {
-		unsigned char c = (unsigned char)(pchars[s[1U]] - ('a' - 1));
-
-		s++;
-		z--;
-		if (offs[c]) {
-			dbang(tgt, src[offs[c]], ssz);
-		} else {
-			/* cache the first round */
-			shiftl(tgt, *src, ssz);
-			shiftr_and(tgt, src[s[0U]], ssz, 0U);
-
-			offs[c] = ++ncchars;
-			pchars[offs[c]] = c;
-
-			/* violate the const */
-			dbang(src[offs[c]], tgt, ssz);
-		}
-		i = 1U;
-	} else if (!*s) {
-		shiftl(tgt, *src, ssz);
-		s++;
-		z--;
-		i = 0U;
-	} else {
-		dbang(tgt, src[*s], ssz);
-		i = 1U;
-	}
-#else  /* !USE_CACHE */
-	if (!*s) {
+ * the first element of a pattern is either puncs, shifted so that
+ * bit I denotes a puncs character left of I, or a character, or,
+ * for case-insensitive letters, either case of it */
+	if (!n.c) {
 		shiftl(tgt, *src, ssz);
-		s++;
-		z--;
-		i = 0U;
+	} else if (!n.o) {
+		dbang(tgt, src[n.c], ssz);
 	} else {
-		dbang(tgt, src[*s], ssz);
-		i = 1U;
-	}
-#endif	/* USE_CACHE */
-
-	for (; i < z; i++) {
-		/* SRC >>= i, TGT &= SRC */
-		if (!shiftr_and(tgt, src[s[i]], ssz, i)) {
-			break;
-		}
+		dbang(tgt, src[n.c], ssz);
+		dbngor(tgt, src[n.o], ssz);
 	}
 	return;
 }
 
-static void
-dmatchci(accu_t *restrict tgt,
-       accu_t (*const src)[0x100U], size_t ssz,
-       const uint8_t s[], size_t z)
+static unsigned int
+dnext(accu_t *restrict tgt, const accu_t *par,
+      accu_t (*const src)[0x100U], size_t ssz, struct dnode_s n)
 {
-/* like dmatch() but for case-insensitive characters s... */
-	size_t i;
-
-	if (!*s) {
-		shiftl(tgt, *src, ssz);
-		s++;
-		z--;
-		i = 0U;
-	} else if ((*s | 0x20) >= 'a' && (*s | 0x20) <= 'z') {
-		dbang(tgt, src[u8ucase(*s)], ssz);
-		dbngor(tgt, src[u8lcase(*s)], ssz);
-		i = 1U;
-	} else {
-		dbang(tgt, src[*s], ssz);
-		i = 1U;
+/* refine the prefix bitmask PAR by element N, i.e. TGT = PAR & N >> sh */
+	if (!n.o) {
+		return shiftr_and(tgt, par, src[n.c], ssz, n.sh);
 	}
-
-	for (; i < z; i++) {
-		if ((pchars[s[i]] | 0x20) >= 'a' &&
-		    (pchars[s[i]] | 0x20) <= 'z') {
-			/* SRC >>= i, TGT &= ucase(SRC) | lcase(SRC) */
-			const uint8_t us = offs[u8ucase(pchars[s[i]])];
-			const uint8_t ls = offs[u8lcase(pchars[s[i]])];
-
-			if (!shiftr_and_ci(tgt, src[us], src[ls], ssz, i)) {
-				break;
-			}
-		} else {
-			/* TGT &= SRC >>= i */
-			if (!shiftr_and(tgt, src[s[i]], ssz, i)) {
-				break;
-			}
-		}
-	}
-	return;
+	return shiftr_and_ci(tgt, par, src[n.c], src[n.o], ssz, n.sh);
 }
 
 static uint_fast32_t
@@ -882,35 +913,475 @@ _dcount_intrin(const accu_t *src, size_t ssz)
 }
 #endif	/* HAVE_POPCNT_INTRINS */
 
+static void
+dhits(ghits_t h, const accu_t *src, size_t ssz,
+      const unsigned int *pidx, size_t npidx)
+{
+/* record the bits set in SRC as matches of the NPIDX patterns PIDX,
+ * the bit index is the offset of the match, cells are left out
+ * exactly like in dcount() */
+	for (size_t i = 0U,
+		     ei = ssz - !(ssz < CHUNKZ / ACCU_BITS); i < ei; i++) {
+		for (accu_t m = src[i]; m; m &= m - 1U) {
+			const size_t o = i * ACCU_BITS + __builtin_ctzll(m);
+
+			for (size_t j = 0U; j < npidx; j++) {
+				ghits_add(h, pidx[j], o);
+			}
+		}
+	}
+	return;
+}
+
 static size_t
-recode(uint8_t *restrict tgt, glod_pat_t p)
+recode(uint16_t *restrict tgt, const struct glepcc_s *cc, glod_pat_t p)
 {
+/* recode P into alphabet offsets, 0 denotes puncs,
+ * case-insensitive letters are keyed by their lower case offset
+ * with bit 8 set */
 	const uint8_t *s = (const void*)p.p;
 	size_t i = 0U;
 
 	if (!p.fl.left) {
 		/* require puncs character left of string */
-		tgt[i++] = '\0';
-		s--;
+		tgt[i++] = 0U;
 	}
-	for (; s[i]; i++) {
-		tgt[i] = offs[s[i]];
+	for (; *s; s++) {
+		if (p.fl.ci && (*s | 0x20) >= 'a' && (*s | 0x20) <= 'z') {
+			tgt[i++] = 0x100U | cc->offs[u8lcase(*s)];
+		} else {
+			tgt[i++] = cc->offs[*s];
+		}
 	}
 	if (!p.fl.right) {
-		tgt[i++] = '\0';
+		tgt[i++] = 0U;
 	}
 	return i;
 }
 
+struct dkey_s {
+	uint16_t k[MAX_DEPTH];
+	size_t n;
+	unsigned int idx;
+};
+
+static int
+dkey_cmp(const void *x, const void *y)
+{
+	const struct dkey_s *kx = x;
+	const struct dkey_s *ky = y;
+
+	for (size_t i = 0U; i < kx->n && i < ky->n; i++) {
+		if (kx->k[i] != ky->k[i]) {
+			return kx->k[i] < ky->k[i] ? -1 : 1;
+		}
+	}
+	return (kx->n > ky->n) - (kx->n < ky->n);
+}
+
+static int
+build_trie(struct glepcc_s *restrict cc, glod_pats_t g)
+{
+/* build the shared-prefix tree, sorting the recoded patterns puts
+ * common prefixes next to each other, the tree is then laid out in
+ * preorder with skip indices to jump over dead subtrees */
+	struct dkey_s *keys;
+	size_t nkeys = 0U;
+	/* nodes on the path to the current node, by depth */
+	size_t path[MAX_DEPTH];
+	size_t npath = 0U;
+	size_t np = 0U;
+
+	if (UNLIKELY((keys = malloc(g->npats * sizeof(*keys))) == NULL)) {
+		return -1;
+	}
+	for (size_t i = 0U; i < g->npats; i++) {
+		if (UNLIKELY(g->pats[i].n == 0U || g->pats[i].n > TRIE_MAXN)) {
+			continue;
+		}
+		keys[nkeys].n = recode(keys[nkeys].k, cc, g->pats[i]);
+		keys[nkeys].idx = g->pats[i].idx;
+		nkeys++;
+	}
+	qsort(keys, nkeys, sizeof(*keys), dkey_cmp);
+
+	cc->nodes = malloc((nkeys * MAX_DEPTH + 1U) * sizeof(*cc->nodes));
+	cc->pidx = malloc((nkeys + 1U) * sizeof(*cc->pidx));
+	if (UNLIKELY(cc->nodes == NULL || cc->pidx == NULL)) {
+		free(keys);
+		return -1;
+	}
+
+	for (size_t i = 0U; i < nkeys; i++) {
+		const struct dkey_s k = keys[i];
+		size_t l = 0U;
+
+		if (i > 0U) {
+			/* length of the prefix shared with the previous key */
+			const struct dkey_s *pk = keys + i - 1U;
+
+			for (; l < k.n && l < pk->n && k.k[l] == pk->k[l]; l++);
+		}
+		/* close the subtrees we're leaving */
+		for (; npath > l; npath--) {
+			cc->nodes[path[npath - 1U]].skip = cc->nnodes;
+		}
+		/* open new nodes for the rest of the key */
+		for (; npath < k.n; npath++) {
+			const uint8_t c = (uint8_t)(k.k[npath] & 0xffU);
+			const uint8_t o = (uint8_t)(k.k[npath] & 0x100U
+				? cc->offs[u8ucase(cc->pchars[c])] : 0U);
+
+			path[npath] = cc->nnodes;
+			cc->nodes[cc->nnodes++] = (struct dnode_s){
+				.c = c,
+				.o = o,
+				.d = (uint8_t)npath,
+				.sh = (uint8_t)(npath - (npath && !k.k[0U])),
+				.pbeg = np,
+				.pend = np,
+			};
+		}
+		/* attach pattern to the last node */
+		with (struct dnode_s *n = cc->nodes + path[k.n - 1U]) {
+			if (n->pbeg == n->pend) {
+				n->pbeg = np;
+			}
+			cc->pidx[np++] = k.idx;
+			n->pend = np;
+		}
+	}
+	for (; npath > 0U; npath--) {
+		cc->nodes[path[npath - 1U]].skip = cc->nnodes;
+	}
+	free(keys);
+	return 0;
+}
+
+
+/* fingerprint matcher, a variant of Teddy:
+ * for each of the first TEDDY_K bytes of a pattern the bucket bits of
+ * its low and high nibble are looked up with pshufb and and'ed, a
+ * non-naught result flags positions where a pattern of the indicated
+ * buckets may start, the bucket's patterns are then verified */
+static int
+tpat_cmp(const void *x, const void *y)
+{
+	const struct tpat_s *tx = x;
+	const struct tpat_s *ty = y;
+
+	/* VAL holds the pattern bytes in order */
+	return memcmp(&tx->val, &ty->val, sizeof(tx->val));
+}
+
+static int
+build_teddy(struct glepcc_s *restrict cc, glod_pats_t g)
+{
+/* sort the patterns so that similar fingerprints share a bucket,
+ * then cut the lot into TEDDY_NB buckets of equal size */
+	size_t n = 0U;
+
+	cc->tpats = calloc(g->npats + 1U, sizeof(*cc->tpats));
+	if (UNLIKELY(cc->tpats == NULL)) {
+		return -1;
+	}
+	for (size_t i = 0U; i < g->npats; i++) {
+		const glod_pat_t p = g->pats[i];
+		uint8_t v[sizeof(uint64_t)] = {0U};
+		uint8_t m[sizeof(uint64_t)] = {0U};
+		uint8_t c[sizeof(uint64_t)] = {0U};
+		struct tpat_s *t = cc->tpats + n;
+
+		if (p.n <= TRIE_MAXN || p.n > TEDDY_MAXN) {
+			continue;
+		}
+		for (size_t j = 0U; j < p.n; j++) {
+			v[j] = (uint8_t)p.p[j];
+			m[j] = 0xffU;
+			if (p.fl.ci && u8lcase(v[j]) >= 'a' && u8lcase(v[j]) <= 'z') {
+				v[j] = u8lcase(v[j]);
+				c[j] = 0x20U;
+			}
+		}
+		memcpy(&t->val, v, sizeof(t->val));
+		memcpy(&t->msk, m, sizeof(t->msk));
+		memcpy(&t->cim, c, sizeof(t->cim));
+		t->idx = p.idx;
+		t->n = (uint8_t)p.n;
+		t->left = (uint8_t)p.fl.left;
+		t->right = (uint8_t)p.fl.right;
+		n++;
+	}
+	qsort(cc->tpats, n, sizeof(*cc->tpats), tpat_cmp);
+
+	for (size_t b = 0U; b <= TEDDY_NB; b++) {
+		cc->bkt[b] = (uint32_t)(b * n / TEDDY_NB);
+	}
+	for (size_t b = 0U; b < TEDDY_NB; b++) {
+		for (size_t j = cc->bkt[b]; j < cc->bkt[b + 1U]; j++) {
+			const struct tpat_s t = cc->tpats[j];
+			uint8_t v[sizeof(t.val)];
+			uint8_t c[sizeof(t.cim)];
+
+			memcpy(v, &t.val, sizeof(v));
+			memcpy(c, &t.cim, sizeof(c));
+			for (size_t k = 0U; k < TEDDY_K; k++) {
+				cc->flo[k][v[k] & 0xfU] |= (uint8_t)(1U << b);
+				cc->fhi[k][v[k] >> 4U] |= (uint8_t)(1U << b);
+				/* the other case has the same low nibble */
+				cc->fhi[k][(v[k] ^ c[k]) >> 4U] |= (uint8_t)(1U << b);
+			}
+		}
+	}
+	return 0;
+}
+
+static inline unsigned int
+tverify(gcnt_t *restrict cnt, ghits_t hits, glepcc_t g,
+	const uint8_t *b, size_t bsz, size_t i, unsigned int bkts)
+{
+/* verify the patterns of buckets BKTS at position I of B,
+ * return the number of matches */
+	unsigned int nmtch = 0U;
+	uint64_t x = 0U;
+
+	if (UNLIKELY(engine_stats_p)) {
+		__atomic_add_fetch(&g->ncand, 1U, __ATOMIC_RELAXED);
+	}
+	if (LIKELY(i + sizeof(x) <= bsz)) {
+		memcpy(&x, b + i, sizeof(x));
+	} else {
+		memcpy(&x, b + i, bsz - i);
+	}
+	for (; bkts; bkts &= bkts - 1U) {
+		const unsigned int k = __builtin_ctz(bkts);
+
+		for (size_t j = g->bkt[k]; j < g->bkt[k + 1U]; j++) {
+			const struct tpat_s *t = g->tpats + j;
+
+			gpst_vrfy(t->idx);
+			if (((x & t->msk) | t->cim) != t->val) {
+				continue;
+			} else if (UNLIKELY(i + t->n > bsz)) {
+				continue;
+			} else if (!t->left && i && !ispuncs((int8_t)b[i - 1U])) {
+				continue;
+			} else if (!t->right && i + t->n < bsz &&
+				   !ispuncs((int8_t)b[i + t->n])) {
+				continue;
+			}
+			/* MATCH */
+			cnt[t->idx]++;
+			nmtch++;
+			if (UNLIKELY(hits != NULL)) {
+				ghits_add(hits, t->idx, i);
+			}
+		}
+	}
+	return nmtch;
+}
+
+static size_t
+_teddy_seq(gcnt_t *restrict cnt, ghits_t hits, glepcc_t g,
+	   const uint8_t *b, size_t bsz, size_t i)
+{
+/* scan B from I onwards, return the number of matches */
+	const size_t ep = bsz < CHUNKZ ? bsz : CHUNKZ - MWNDWZ;
+	size_t nmtch = 0U;
+
+	for (; i < ep && i + TEDDY_K <= bsz; i++) {
+		unsigned int m = 0xffU;
+
+		for (size_t k = 0U; k < TEDDY_K; k++) {
+			const uint8_t c = b[i + k];
+
+			m &= g->flo[k][c & 0xfU] & g->fhi[k][c >> 4U];
+		}
+		if (UNLIKELY(m)) {
+			nmtch += tverify(cnt, hits, g, b, bsz, i, m);
+		}
+	}
+	return nmtch;
+}
+
+static size_t
+_teddy_routin(gcnt_t *restrict cnt, ghits_t hits,
+	      glepcc_t g, const uint8_t *b, size_t bsz)
+{
+	return _teddy_seq(cnt, hits, g, b, bsz, 0U);
+}
+
+/* the pshufb variants are compiled for their targets regardless of the
+ * compiler flags and chosen at runtime */
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__) && \
+	defined HAVE_IMMINTRIN_H
+# define HAVE_TEDDY_INTRIN
+
+static __attribute__((target("ssse3"))) size_t
+_teddy128(gcnt_t *restrict cnt, ghits_t hits,
+	  glepcc_t g, const uint8_t *b, size_t bsz)
+{
+	const size_t ep = bsz < CHUNKZ ? bsz : CHUNKZ - MWNDWZ;
+	const __m128i nib = _mm_set1_epi8(0x0f);
+	__m128i lo[TEDDY_K];
+	__m128i hi[TEDDY_K];
+	size_t nmtch = 0U;
+	size_t i = 0U;
+
+	for (size_t k = 0U; k < TEDDY_K; k++) {
+		lo[k] = _mm_loadu_si128((const void*)g->flo[k]);
+		hi[k] = _mm_loadu_si128((const void*)g->fhi[k]);
+	}
+	for (; i < ep && i + 16U + TEDDY_K - 1U <= bsz; i += 16U) {
+		__m128i r = _mm_set1_epi8(-1);
+		unsigned int m;
+
+		for (size_t k = 0U; k < TEDDY_K; k++) {
+			const __m128i d = _mm_loadu_si128((const void*)(b + i + k));
+			const __m128i dl = _mm_and_si128(d, nib);
+			const __m128i dh = _mm_and_si128(_mm_srli_epi16(d, 4), nib);
+
+			r = _mm_and_si128(r, _mm_shuffle_epi8(lo[k], dl));
+			r = _mm_and_si128(r, _mm_shuffle_epi8(hi[k], dh));
+		}
+		m = _mm_movemask_epi8(_mm_cmpeq_epi8(r, _mm_setzero_si128()));
+		if (UNLIKELY((m ^= 0xffffU))) {
+			uint8_t rb[16U];
+
+			_mm_storeu_si128((void*)rb, r);
+			for (; m; m &= m - 1U) {
+				const unsigned int j = __builtin_ctz(m);
+
+				if (UNLIKELY(i + j >= ep)) {
+					break;
+				}
+				nmtch += tverify(
+					cnt, hits, g, b, bsz, i + j, rb[j]);
+			}
+		}
+	}
+	return nmtch + _teddy_seq(cnt, hits, g, b, bsz, i);
+}
+
+static __attribute__((target("avx2"))) size_t
+_teddy256(gcnt_t *restrict cnt, ghits_t hits,
+	  glepcc_t g, const uint8_t *b, size_t bsz)
+{
+	const size_t ep = bsz < CHUNKZ ? bsz : CHUNKZ - MWNDWZ;
+	const __m256i nib = _mm256_set1_epi8(0x0f);
+	__m256i lo[TEDDY_K];
+	__m256i hi[TEDDY_K];
+	size_t nmtch = 0U;
+	size_t i = 0U;
+
+	/* pshufb works per 128-bit lane, so duplicate the tables */
+	for (size_t k = 0U; k < TEDDY_K; k++) {
+		lo[k] = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const void*)g->flo[k]));
+		hi[k] = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const void*)g->fhi[k]));
+	}
+	for (; i < ep && i + 32U + TEDDY_K - 1U <= bsz; i += 32U) {
+		__m256i r = _mm256_set1_epi8(-1);
+		uint32_t m;
+
+		for (size_t k = 0U; k < TEDDY_K; k++) {
+			const __m256i d =
+				_mm256_loadu_si256((const void*)(b + i + k));
+			const __m256i dl = _mm256_and_si256(d, nib);
+			const __m256i dh =
+				_mm256_and_si256(_mm256_srli_epi16(d, 4), nib);
+
+			r = _mm256_and_si256(r, _mm256_shuffle_epi8(lo[k], dl));
+			r = _mm256_and_si256(r, _mm256_shuffle_epi8(hi[k], dh));
+		}
+		m = (uint32_t)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(r, _mm256_setzero_si256()));
+		if (UNLIKELY((m = ~m))) {
+			uint8_t rb[32U];
+
+			_mm256_storeu_si256((void*)rb, r);
+			for (; m; m &= m - 1U) {
+				const unsigned int j = __builtin_ctz(m);
+
+				if (UNLIKELY(i + j >= ep)) {
+					break;
+				}
+				nmtch += tverify(
+					cnt, hits, g, b, bsz, i + j, rb[j]);
+			}
+		}
+	}
+	return nmtch + _teddy_seq(cnt, hits, g, b, bsz, i);
+}
+
+static __attribute__((target("avx512f,avx512bw"))) size_t
+_teddy512(gcnt_t *restrict cnt, ghits_t hits,
+	  glepcc_t g, const uint8_t *b, size_t bsz)
+{
+	const size_t ep = bsz < CHUNKZ ? bsz : CHUNKZ - MWNDWZ;
+	const __m512i nib = _mm512_set1_epi8(0x0f);
+	__m512i lo[TEDDY_K];
+	__m512i hi[TEDDY_K];
+	size_t nmtch = 0U;
+	size_t i = 0U;
+
+	/* pshufb works per 128-bit lane, so quadruple the tables */
+	for (size_t k = 0U; k < TEDDY_K; k++) {
+		lo[k] = _mm512_broadcast_i32x4(
+			_mm_loadu_si128((const void*)g->flo[k]));
+		hi[k] = _mm512_broadcast_i32x4(
+			_mm_loadu_si128((const void*)g->fhi[k]));
+	}
+	for (; i < ep && i + 64U + TEDDY_K - 1U <= bsz; i += 64U) {
+		__m512i r = _mm512_set1_epi8(-1);
+		uint64_t m;
+
+		for (size_t k = 0U; k < TEDDY_K; k++) {
+			const __m512i d =
+				_mm512_loadu_si512((const void*)(b + i + k));
+			const __m512i dl = _mm512_and_si512(d, nib);
+			const __m512i dh =
+				_mm512_and_si512(_mm512_srli_epi16(d, 4), nib);
+
+			r = _mm512_and_si512(r, _mm512_shuffle_epi8(lo[k], dl));
+			r = _mm512_and_si512(r, _mm512_shuffle_epi8(hi[k], dh));
+		}
+		if (UNLIKELY((m = _mm512_test_epi8_mask(r, r)))) {
+			uint8_t rb[64U];
+
+			_mm512_storeu_si512((void*)rb, r);
+			for (; m; m &= m - 1U) {
+				const unsigned int j = __builtin_ctzll(m);
+
+				if (UNLIKELY(i + j >= ep)) {
+					break;
+				}
+				nmtch += tverify(
+					cnt, hits, g, b, bsz, i + j, rb[j]);
+			}
+		}
+	}
+	return nmtch + _teddy_seq(cnt, hits, g, b, bsz, i);
+}
+#endif	/* __GNUC__ && x86 && HAVE_IMMINTRIN_H */
+
+
 
 /* public glep API */
 static uint_fast32_t(*dcount)(const accu_t *src, size_t ssz);
 static size_t(*decomp)(accu_t (*restrict tgt)[0x100U], const void *b, size_t z,
 		       const char pchars[static 0x100U], size_t npchars);
+static size_t(*teddy)(gcnt_t *restrict cnt, ghits_t hits, glepcc_t g,
+		      const uint8_t *b, size_t z);
 
 static void
 glep_simd_dispatch(void)
 {
+	if (decomp != NULL) {
+		/* dispatched already */
+		return;
+	}
 #if defined HAVE_POPCNT_INTRINS
 	if (dcount == NULL &&
 	    (has_cpu_feature_p(_FEAT_POPCNT) || has_cpu_feature_p(_FEAT_ABM))) {
@@ -945,123 +1416,362 @@ glep_simd_dispatch(void)
 		/* should we abort instead? */
 		decomp = _decomp_seq;
 	}
+
+	if (0) {
+		;
+#if defined HAVE_TEDDY_INTRIN
+	} else if (has_cpu_feature_p(_FEAT_AVX512BW)) {
+		teddy = _teddy512;
+	} else if (has_cpu_feature_p(_FEAT_AVX2)) {
+		teddy = _teddy256;
+	} else if (has_cpu_feature_p(_FEAT_SSSE3)) {
+		teddy = _teddy128;
+#endif	/* HAVE_TEDDY_INTRIN */
+	} else {
+		teddy = _teddy_routin;
+	}
+	return;
+}
+
+int
+glep_simd_pin(const char *variant)
+{
+/* use the decomposer and fingerprint matcher of VARIANT (seq, 64, 128,
+ * 256 or 512) instead of the best ones the cpu has to offer,
+ * return -1 if VARIANT isn't compiled in or not supported */
+	size_t(*d)(accu_t (*restrict)[0x100U], const void*, size_t,
+		   const char[static 0x100U], size_t) = NULL;
+	size_t(*t)(gcnt_t *restrict, ghits_t, glepcc_t,
+		   const uint8_t*, size_t) = _teddy_routin;
+
+	if (0) {
+		;
+	} else if (!strcmp(variant, "seq")) {
+		d = _decomp_seq;
+#if defined __MMX__
+	} else if (!strcmp(variant, "64") && has_cpu_feature_p(_FEAT_MMX)) {
+		d = _decomp64;
+#endif	/* MMX */
+#if defined HAVE_MM128_INT_INTRINS
+	} else if (!strcmp(variant, "128") && has_cpu_feature_p(_FEAT_SSE2)) {
+		d = _decomp128;
+# if defined HAVE_TEDDY_INTRIN
+		if (has_cpu_feature_p(_FEAT_SSSE3)) {
+			t = _teddy128;
+		}
+# endif	 /* HAVE_TEDDY_INTRIN */
+#endif  /* HAVE_MM128_INT_INTRINS */
+#if defined HAVE_MM256_INT_INTRINS
+	} else if (!strcmp(variant, "256") && has_cpu_feature_p(_FEAT_AVX2)) {
+		d = _decomp256;
+# if defined HAVE_TEDDY_INTRIN
+		t = _teddy256;
+# endif	 /* HAVE_TEDDY_INTRIN */
+#endif	/* HAVE_MM256_INT_INTRINS */
+#if defined HAVE_MM512_INT_INTRINS
+	} else if (!strcmp(variant, "512") &&
+		   has_cpu_feature_p(_FEAT_AVX512BW)) {
+		d = _decomp512;
+# if defined HAVE_TEDDY_INTRIN
+		t = _teddy512;
+# endif	 /* HAVE_TEDDY_INTRIN */
+#endif	/* HAVE_MM512_INT_INTRINS */
+	} else {
+		return -1;
+	}
+	/* get dcount sorted, then override */
+	glep_simd_dispatch();
+	decomp = d;
+	teddy = t;
+	return 0;
+}
+
+uint64_t
+glep_simd_ncand(glepcc_t g)
+{
+/* number of fingerprint hits, requires engine_stats_p */
+	return g->ncand;
+}
+
+void
+glep_simd_stats(glepcc_t g)
+{
+/* print time spent per phase, requires engine_stats_p */
+	static const char *const phase[NPHASES] = {
+		[PHASE_TEDDY] = "teddy",
+		[PHASE_DECOMP] = "decomp",
+		[PHASE_DMATCH] = "dmatch",
+		[PHASE_DCOUNT] = "dcount",
+	};
+
+	for (size_t i = 0U; i < NPHASES; i++) {
+		fprintf(stderr, "simd\t%s\t%" PRIu64 "ns\n",
+			phase[i], g->tsec[i]);
+	}
+	fprintf(stderr, "simd\tcandidates\t%" PRIu64 "\n", g->ncand);
 	return;
 }
 
+size_t
+glep_simd_cost(glod_pats_t g)
+{
+/* estimate the scanning cost of G in ns per KiB of text, a bucket of
+ * K patterns admits a random octet's low nibble with probability
+ * 1 - (15/16)^K, and it takes TEDDY_K of those in a row for a hit,
+ * high nibbles of text are too uniform to filter anything */
+	size_t ntrie = 0U;
+	size_t ntd = 0U;
+	double nhit = 0;
+	size_t res = 0U;
+
+	for (size_t i = 0U; i < g->npats; i++) {
+		ntrie += g->pats[i].n <= TRIE_MAXN;
+		ntd += g->pats[i].n > TRIE_MAXN && g->pats[i].n <= TEDDY_MAXN;
+	}
+	if (ntrie) {
+		res += COST_TRIE + COST_TRIE_PAT * ntrie;
+	}
+	if (!ntd) {
+		return res;
+	}
+	for (size_t b = 0U; b < TEDDY_NB; b++) {
+		const size_t k = ntd * (b + 1U) / TEDDY_NB - ntd * b / TEDDY_NB;
+		double miss = 1, hit = 1;
+
+		for (size_t j = 0U; j < k; j++) {
+			miss *= (double)15U / 16U;
+		}
+		for (size_t j = 0U; j < TEDDY_K; j++) {
+			hit *= 1 - miss;
+		}
+		nhit += hit;
+	}
+	return res + COST_TEDDY + (size_t)(COST_TEDDY_HIT * nhit);
+}
+
 glepcc_t
 glep_simd_cc(glod_pats_t g)
 {
-/* rearrange patterns into 1grams, 2grams, 3,4grams, etc. */
+/* put characters of 1grams and 2grams into the alphabet and arrange
+ * them in a shared-prefix tree, fingerprint the 3 to 8grams */
+	struct glepcc_s *res;
+
+	if (UNLIKELY((res = calloc(1, sizeof(*res))) == NULL)) {
+		return NULL;
+	}
 	for (size_t i = 0U; i < g->npats; i++) {
 		const char *p = g->pats[i].p;
 		const size_t z = g->pats[i].n;
 		const bool ci = g->pats[i].fl.ci;
 
-		if (z > 4U) {
+		if (z > TRIE_MAXN) {
 			continue;
 		}
-		if (LIKELY(!ci)) {
-			switch (z) {
-			case 4U:
-				add_pchar(p[3U]);
-			case 3U:
-				add_pchar(p[2U]);
-			case 2U:
-				add_pchar(p[1U]);
-			case 1U:
-				add_pchar(p[0U]);
-			default:
-			case 0U:
-				break;
-			}
-		} else {
-			switch (z) {
-			case 4U:
-				if ((p[3U] | 0x20) >= 0x61 &&
-				    (p[3U] | 0x20) <= 0x7a) {
-					add_pchar(ucase(p[3U]));
-					add_pchar(lcase(p[3U]));
-				} else {
-					add_pchar(p[3U]);
-				}
-			case 3U:
-				if ((p[2U] | 0x20) >= 0x61 &&
-				    (p[2U] | 0x20) <= 0x7a) {
-					add_pchar(ucase(p[2U]));
-					add_pchar(lcase(p[2U]));
-				} else {
-					add_pchar(p[2U]);
-				}
-			case 2U:
-				if ((p[1U] | 0x20) >= 0x61 &&
-				    (p[1U] | 0x20) <= 0x7a) {
-					add_pchar(ucase(p[1U]));
-					add_pchar(lcase(p[1U]));
-				} else {
-					add_pchar(p[1U]);
-				}
-			case 1U:
-				if ((p[0U] | 0x20) >= 0x61 &&
-				    (p[0U] | 0x20) <= 0x7a) {
-					add_pchar(ucase(p[0U]));
-					add_pchar(lcase(p[0U]));
-				} else {
-					add_pchar(p[0U]);
-				}
-			default:
-			case 0U:
-				break;
+		for (size_t j = 0U; j < z; j++) {
+			if (LIKELY(!ci)) {
+				add_pchar(res, p[j]);
+			} else if ((p[j] | 0x20) >= 0x61 &&
+				   (p[j] | 0x20) <= 0x7a) {
+				add_pchar(res, ucase(p[j]));
+				add_pchar(res, lcase(p[j]));
+			} else {
+				add_pchar(res, p[j]);
 			}
 		}
 	}
 
+	if (UNLIKELY(build_trie(res, g) < 0)) {
+		glep_simd_fr(res);
+		return NULL;
+	} else if (UNLIKELY(build_teddy(res, g) < 0)) {
+		glep_simd_fr(res);
+		return NULL;
+	}
+
 	/* while we're at it, initialise our routines and intrinsics */
 	glep_simd_dispatch();
-	return deconst(g);
+	return res;
 }
 
 __attribute__((noinline)) int
-glep_simd_gr(gcnt_t *restrict cnt, glepcc_t g, const char *buf, size_t bsz)
+glep_simd_gr(gcnt_t *restrict cnt, ghits_t hits,
+	     glepcc_t g, const char *buf, size_t bsz)
 {
-	glod_pats_t pv = (const void*)g;
 	accu_t deco[0x100U][CHUNKZ / ACCU_BITS];
-	accu_t c[CHUNKZ / ACCU_BITS];
+	/* one bitmask per level of the tree */
+	accu_t lvl[MAX_DEPTH][CHUNKZ / ACCU_BITS];
+	size_t nmtch = 0U;
 	size_t nb;
+	/* phase timings, only taken with engine_stats_p */
+	uint64_t t[NPHASES] = {0U};
+	uint64_t t0 = 0U;
 
-	/* put bit patterns into puncs and pat */
-	nb = decomp(deco, (const void*)buf, bsz, pchars, npchars);
+	if (UNLIKELY(engine_stats_p)) {
+		t0 = glep_ns();
+	}
+	if (g->bkt[TEDDY_NB]) {
+		nmtch += teddy(cnt, hits, g, (const uint8_t*)buf, bsz);
+	}
+	if (!g->nnodes) {
+		/* no 1grams or 2grams */
+		goto out;
+	}
+	if (UNLIKELY(engine_stats_p)) {
+		const uint64_t now = glep_ns();
+		t[PHASE_TEDDY] = now - t0;
+		t0 = now;
+	}
 
-#if defined USE_CACHE
-	for (unsigned char i = '\1'; i < ' '; i++) {
-		offs[i] = 0U;
+	/* put bit patterns into puncs and pat */
+	nb = decomp(deco, (const void*)buf, bsz, g->pchars, g->npchars);
+	if (UNLIKELY(engine_stats_p)) {
+		const uint64_t now = glep_ns();
+		t[PHASE_DECOMP] = now - t0;
+		t0 = now;
 	}
-	ncchars = npchars;
-#endif	/* USE_CACHE */
 
-	for (size_t i = 0U; i < pv->npats; i++) {
-		uint8_t str[256U];
-		size_t len;
+	/* walk the tree, every prefix is evaluated once and its bitmask
+	 * is shared by all patterns below it */
+	for (size_t i = 0U; i < g->nnodes;) {
+		const struct dnode_s n = g->nodes[i];
 
-		/* match pattern */
-		len = recode(str, pv->pats[i]);
-		if (LIKELY(!pv->pats[i].fl.ci)) {
-			dmatch(c, deco, nb, str, len);
-		} else {
-			dmatchci(c, deco, nb, str, len);
+		if (!n.d) {
+			dfirst(*lvl, deco, nb, n);
+		} else if (!dnext(lvl[n.d], lvl[n.d - 1U], deco, nb, n)) {
+			/* no matches left, skip the whole subtree */
+			i = n.skip;
+			continue;
+		}
+		if (n.pbeg < n.pend) {
+			/* count the matches */
+			const uint64_t tc = UNLIKELY(engine_stats_p)
+				? glep_ns() : 0U;
+			const uint_fast32_t x = dcount(lvl[n.d], nb);
+
+			if (UNLIKELY(engine_stats_p)) {
+				t[PHASE_DCOUNT] += glep_ns() - tc;
+			}
+
+			for (size_t j = n.pbeg; j < n.pend; j++) {
+				cnt[g->pidx[j]] += x;
+			}
+			nmtch += x * (n.pend - n.pbeg);
+			if (UNLIKELY(hits != NULL) && x) {
+				dhits(hits, lvl[n.d], nb,
+				      g->pidx + n.pbeg, n.pend - n.pbeg);
+			}
 		}
+		i++;
+	}
+out:
+	if (UNLIKELY(engine_stats_p)) {
+		struct glepcc_s *pg = deconst(g);
+		const uint64_t now = glep_ns();
 
-		/* count the matches */
-		cnt[pv->pats[i].idx] += dcount(c, nb);
+		if (!g->nnodes) {
+			t[PHASE_TEDDY] = now - t0;
+		} else {
+			/* the tree walk minus counting is matching */
+			t[PHASE_DMATCH] = now - t0 - t[PHASE_DCOUNT];
+		}
+		for (size_t i = 0U; i < NPHASES; i++) {
+			__atomic_add_fetch(
+				pg->tsec + i, t[i], __ATOMIC_RELAXED);
+		}
 	}
-	return 0;
+	return nmtch;
 }
 
 void
-glep_simd_fr(glepcc_t UNUSED(g))
+glep_simd_fr(glepcc_t g)
 {
+	with (struct glepcc_s *pg = deconst(g)) {
+		if (UNLIKELY(pg == NULL)) {
+			break;
+		} else if (pg->mapped) {
+			free(pg);
+			break;
+		}
+		if (pg->nodes != NULL) {
+			free(pg->nodes);
+		}
+		if (pg->pidx != NULL) {
+			free(pg->pidx);
+		}
+		if (pg->tpats != NULL) {
+			free(pg->tpats);
+		}
+		free(pg);
+	}
 	return;
 }
 
+size_t
+glep_simd_wr(gdbw_t w, glepcc_t g)
+{
+	struct ccrec_s r = {
+		.npchars = g->npchars,
+		.nnodes = g->nnodes,
+	};
+
+	memcpy(r.pchars, g->pchars, sizeof(r.pchars));
+	memcpy(r.offs, g->offs, sizeof(r.offs));
+	memcpy(r.flo, g->flo, sizeof(r.flo));
+	memcpy(r.fhi, g->fhi, sizeof(r.fhi));
+	memcpy(r.bkt, g->bkt, sizeof(r.bkt));
+	/* the last pattern range tells us the size of PIDX */
+	for (size_t i = 0U; i < g->nnodes; i++) {
+		if (g->nodes[i].pend > r.npidx) {
+			r.npidx = g->nodes[i].pend;
+		}
+	}
+	r.nodes = gdbw_put(w, g->nodes, g->nnodes * sizeof(*g->nodes));
+	r.pidx = gdbw_put(w, g->pidx, r.npidx * sizeof(*g->pidx));
+	r.tpats = gdbw_put(w, g->tpats, r.bkt[TEDDY_NB] * sizeof(*g->tpats));
+	if (UNLIKELY(!r.nodes || !r.pidx || !r.tpats)) {
+		return 0U;
+	}
+	return gdbw_put(w, &r, sizeof(r));
+}
+
+glepcc_t
+glep_simd_rd(gdb_t d, size_t o)
+{
+	const struct ccrec_s *r;
+	struct glepcc_s *res;
+
+	if (UNLIKELY((r = gdb_get(d, o, sizeof(*r))) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY(r->npchars >= countof(r->pchars))) {
+		return NULL;
+	} else if (UNLIKELY((res = calloc(1, sizeof(*res))) == NULL)) {
+		return NULL;
+	}
+	memcpy(res->pchars, r->pchars, sizeof(res->pchars));
+	memcpy(res->offs, r->offs, sizeof(res->offs));
+	memcpy(res->flo, r->flo, sizeof(res->flo));
+	memcpy(res->fhi, r->fhi, sizeof(res->fhi));
+	memcpy(res->bkt, r->bkt, sizeof(res->bkt));
+	res->npchars = r->npchars;
+	res->nnodes = r->nnodes;
+	res->nodes = deconst(
+		gdb_get(d, r->nodes, r->nnodes * sizeof(*res->nodes)));
+	res->pidx = deconst(
+		gdb_get(d, r->pidx, r->npidx * sizeof(*res->pidx)));
+	res->tpats = deconst(
+		gdb_get(d, r->tpats, r->bkt[TEDDY_NB] * sizeof(*res->tpats)));
+	res->mapped = 1;
+	if (UNLIKELY(res->nodes == NULL || res->pidx == NULL ||
+		     res->tpats == NULL)) {
+		glep_simd_fr(res);
+		return NULL;
+	}
+
+	/* initialise our routines and intrinsics */
+	glep_simd_dispatch();
+	return res;
+}
+
 void
 glep_simd_dsptch_nfo(void)
 {
@@ -1103,6 +1813,20 @@ glep_simd_dsptch_nfo(void)
 		puts("decomp\troutin\thand-crafted");
 	}
 
+	if (0) {
+		;
+#if defined HAVE_TEDDY_INTRIN
+	} else if (teddy == _teddy512) {
+		puts("teddy\tintrin\tAVX512BW");
+	} else if (teddy == _teddy256) {
+		puts("teddy\tintrin\tAVX2");
+	} else if (teddy == _teddy128) {
+		puts("teddy\tintrin\tSSSE3");
+#endif	/* HAVE_TEDDY_INTRIN */
+	} else {
+		puts("teddy\troutin\thand-crafted");
+	}
+
 	if (0) {
 		;
 	} else if (has_cpu_feature_p(_FEAT_BMI1)) {
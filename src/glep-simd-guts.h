@@ -2,11 +2,19 @@
 #define INCLUDED_glep_simd_guts_h_
 
 #include "glep.h"
+#include "glep-db.h"
 
 extern glepcc_t glep_simd_cc(glod_pats_t);
-extern int glep_simd_gr(gcnt_t *restrict, glepcc_t, const char *b, size_t z);
+extern int glep_simd_gr(gcnt_t *restrict, ghits_t, glepcc_t, const char *b, size_t z);
 extern void glep_simd_fr(glepcc_t);
+extern size_t glep_simd_cost(glod_pats_t);
+
+extern size_t glep_simd_wr(gdbw_t, glepcc_t);
+extern glepcc_t glep_simd_rd(gdb_t, size_t o);
 
 extern void glep_simd_dsptch_nfo(void);
+extern int glep_simd_pin(const char *variant);
+extern uint64_t glep_simd_ncand(glepcc_t);
+extern void glep_simd_stats(glepcc_t);
 
 #endif	/* INCLUDED_glep_simd_guts_h_ */
@@ -39,14 +39,32 @@
 #endif	/* HAVE_CONFIG_H */
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <assert.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
 #include "glep.h"
 #include "wu-manber-guts.h"
 #include "glep-simd-guts.h"
+#include "aho-corasick-guts.h"
+#include "freundt-rabin-karp-guts.h"
+#include "glep-db.h"
 #include "pats.h"
 #include "nifty.h"
 #include "coru.h"
+#include "wsq.h"
+#include "unpack.h"
+#include "uring.h"
+#include "glep-index.h"
+#include "glep-cache.h"
+#include "glep-serve.h"
+#include "glep-out.h"
 
 /* lib stuff */
 typedef size_t idx_t;
@@ -57,6 +75,44 @@ typedef size_t idx_t;
 
 static const char stdin_fn[] = "<stdin>";
 
+/* minimum number of chunks per range when splitting files */
+#define SPLIT_MINZ	(64U)
+/* minimum number of patterns to hand all of them to Aho-Corasick */
+#define AC_MINPATS	(8192U)
+/* at most this many 3 to 8 byte patterns go to the fingerprint matcher,
+ * beyond that its buckets get crowded and Wu-Manber wins */
+#define TD_MAXPATS	(96U)
+/* the longest patterns the SIMD code can take */
+#define TD_MAXN		(8U)
+/* number of chunks of a mapped file to ask the kernel for in advance */
+#define RA_CHUNKS	(64U)
+/* how long idle workers doze off while others are walking directories */
+#define IDLE_NSEC	(100000L)
+/* capacity of the pipe between decompressor and matcher */
+#define UNPACK_PIPEZ	(1024U * 1024U)
+/* minimum number of patterns to keep track of the counters touched */
+#define TCH_MINPATS	(4096U)
+/* number of touched counters when we've lost track */
+#define NTCH_ALL	((size_t)-1)
+
+/* the planner's split: patterns of up to THRESH octets go to the SIMD
+ * code, the rest to Rabin-Karp if RK_P, to Wu-Manber otherwise */
+struct plan_s {
+	unsigned int thresh;
+	bool rk_p;
+	/** estimated cost per kilobyte of text */
+	size_t cost;
+};
+
+/* the engines, as indexed in the --stats counters */
+enum {
+	EST_SIMD,
+	EST_WM,
+	EST_RK,
+	EST_AC,
+	NENGINES
+};
+
 struct glepcc_s {
 	glod_pats_t orig;
 
@@ -65,9 +121,133 @@ struct glepcc_s {
 
 	glod_pats_t wu_manber;
 	glepcc_t wu_manber_cc;
+
+	glod_pats_t rabin_karp;
+	glepcc_t rabin_karp_cc;
+
+	glepcc_t aho_corasick_cc;
+
+	/* how the patterns were split among the engines */
+	struct plan_s plan;
+
+	/* the database we've been loaded from, if any */
+	gdb_t db;
+
+	/* what each engine did, for --stats */
+	struct estat_s {
+		uint64_t ncall;
+		uint64_t nbyte;
+		uint64_t nsec;
+		uint64_t nmtch;
+	} est[NENGINES];
+};
+
+/* root record of compiled pattern databases */
+struct gdbroot_s {
+	/** obarrays, offset and size */
+	uint64_t oa_pat;
+	uint64_t oa_patz;
+	uint64_t oa_yld;
+	uint64_t oa_yldz;
+	/** the original patterns, as array of struct gdbpat_s */
+	uint64_t npats;
+	uint64_t pats;
+	/** engine records, or 0 if not used */
+	uint64_t glep_simd;
+	uint64_t wu_manber;
+	uint64_t aho_corasick;
+	/** indices of the patterns handed to Wu-Manber */
+	uint64_t nwu_manber;
+	uint64_t wu_manber_pidx;
+	uint64_t rabin_karp;
+	/** indices of the patterns handed to Rabin-Karp */
+	uint64_t nrabin_karp;
+	uint64_t rabin_karp_pidx;
+};
+
+struct gdbpat_s {
+	uint32_t fl;
+	uint32_t n;
+	uint32_t y;
+};
+
+/* counters, one per pattern, with large pattern sets we also note
+ * down which ones have been touched, so that rinsing and reporting
+ * costs O(hits) rather than O(npats) per file */
+struct gcnts_s {
+	gcnt_t *cnt;
+	size_t npats;
+	/* touched counters, I | (report position of I) << 32,
+	 * or NULL if we sweep all counters */
+	uint64_t *tch;
+	size_t ntch;
+	/* whether counter I is in TCH */
+	uint8_t *tchp;
+	/* for yields the report position of their first pattern */
+	uint32_t *ylead;
+	/* hit buffer to learn the touched counters from */
+	struct ghits_s hb;
+};
+
+/* state of the scan of one file, or of one range of it */
+struct gscan_s {
+	glepcc_t cc;
+	struct gcnts_s *c;
+	/* hit buffer, or NULL if we don't report offsets */
+	ghits_t hits;
+	const char *fn;
+	/* file offset of the buffer and the number of lines before it */
+	size_t off;
+	size_t nl;
+	/* total number of matches, possibly shared with other rangers */
+	size_t *nmtch;
+	/* number of matches reported, at most max_count */
+	size_t nrep;
+	/* with records, the current record's number, its file offset
+	 * and its matches, and how far into the buffer we've looked
+	 * for record separators */
+	size_t rno;
+	size_t roff;
+	size_t rmtch;
+	size_t rp;
 };
 
 bool non_ascii_wordsep_p = false;
+bool engine_stats_p = false;
+struct gpst_s *pat_stats = NULL;
+
+/* hot path counters, only kept with engine_stats_p */
+static struct {
+	uint64_t nread;
+	uint64_t nswtch;
+	/* files reported off the --cache, and files scanned despite it */
+	uint64_t nchit;
+	uint64_t ncmiss;
+} hstat;
+
+static size_t scan1(struct gscan_s *s, const char *buf, size_t nrd);
+
+static inline ssize_t
+gread(int fd, void *buf, size_t bsz)
+{
+	if (UNLIKELY(engine_stats_p)) {
+		__atomic_add_fetch(&hstat.nread, 1U, __ATOMIC_RELAXED);
+	}
+	return read(fd, buf, bsz);
+}
+
+static inline ssize_t
+gpread(int fd, void *buf, size_t bsz, off_t off)
+{
+	if (UNLIKELY(engine_stats_p)) {
+		__atomic_add_fetch(&hstat.nread, 1U, __ATOMIC_RELAXED);
+	}
+	return pread(fd, buf, bsz, off);
+}
+static int match_unpack(
+	struct gcnts_s *c, glepcc_t cc, int fd, const char *fn,
+	unpack_fmt_t fmt, const char *pre, size_t prez);
+static unpack_fmt_t sniff(const char *buf, size_t z);
 
 
 /* our coroutines */
@@ -75,6 +255,8 @@ DEFCORU(co_snarf, {
 		char *buf;
 		size_t bsz;
 		int fd;
+		/* octets in BUF read by someone else already */
+		size_t nun;
 	}, void *UNUSED(arg))
 {
 	/* upon the first call we expect a completely processed buffer
@@ -84,13 +266,13 @@ DEFCORU(co_snarf, {
 	const int fd = CORU_CLOSUR(fd);
 	ssize_t npr;
 	ssize_t nrd;
-	size_t nun = 0U;
+	size_t nun = CORU_CLOSUR(nun);
 
 	/* leave some good advice about our access pattern */
 	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
 	/* enter the main snarf loop */
-	while ((nrd = read(fd, buf + nun, bsz - nun)) > 0) {
+	while ((nrd = gread(fd, buf + nun, bsz - nun)) > 0) {
 		/* we've got NRD more unprocessed bytes */
 		nun += nrd;
 		/* insist on filling the buffer */
@@ -117,16 +299,14 @@ DEFCORU(co_snarf, {
 DEFCORU(co_match, {
 		char *buf;
 		size_t bsz;
-		/* counter */
-		gcnt_t *cnt;
-		glepcc_t cc;
+		/* counters and the like */
+		struct gscan_s *s;
 	}, void *arg)
 {
 	/* upon the first call we expect a completely filled buffer
 	 * just to determine the buffer's size */
 	char *const buf = CORU_CLOSUR(buf);
-	gcnt_t *const cnt = CORU_CLOSUR(cnt);
-	const glepcc_t cc = CORU_CLOSUR(cc);
+	struct gscan_s *const s = CORU_CLOSUR(s);
 	size_t nrd = (intptr_t)arg;
 	ssize_t npr;
 
@@ -137,12 +317,7 @@ DEFCORU(co_match, {
 	/* enter the main match loop */
 	do {
 		/* ... then grep, ... */
-		glep_gr(cnt, cc, buf, nrd);
-
-		/* our contract with the guts matchers is to use up
-		 * CHUNKZ - MWNDWZ bytes if nrd was CHUNKZ, and
-		 * everything otherwise */
-		npr = nrd < CHUNKZ ? nrd : CHUNKZ - MWNDWZ;
+		npr = scan1(s, buf, nrd);
 	} while ((nrd = YIELD(npr)) > 0U);
 	return 0;
 }
@@ -156,13 +331,57 @@ DEFCORU(co_match, {
 static int invert_match_p;
 static int show_pats_p;
 static int show_count_p;
-static unsigned int thresh = 2U;
+/* engine choice, --engine */
+static enum {
+	ENGINE_AUTO,
+	ENGINE_SIMD,
+	ENGINE_WM,
+	ENGINE_RK,
+} engine;
+static size_t njobs = 1U;
+/* files opened and read ahead of each scanner, --io-depth */
+static size_t io_depth = 32U;
+/* --stats and --stats-patterns */
+static int stats_p;
+static size_t stats_npats;
+static int split_p;
+static int list_p;
+static int quiet_p;
+static int offset_p;
+static int lineno_p;
+/* look into compressed input, --no-decompress */
+static int unpack_p = 1;
+/* --format */
+static enum {
+	FMT_TSV,
+	FMT_JSONL,
+	FMT_BIN,
+} out_fmt;
+/* descend into directories, -r, and the globs to filter their files */
+static int recursive_p;
+static char *const *includes;
+static size_t nincludes;
+static char *const *excludes;
+static size_t nexcludes;
+static char *const *exclude_dirs;
+static size_t nexclude_dirs;
+/* stop scanning a file after this many matches, 0 for never */
+static size_t max_count;
+/* record separator, or -1 if files are the unit */
+static int rsep = -1;
+/* whether anything matched at all, for -q */
+static int found_p;
+/* results of earlier runs, --cache */
+static gcache_t cache;
 
 static void
 __attribute__((format(printf, 1, 2)))
 error(const char *fmt, ...)
 {
 	va_list vap;
+
+	/* keep messages from concurrent workers in one piece */
+	flockfile(stderr);
 	va_start(vap, fmt);
 	vfprintf(stderr, fmt, vap);
 	va_end(vap);
@@ -171,40 +390,217 @@ error(const char *fmt, ...)
 		fputs(strerror(errno), stderr);
 	}
 	fputc('\n', stderr);
+	funlockfile(stderr);
 	return;
 }
 
 
-static int
-__lenle4(glod_pat_t p)
+static inline bool
+short_p(glod_pat_t p, unsigned int thresh)
 {
+/* whether P goes to the SIMD code with the planner's THRESH */
 	return p.n <= thresh;
 }
 
 static int
-__lengt4(glod_pat_t p)
+make_gcnts(struct gcnts_s *restrict c, glepcc_t cc)
+{
+	const size_t npats = cc->orig->npats;
+	const size_t nyld = ninterns(cc->orig->oa_yld);
+
+	*c = (struct gcnts_s){.npats = npats};
+	if (UNLIKELY((c->cnt = calloc(npats, sizeof(*c->cnt))) == NULL)) {
+		return -1;
+	} else if (npats < TCH_MINPATS && rsep < 0) {
+		/* sweeping is cheap enough, unless there's lots of records */
+		return 0;
+	}
+	c->tch = malloc(npats * sizeof(*c->tch));
+	c->tchp = calloc(npats, sizeof(*c->tchp));
+	c->ylead = nyld && !show_pats_p ? malloc(nyld * sizeof(*c->ylead)) : NULL;
+	if (UNLIKELY(c->tch == NULL || c->tchp == NULL ||
+		     (nyld && !show_pats_p && c->ylead == NULL))) {
+		/* just sweep then */
+		free(c->tch);
+		free(c->tchp);
+		free(c->ylead);
+		c->tch = NULL;
+		c->tchp = NULL;
+		c->ylead = NULL;
+		return 0;
+	}
+	for (size_t i = npats; c->ylead != NULL && i-- > 0U;) {
+		const obint_t yldi = cc->orig->pats[i].y;
+
+		if (yldi) {
+			c->ylead[yldi - 1U] = (uint32_t)i;
+		}
+	}
+	return 0;
+}
+
+static void
+free_gcnts(struct gcnts_s *c)
+{
+	free(c->cnt);
+	free(c->tch);
+	free(c->tchp);
+	free(c->ylead);
+	free(c->hb.h);
+	return;
+}
+
+static void
+rinse(struct gcnts_s *c)
+{
+	if (c->tch == NULL || c->ntch == NTCH_ALL) {
+		memset(c->cnt, 0, c->npats * sizeof(*c->cnt));
+		if (c->tch != NULL) {
+			memset(c->tchp, 0, c->npats * sizeof(*c->tchp));
+		}
+	} else {
+		for (size_t k = 0U; k < c->ntch; k++) {
+			const uint32_t i = (uint32_t)c->tch[k];
+
+			c->cnt[i] = 0U;
+			c->tchp[i] = 0U;
+		}
+	}
+	c->ntch = 0U;
+	return;
+}
+
+static inline void
+touch1(struct gcnts_s *c, glepcc_t cc, uint32_t i)
+{
+	obint_t yldi;
+	uint64_t at = i;
+
+	if (c->ntch == NTCH_ALL || c->tchp[i]) {
+		return;
+	} else if (c->ylead != NULL && (yldi = cc->orig->pats[i].y)) {
+		at = c->ylead[yldi - 1U];
+	}
+	c->tchp[i] = 1U;
+	c->tch[c->ntch++] = at << 32U | i;
+	return;
+}
+
+static void
+touch(struct gcnts_s *c, glepcc_t cc, const struct ghits_s *h, size_t nmtch)
+{
+/* note down the counters behind the NMTCH hits in H */
+	if (c->ntch == NTCH_ALL) {
+		return;
+	} else if (UNLIKELY(h->n != nmtch)) {
+		/* hits have been dropped, we've lost track */
+		c->ntch = NTCH_ALL;
+		return;
+	}
+	for (size_t j = 0U; j < h->n; j++) {
+		touch1(c, cc, h->h[j].idx);
+	}
+	return;
+}
+
+static int
+u64_cmp(const void *x, const void *y)
+{
+	const uint64_t *ux = x;
+	const uint64_t *uy = y;
+
+	return (*ux > *uy) - (*ux < *uy);
+}
+
+
+/* reports, everything goes through the bulk output of glep-out.c */
+static void
+pr_fn(const char *fn, size_t rno)
+{
+/* report FN, or record RNO of FN if RNO is non-0, on its own */
+	switch (out_fmt) {
+	case FMT_TSV:
+		out_str(fn);
+		if (rno) {
+			out_chr('\t');
+			out_ulong(rno);
+		}
+		out_chr('\n');
+		break;
+	case FMT_JSONL:
+		out_str("{\"file\":");
+		out_json(fn);
+		if (rno) {
+			out_str(",\"record\":");
+			out_ulong(rno);
+		}
+		out_str("}\n");
+		break;
+	case FMT_BIN:
+		out_bin(UINT32_MAX, 0U, fn, rno);
+		break;
+	}
+	return;
+}
+
+static void
+pr_count(const char *rs, size_t pidx, size_t cnt, const char *fn, size_t rno)
 {
-	return p.n > thresh;
+/* report CNT matches of RS, i.e. pattern PIDX, in FN or its record RNO */
+	switch (out_fmt) {
+	case FMT_TSV:
+		out_str(rs);
+		out_chr('\t');
+		if (show_count_p) {
+			out_ulong(cnt);
+			out_chr('\t');
+		}
+		pr_fn(fn, rno);
+		break;
+	case FMT_JSONL:
+		out_str("{\"file\":");
+		out_json(fn);
+		if (rno) {
+			out_str(",\"record\":");
+			out_ulong(rno);
+		}
+		out_str(",\"pattern\":");
+		out_json(rs);
+		out_str(",\"count\":");
+		out_ulong(cnt);
+		out_str("}\n");
+		break;
+	case FMT_BIN:
+		out_bin((uint32_t)pidx, cnt, fn, rno);
+		break;
+	}
+	return;
 }
 
 static void
-pr_results(glepcc_t cc, const gcnt_t *cnt, const char *fn)
+pr_results(glepcc_t cc, struct gcnts_s *c, const char *fn, size_t rno)
 {
+	const gcnt_t *cnt = c->cnt;
+	/* counters to go through in report order, all if ORD is NULL */
+	const uint64_t *ord = NULL;
+	size_t n = cc->orig->npats;
 	size_t nmtch = 0U;
 
+	if (c->tch != NULL && c->ntch != NTCH_ALL) {
+		qsort(c->tch, c->ntch, sizeof(*c->tch), u64_cmp);
+		ord = c->tch;
+		n = c->ntch;
+	}
+
 	if (show_pats_p) {
-		for (size_t i = 0U; i < cc->orig->npats; i++) {
+		for (size_t k = 0U; k < n; k++) {
+			const size_t i = ord != NULL ? (uint32_t)ord[k] : k;
+
 			if (!cnt[i]) {
 				continue;
 			}
 			/* otherwise do the printing work */
-			fputs(cc->orig->pats[i].p, stdout);
-			if (!show_count_p) {
-				putchar('\t');
-			} else {
-				printf("\t%lu\t", cnt[i]);
-			}
-			puts(fn);
+			pr_count(cc->orig->pats[i].p, i, cnt[i], fn, rno);
 			nmtch++;
 		}
 	} else {
@@ -216,8 +612,18 @@ pr_results(glepcc_t cc, const gcnt_t *cnt, const char *fn)
 			return;
 		}
 
-		memset(clscnt, 0, sizeof(clscnt));
-		for (size_t i = 0U; i < cc->orig->npats; i++) {
+		if (ord == NULL) {
+			memset(clscnt, 0, sizeof(clscnt));
+		}
+		for (size_t k = 0U; ord != NULL && k < n; k++) {
+			const obint_t yldi = cc->orig->pats[(uint32_t)ord[k]].y;
+
+			if (yldi) {
+				clscnt[yldi - 1U] = 0U;
+			}
+		}
+		for (size_t k = 0U; k < n; k++) {
+			const size_t i = ord != NULL ? (uint32_t)ord[k] : k;
 			obint_t yldi;
 
 			if (!cnt[i]) {
@@ -227,10 +633,12 @@ pr_results(glepcc_t cc, const gcnt_t *cnt, const char *fn)
 			}
 			clscnt[yldi - 1U] += cnt[i];
 		}
-		for (size_t i = 0U; i < cc->orig->npats; i++) {
+		for (size_t k = 0U; k < n; k++) {
+			const size_t i = ord != NULL ? (uint32_t)ord[k] : k;
 			obint_t yldi;
 			const char *rs;
 			uint_fast32_t rc;
+			size_t pidx = i;
 
 			if (UNLIKELY(!(yldi = cc->orig->pats[i].y))) {
 				rc = cnt[i];
@@ -240,6 +648,10 @@ pr_results(glepcc_t cc, const gcnt_t *cnt, const char *fn)
 				rs = obint_name(cc->orig->oa_yld, yldi);
 				/* reset the counter */
 				clscnt[yldi - 1U] = 0U;
+				/* sweeps meet the yield's first pattern first */
+				if (c->ylead != NULL) {
+					pidx = c->ylead[yldi - 1U];
+				}
 			}
 
 			if (!rc) {
@@ -247,49 +659,340 @@ pr_results(glepcc_t cc, const gcnt_t *cnt, const char *fn)
 				continue;
 			}
 			/* otherwise do the printing work */
-			fputs(rs, stdout);
-			if (!show_count_p) {
-				putchar('\t');
-			} else {
-				printf("\t%lu\t", rc);
-			}
-			puts(fn);
+			pr_count(rs, pidx, rc, fn, rno);
 			nmtch++;
 		}
 	}
 	if (invert_match_p && !nmtch) {
-		puts(fn);
+		pr_fn(fn, rno);
+	}
+	return;
+}
+
+static inline bool
+enough_p(size_t nmtch)
+{
+	return max_count && nmtch >= max_count;
+}
+
+static inline bool
+hits_p(void)
+{
+/* whether matches are needed one by one, for offsets and line numbers,
+ * for records, or to cut the counts off after -m's N matches */
+	return offset_p || lineno_p || rsep >= 0 ||
+		(max_count && !list_p && !quiet_p);
+}
+
+static bool
+quit_p(void)
+{
+/* with -q there's no point in scanning anything after the first match */
+	return quiet_p && __atomic_load_n(&found_p, __ATOMIC_RELAXED);
+}
+
+static void
+pr_file(glepcc_t cc, struct gcnts_s *c, const char *fn, size_t rno,
+	size_t nmtch)
+{
+/* report the NMTCH matches in FN, or its record RNO if non-0 */
+	if (nmtch) {
+		__atomic_store_n(&found_p, 1, __ATOMIC_RELAXED);
+	}
+	with (struct gcap_s *k = out_captured()) {
+		if (nmtch && k != NULL) {
+			k->found_p = true;
+		}
+	}
+	if (quiet_p) {
+		return;
 	}
+	/* lock the output so results of concurrent workers don't interleave */
+	out_lock();
+	if (list_p) {
+		if ((nmtch > 0U) != invert_match_p) {
+			pr_fn(fn, rno);
+		}
+	} else if (offset_p || lineno_p) {
+		/* matches have been reported as they came */
+		if (invert_match_p && !nmtch) {
+			pr_fn(fn, rno);
+		}
+	} else {
+		pr_results(cc, c, fn, rno);
+	}
+	out_unlock();
+	return;
+}
+
+static const char*
+pr_name(glepcc_t cc, size_t i)
+{
+/* the string to report for pattern I, see pr_results() */
+	obint_t yldi;
+
+	if (show_pats_p || !(yldi = cc->orig->pats[i].y)) {
+		return cc->orig->pats[i].p;
+	}
+	return obint_name(cc->orig->oa_yld, yldi);
+}
+
+static size_t
+count_nl(const char *bp, const char *ep)
+{
+	size_t n = 0U;
+
+	for (; (bp = memchr(bp, '\n', ep - bp)) != NULL; bp++, n++);
+	return n;
+}
+
+static void
+pr_hit(const char *rs, const char *fn, size_t rno, size_t lno, size_t off)
+{
+/* report a match of RS in FN, or record RNO of it if non-0, at line LNO
+ * and offset OFF, either as requested */
+	switch (out_fmt) {
+	case FMT_TSV:
+		out_str(rs);
+		out_chr('\t');
+		out_str(fn);
+		if (rno) {
+			out_chr('\t');
+			out_ulong(rno);
+		}
+		if (lineno_p) {
+			out_chr('\t');
+			out_ulong(lno);
+		}
+		if (offset_p) {
+			out_chr('\t');
+			out_ulong(off);
+		}
+		out_chr('\n');
+		break;
+	case FMT_JSONL:
+		out_str("{\"file\":");
+		out_json(fn);
+		if (rno) {
+			out_str(",\"record\":");
+			out_ulong(rno);
+		}
+		out_str(",\"pattern\":");
+		out_json(rs);
+		if (lineno_p) {
+			out_str(",\"line\":");
+			out_ulong(lno);
+		}
+		if (offset_p) {
+			out_str(",\"offset\":");
+			out_ulong(off);
+		}
+		out_str("}\n");
+		break;
+	case FMT_BIN:
+		/* refused by main() */
+		break;
+	}
+	return;
+}
+
+static int
+hit_cmp(const void *x, const void *y)
+{
+	const struct ghit_s *hx = x;
+	const struct ghit_s *hy = y;
+
+	if (hx->off != hy->off) {
+		return (hx->off > hy->off) - (hx->off < hy->off);
+	}
+	return (hx->idx > hy->idx) - (hx->idx < hy->idx);
+}
+
+static void
+pr_rec(struct gscan_s *s)
+{
+/* report the current record and start afresh */
+	pr_file(s->cc, s->c, s->fn, s->rno + 1U, s->rmtch);
+	rinse(s->c);
+	s->rmtch = 0U;
+	return;
+}
+
+static void
+pr_recs(struct gscan_s *s, const char *buf, size_t till)
+{
+/* report the records ending in BUF before offset TILL */
+	const char *bp = buf + s->rp;
+	const char *const ep = buf + till;
+
+	for (const char *sp;
+	     bp < ep && (sp = memchr(bp, rsep, ep - bp)) != NULL; bp = sp + 1) {
+		pr_rec(s);
+		s->rno++;
+		s->roff = s->off + (sp + 1 - buf);
+	}
+	s->rp = till;
+	return;
+}
+
+static void
+pr_end(struct gscan_s *s)
+{
+/* report what's left after the scan */
+	if (rsep < 0) {
+		pr_file(s->cc, s->c, s->fn, 0U, *s->nmtch);
+	} else if (s->off > s->roff) {
+		/* the final record lacks its separator */
+		pr_rec(s);
+	}
+	return;
+}
+
+static void
+pr_hits(struct gscan_s *s, const char *buf, size_t npr)
+{
+/* report the hits collected in S's hit buffer in file order and
+ * advance the line count by the NPR bytes used up of BUF,
+ * with records hand the hits out to the records they're in */
+	struct ghit_s *const h = s->hits->h;
+	const size_t nh = s->hits->n;
+	const bool pr_p = (offset_p || lineno_p) &&
+		!quiet_p && !list_p && !invert_match_p;
+	const char *lp = buf;
+
+	if (nh > 1U) {
+		qsort(h, nh, sizeof(*h), hit_cmp);
+	}
+	if (rsep >= 0) {
+		/* the engines counted the whole chunk, the counters get
+		 * the hits back record by record */
+		for (size_t i = 0U; i < nh; i++) {
+			s->c->cnt[h[i].idx]--;
+		}
+		s->rp = 0U;
+	}
+	if (nh && pr_p) {
+		out_lock();
+	}
+	for (size_t i = 0U; i < nh; i++) {
+		if (UNLIKELY(enough_p(s->nrep))) {
+			/* the engines scan whole chunks, matches past
+			 * -m's limit are handed back */
+			if (rsep < 0) {
+				s->c->cnt[h[i].idx]--;
+			}
+			continue;
+		} else if (rsep >= 0) {
+			pr_recs(s, buf, h[i].off);
+			s->c->cnt[h[i].idx]++;
+			if (s->c->tch != NULL) {
+				touch1(s->c, s->cc, h[i].idx);
+			}
+			s->rmtch++;
+		}
+		if (pr_p) {
+			if (lineno_p) {
+				s->nl += count_nl(lp, buf + h[i].off);
+				lp = buf + h[i].off;
+			}
+			pr_hit(pr_name(s->cc, h[i].idx), s->fn,
+			       rsep >= 0 ? s->rno + 1U : 0U,
+			       s->nl + 1U, s->off + h[i].off);
+		}
+		s->nrep++;
+	}
+	if (nh && pr_p) {
+		out_unlock();
+	}
+	if (rsep >= 0) {
+		pr_recs(s, buf, npr);
+	}
+	if (lineno_p) {
+		s->nl += count_nl(lp, buf + npr);
+	}
+	s->hits->n = 0U;
 	return;
 }
 
+static size_t
+scan1(struct gscan_s *s, const char *buf, size_t nrd)
+{
+/* grep the NRD bytes of BUF at file offset S->OFF,
+ * return the number of bytes used up */
+	/* our contract with the guts matchers is to use up
+	 * CHUNKZ - MWNDWZ bytes if nrd was CHUNKZ, and
+	 * everything otherwise */
+	const size_t npr = nrd < CHUNKZ ? nrd : CHUNKZ - MWNDWZ;
+	/* the touched counters are learnt from the hits */
+	ghits_t hits = s->hits == NULL &&
+		(s->c->tch != NULL || UNLIKELY(pat_stats != NULL))
+		? &s->c->hb : s->hits;
+	size_t n;
+
+	if ((n = glep_gr(s->c->cnt, hits, s->cc, buf, nrd))) {
+		__atomic_add_fetch(s->nmtch, n, __ATOMIC_RELAXED);
+	}
+	if (UNLIKELY(pat_stats != NULL)) {
+		for (size_t k = 0U; k < hits->n; k++) {
+			__atomic_add_fetch(
+				&pat_stats[hits->h[k].idx].nmtch, 1U,
+				__ATOMIC_RELAXED);
+		}
+	}
+	if (s->c->tch != NULL) {
+		touch(s->c, s->cc, hits, n);
+	}
+	if (s->hits != NULL) {
+		pr_hits(s, buf, npr);
+	} else if (hits != NULL) {
+		hits->n = 0U;
+	}
+	s->off += npr;
+	return npr;
+}
+
 static int
-match0(glepcc_t cc, int fd, const char *fn)
+match_read(struct gcnts_s *c, glepcc_t cc, int fd, const char *fn)
 {
 	char buf[CHUNKZ];
 	struct cocore *snarf;
 	struct cocore *match;
 	struct cocore *self;
+	size_t nmtch = 0U;
+	struct ghits_s hb = {0U};
+	struct gscan_s s = {
+		.cc = cc, .c = c, .fn = fn, .nmtch = &nmtch,
+		.hits = hits_p() ? &hb : NULL,
+	};
 	int res = 0;
 	ssize_t nrd;
 	ssize_t npr;
-	gcnt_t cnt[cc->orig->npats];
+	size_t nun = 0U;
 
-	if (UNLIKELY(cnt == NULL)) {
-		/* return early on */
-		return -1;
+	if (unpack_p) {
+		/* sniff the first couple of octets for compression */
+		for (ssize_t n;
+		     nun < UNPACK_MAGICZ &&
+			     (n = gread(fd, buf + nun, UNPACK_MAGICZ - nun)) > 0;
+		     nun += n);
+		with (unpack_fmt_t fmt = sniff(buf, nun)) {
+			if (fmt != UNPACK_NONE) {
+				return match_unpack(
+					c, cc, fd, fn, fmt, buf, nun);
+			}
+		}
 	}
 
 	self = PREP();
 	snarf = START_PACK(
 		co_snarf, .next = self, .clo = {
-			.buf = buf, .bsz = sizeof(buf), .fd = fd});
+			.buf = buf, .bsz = sizeof(buf), .fd = fd,
+			.nun = nun});
 	match = START_PACK(
 		co_match, .next = self, .clo = {
-			.buf = buf, .bsz = sizeof(buf), .cnt = cnt, .cc = cc});
+			.buf = buf, .bsz = sizeof(buf), .s = &s});
 
-	/* rinse */
-	memset(cnt, 0, sizeof(cnt));
+	rinse(c);
 
 	/* assume a nicely processed buffer to indicate its size to
 	 * the reader coroutine */
@@ -308,69 +1011,1459 @@ match0(glepcc_t cc, int fd, const char *fn)
 			res = -1;
 			break;
 		}
+		if (UNLIKELY(engine_stats_p)) {
+			/* into and out of either coroutine */
+			__atomic_add_fetch(&hstat.nswtch, 4U, __ATOMIC_RELAXED);
+		}
 
 		assert(npr <= nrd);
-	} while (nrd > 0);
+		/* with enough matches we simply stop asking for input */
+	} while (nrd > 0 && !enough_p(nmtch));
 
 	/* just print all them results now */
-	pr_results(cc, cnt, fn);
+	pr_end(&s);
+	free(hb.h);
 
 	UNPREP();
 	return res;
 }
 
-glepcc_t
-glep_cc(glod_pats_t g)
+
+/* pipelined decompression */
+struct glepu_s {
+	pthread_t thr;
+	int fd;
+	/* writing end of the pipe to the matcher */
+	int ofd;
+	unpack_fmt_t fmt;
+	/* octets of FD read already */
+	const char *pre;
+	size_t prez;
+	int rc;
+	/* errno of the failure, it's thread-local */
+	int err;
+};
+
+static unpack_fmt_t
+sniff(const char *buf, size_t z)
 {
-/* compile patterns in G, i.e. preprocessing phase for the SIMD code
- * or Wu-Manber */
-	struct glepcc_s *res = malloc(sizeof(*res));
+/* like unpack_sniff() but warn, once, about compressed input this
+ * build can't decompress, such input is scanned as is */
+	static int warned_p;
+	const unpack_fmt_t fmt = unpack_sniff(buf, z);
+	const char *nm;
 
-	if (UNLIKELY(res == NULL)) {
-		return NULL;
+	if (LIKELY(fmt != UNPACK_NONE) ||
+	    LIKELY((nm = unpack_unsupp(buf, z)) == NULL)) {
+		return fmt;
+	} else if (!__atomic_exchange_n(&warned_p, 1, __ATOMIC_RELAXED)) {
+		errno = 0;
+		error("Warning: no %s support built in, "
+		      "scanning %s input as is", nm, nm);
 	}
+	return UNPACK_NONE;
+}
 
-	if ((res->glep_simd = glod_pats_filter(g, __lenle4)) != NULL) {
-		res->glep_simd_cc = glep_simd_cc(res->glep_simd);
-	} else {
-		res->glep_simd_cc = NULL;
-	}
+static void*
+glep_unpacker(void *arg)
+{
+	struct glepu_s *u = arg;
+	sigset_t ss;
 
-	if ((res->wu_manber = glod_pats_filter(g, __lengt4)) != NULL) {
-		res->wu_manber_cc = wu_manber_cc(res->wu_manber);
-	} else {
-		res->wu_manber_cc = NULL;
-	}
+	/* a matcher that's had enough closes its end of the pipe, have
+	 * that show up as EPIPE rather than as signal */
+	sigemptyset(&ss);
+	sigaddset(&ss, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &ss, NULL);
 
-	res->orig = g;
-	return res;
+	if (unpack_fd(u->ofd, u->fd, u->fmt, u->pre, u->prez) < 0 &&
+	    errno != EPIPE) {
+		u->rc = -1;
+		u->err = errno;
+	}
+	close(u->ofd);
+	return NULL;
 }
 
-int
-glep_gr(gcnt_t *restrict cnt, glepcc_t c, const char *buf, size_t bsz)
+static int
+match_unpack(struct gcnts_s *c, glepcc_t cc, int fd, const char *fn,
+	     unpack_fmt_t fmt, const char *pre, size_t prez)
 {
-	if (LIKELY(c->glep_simd_cc != NULL)) {
-		glep_simd_gr(cnt, c->glep_simd_cc, buf, bsz);
+/* decompress FD in a thread of its own and match the output as it
+ * comes through a pipe, this way the two stages run side by side and
+ * the slower one sets the pace */
+	struct glepu_s u = {.fd = fd, .fmt = fmt, .pre = pre, .prez = prez};
+	int p[2U];
+	int rc;
+
+	if (UNLIKELY(pipe(p) < 0)) {
+		return -1;
 	}
-	if (LIKELY(c->wu_manber_cc != NULL)) {
-		wu_manber_gr(cnt, c->wu_manber_cc, buf, bsz);
+#if defined F_SETPIPE_SZ
+	/* a roomier pipe evens out the pace of the stages */
+	fcntl(p[1U], F_SETPIPE_SZ, UNPACK_PIPEZ);
+#endif	/* F_SETPIPE_SZ */
+	u.ofd = p[1U];
+	if (UNLIKELY(pthread_create(&u.thr, NULL, glep_unpacker, &u))) {
+		close(p[0U]);
+		close(p[1U]);
+		return -1;
+	}
+	rc = match_read(c, cc, p[0U], fn);
+	/* unblock the unpacker should we have stopped early */
+	close(p[0U]);
+	pthread_join(u.thr, NULL);
+	if (rc < 0) {
+		return -1;
+	} else if (u.rc < 0) {
+		/* the unpacker's errno */
+		errno = u.err;
+		return -1;
 	}
 	return 0;
 }
 
-void
-glep_fr(glepcc_t g)
+static unpack_fmt_t
+sniff_fd(int fd)
 {
-	if (UNLIKELY(g == NULL)) {
-		return;
+/* determine the compression format of FD, if it's a regular file,
+ * without moving its offset */
+	char m[UNPACK_MAGICZ];
+	ssize_t n;
+
+	if (!unpack_p || (n = gpread(fd, m, sizeof(m), 0)) <= 0) {
+		return UNPACK_NONE;
 	}
-	if (g->wu_manber_cc != NULL) {
-		wu_manber_fr(g->wu_manber_cc);
+	return sniff(m, n);
+}
+
+
+/* zero-copy input for regular files */
+static size_t
+nchunks(size_t fz)
+{
+/* number of chunks co_snarf() would present for FZ bytes of input,
+ * chunk I > 0 exists iff chunk I - 1 was a full one */
+	return fz > MWNDWZ
+		? 1U + (fz - MWNDWZ) / (CHUNKZ - MWNDWZ)
+		: fz > 0U;
+}
+
+static glodf_t
+mmap_reg(int fd, size_t fz)
+{
+/* map FZ bytes of FD and have at least one page of zeroes follow them,
+ * the guts matchers are used to peeking past the end of their buffer
+ * and for the final chunk that would be past the end of the file */
+	const size_t pgz = sysconf(_SC_PAGESIZE);
+	const size_t mz = ((fz + pgz - 1U) / pgz + 1U) * pgz;
+	void *p;
+
+	if (UNLIKELY(!fz)) {
+		return (glodf_t){.z = 0U, .d = NULL};
 	}
-	if (g->glep_simd_cc != NULL) {
-		glep_simd_fr(g->glep_simd_cc);
+	p = mmap(NULL, mz, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (UNLIKELY(p == MAP_FAILED)) {
+		return (glodf_t){.z = 0U, .d = NULL};
+	} else if (UNLIKELY(mmap(p, fz, PROT_READ, MAP_PRIVATE | MAP_FIXED,
+				 fd, 0) == MAP_FAILED)) {
+		munmap(p, mz);
+		return (glodf_t){.z = 0U, .d = NULL};
 	}
-
+	/* leave some good advice about our access pattern */
+	madvise(p, fz, MADV_SEQUENTIAL);
+	return (glodf_t){.z = mz, .d = p};
+}
+
+static void
+scan_map(struct gscan_s *s, const char *m, size_t fz, size_t beg, size_t end)
+{
+/* scan chunks BEG till END of the FZ bytes mapped at M in place,
+ * chunk offsets are multiples of 64, so the mapping's alignment
+ * carries over to every chunk */
+	const size_t pgz = sysconf(_SC_PAGESIZE);
+
+	for (size_t i = beg; i < end; i++) {
+		const size_t off = i * (CHUNKZ - MWNDWZ);
+		const size_t nrd = fz - off < CHUNKZ ? fz - off : CHUNKZ;
+
+		if (enough_p(__atomic_load_n(s->nmtch, __ATOMIC_RELAXED))) {
+			break;
+		}
+
+		if (!((i - beg) % RA_CHUNKS)) {
+			/* ask for the next couple of chunks in advance */
+			const size_t ra = off / pgz * pgz;
+			size_t raz = (RA_CHUNKS + 1U) * CHUNKZ;
+
+			if (raz > fz - ra) {
+				raz = fz - ra;
+			}
+			madvise(deconst(m + ra), raz, MADV_WILLNEED);
+		}
+		s->off = off;
+		scan1(s, m + off, nrd);
+	}
+	return;
+}
+
+static int
+match_buf(struct gcnts_s *c, glepcc_t cc, int fd, const char *fn,
+	  char *buf, size_t nrd)
+{
+/* FD is a regular file of NRD < CHUNKZ - MWNDWZ bytes, all of which
+ * are in BUF already, which has room for MWNDWZ more */
+	size_t nmtch = 0U;
+	struct ghits_s hb = {0U};
+	struct gscan_s s = {
+		.cc = cc, .c = c, .fn = fn, .nmtch = &nmtch,
+		.hits = hits_p() ? &hb : NULL,
+	};
+
+	with (unpack_fmt_t fmt = unpack_p && nrd
+	      ? sniff(buf, nrd) : UNPACK_NONE) {
+		if (fmt != UNPACK_NONE) {
+			/* small but compressed, BUF might have been
+			 * pread() so make sure FD continues past it */
+			lseek(fd, nrd, SEEK_SET);
+			return match_unpack(c, cc, fd, fn, fmt, buf, nrd);
+		}
+	}
+	/* the guts matchers peek past the end of their buffer */
+	memset(buf + nrd, 0, MWNDWZ);
+
+	rinse(c);
+	if (nrd) {
+		scan1(&s, buf, nrd);
+	}
+
+	pr_end(&s);
+	free(hb.h);
+	return 0;
+}
+
+static int
+match_small(struct gcnts_s *c, glepcc_t cc, int fd, const char *fn)
+{
+/* FD is a regular file of less than CHUNKZ bytes, that's one chunk, and
+ * one read() is cheaper than setting up and tearing down a mapping
+ * or a pair of coroutines, which matters with lots of tiny files */
+	char ALGN(buf[CHUNKZ], 64U);
+	const size_t bz = CHUNKZ - MWNDWZ;
+	size_t nrd = 0U;
+	ssize_t n = 0;
+
+	/* read till EOF, files might change size under our feet */
+	while (nrd < bz && (n = gread(fd, buf + nrd, bz - nrd)) > 0) {
+		nrd += n;
+	}
+	if (UNLIKELY(n < 0)) {
+		return -1;
+	} else if (UNLIKELY(nrd >= bz)) {
+		/* grown past a chunk, start over the long way */
+		if (lseek(fd, 0, SEEK_SET) < 0) {
+			return -1;
+		}
+		return match_read(c, cc, fd, fn);
+	}
+	return match_buf(c, cc, fd, fn, buf, nrd);
+}
+
+static int
+match0(struct gcnts_s *c, glepcc_t cc, int fd, const char *fn)
+{
+	struct stat st;
+	size_t nmtch = 0U;
+	struct ghits_s hb = {0U};
+	struct gscan_s s = {
+		.cc = cc, .c = c, .fn = fn, .nmtch = &nmtch,
+		.hits = hits_p() ? &hb : NULL,
+	};
+	unpack_fmt_t fmt;
+	glodf_t m;
+
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || !st.st_size) {
+		/* pipes and the like go through read(), so do empty files
+		 * as /proc and sysfs files claim to be */
+		return match_read(c, cc, fd, fn);
+	} else if ((size_t)st.st_size < CHUNKZ - MWNDWZ) {
+		return match_small(c, cc, fd, fn);
+	} else if ((fmt = sniff_fd(fd)) != UNPACK_NONE) {
+		return match_unpack(c, cc, fd, fn, fmt, NULL, 0U);
+	} else if ((m = mmap_reg(fd, st.st_size)).d == NULL) {
+		/* unmappable */
+		return match_read(c, cc, fd, fn);
+	}
+
+	rinse(c);
+
+	scan_map(&s, m.d, st.st_size, 0U, nchunks(st.st_size));
+	munmap(m.d, m.z);
+
+	pr_end(&s);
+	free(hb.h);
+	return 0;
+}
+
+
+/* result cache, see --cache */
+struct gcached_s {
+	const char *s;
+	size_t z;
+	bool found_p;
+};
+
+static bool
+cache_get(const char *fn, struct gcached_s *h)
+{
+/* look FN up in the cache, return true if it's unchanged since its
+ * results, which go to H then, were cached */
+	struct stat st;
+	ssize_t z;
+
+	if (cache == NULL || stat(fn, &st) < 0) {
+		return false;
+	} else if ((z = gcache_get(cache, fn, &st, &h->s, &h->found_p)) < 0) {
+		if (UNLIKELY(engine_stats_p)) {
+			__atomic_add_fetch(&hstat.ncmiss, 1U, __ATOMIC_RELAXED);
+		}
+		return false;
+	}
+	if (UNLIKELY(engine_stats_p)) {
+		__atomic_add_fetch(&hstat.nchit, 1U, __ATOMIC_RELAXED);
+	}
+	h->z = z;
+	return true;
+}
+
+static void
+cache_replay(const struct gcached_s *h)
+{
+/* report the cached results H as though the file had been scanned */
+	if (h->found_p) {
+		__atomic_store_n(&found_p, 1, __ATOMIC_RELAXED);
+	}
+	if (h->z) {
+		out_lock();
+		out_mem(h->s, h->z);
+		out_unlock();
+	}
+	return;
+}
+
+static void
+cache_beg(struct gcap_s *k, int fd)
+{
+/* collect the output for the file FD in K, if there's a cache */
+	*k = (struct gcap_s){.b = NULL};
+	if (cache != NULL && !fstat(fd, &k->st) && S_ISREG(k->st.st_mode)) {
+		out_capture(k);
+	}
+	return;
+}
+
+static int
+cache_end(struct gcap_s *k, const char *fn, int rc)
+{
+/* put the output collected in K into the cache as FN's unless its
+ * scan failed, i.e. RC is negative, return RC */
+	if (out_captured() == k) {
+		out_capture(NULL);
+		if (rc >= 0 && !k->oom_p) {
+			gcache_put(cache, fn, &k->st, k->b, k->n, k->found_p);
+		}
+	}
+	free(k->b);
+	return rc;
+}
+
+static uint64_t
+fnv(uint64_t h, const void *p, size_t z)
+{
+/* FNV-1a, continuing H over the Z octets of P */
+	for (size_t i = 0U; i < z; i++) {
+		h ^= ((const unsigned char*)p)[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static uint64_t
+cache_cookie(glepcc_t cc)
+{
+/* hash the patterns and the options that shape the output, results
+ * obtained with others are of no use */
+	const uint64_t opt[] = {
+		invert_match_p, show_pats_p, show_count_p, list_p, quiet_p,
+		offset_p, lineno_p, unpack_p, out_fmt, rsep, max_count,
+		non_ascii_wordsep_p,
+	};
+	uint64_t h = fnv(0xcbf29ce484222325ULL, opt, sizeof(opt));
+
+	for (size_t i = 0U; i < cc->orig->npats; i++) {
+		const struct glod_pat_s *p = cc->orig->pats + i;
+		const char *rs = pr_name(cc, i);
+
+		h = fnv(h, &p->fl.u, sizeof(p->fl.u));
+		h = fnv(h, &p->n, sizeof(p->n));
+		h = fnv(h, p->p, p->n);
+		h = fnv(h, rs, strlen(rs) + 1U);
+	}
+	return h;
+}
+
+
+/* intra-file parallelism */
+struct glepr_s {
+	pthread_t thr;
+	glepcc_t cc;
+	int fd;
+	/* the file's mapping, if any, and its size */
+	const char *m;
+	size_t fz;
+	/* chunks to scan, chunk I starts at offset I * (CHUNKZ - MWNDWZ) */
+	size_t beg;
+	size_t end;
+	/* counters for this range */
+	gcnt_t *cnt;
+	/* matches in the whole file, shared by all rangers */
+	size_t *nmtch;
+	int rc;
+};
+
+static void*
+glep_ranger(void *arg)
+{
+/* scan the chunks of a range exactly the way co_snarf() and co_match()
+ * would present them, i.e. CHUNKZ bytes, of which the last MWNDWZ are
+ * scanned again as part of the next chunk, this way matches across
+ * range borders are counted exactly once */
+	struct glepr_s *r = arg;
+	struct gcnts_s c = {.cnt = r->cnt, .npats = r->cc->orig->npats};
+	struct gscan_s s = {.cc = r->cc, .c = &c, .nmtch = r->nmtch};
+	char ALGN(buf[CHUNKZ], 64U);
+
+	if (LIKELY(r->m != NULL)) {
+		/* zero-copy */
+		scan_map(&s, r->m, r->fz, r->beg, r->end);
+		goto out;
+	}
+	for (size_t i = r->beg; i < r->end; i++) {
+		const off_t off = (off_t)(i * (CHUNKZ - MWNDWZ));
+		size_t nrd = 0U;
+		ssize_t n = 0;
+
+		if (enough_p(__atomic_load_n(r->nmtch, __ATOMIC_RELAXED))) {
+			break;
+		}
+
+		/* insist on filling the buffer */
+		while (nrd < sizeof(buf) &&
+		       (n = gpread(r->fd, buf + nrd,
+				  sizeof(buf) - nrd, off + nrd)) > 0) {
+			nrd += n;
+		}
+		if (UNLIKELY(n < 0)) {
+			r->rc = -1;
+			break;
+		} else if (UNLIKELY(!nrd)) {
+			break;
+		}
+		s.off = off;
+		scan1(&s, buf, nrd);
+
+		if (nrd < sizeof(buf)) {
+			/* that was the final drain */
+			break;
+		}
+	}
+out:
+	/* only ever used for touched counters or --stats-patterns */
+	free(c.hb.h);
+	return NULL;
+}
+
+static int
+match_split(struct gcnts_s *c, glepcc_t cc, int fd, const char *fn)
+{
+	const size_t npats = cc->orig->npats;
+	struct stat st;
+	size_t nchnk;
+	size_t nrng;
+	size_t nmtch = 0U;
+	glodf_t m;
+	int res = 0;
+
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		/* can't split this one */
+		return match0(c, cc, fd, fn);
+	} else if (sniff_fd(fd) != UNPACK_NONE) {
+		/* nor compressed ones */
+		return match0(c, cc, fd, fn);
+	}
+	nchnk = nchunks(st.st_size);
+	if ((nrng = nchnk / SPLIT_MINZ) > njobs) {
+		nrng = njobs;
+	}
+	if (nrng <= 1U) {
+		/* not worth the hassle */
+		return match0(c, cc, fd, fn);
+	}
+
+	with (struct glepr_s r[nrng]) {
+		gcnt_t *rcnt = calloc(nrng * npats, sizeof(*rcnt));
+
+		if (UNLIKELY(rcnt == NULL)) {
+			return match0(c, cc, fd, fn);
+		} else if ((m = mmap_reg(fd, st.st_size)).d == NULL) {
+			/* rangers will have to pread() */
+			posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		}
+
+		for (size_t i = 0U; i < nrng; i++) {
+			r[i] = (struct glepr_s){
+				.cc = cc, .fd = fd,
+				.m = m.d, .fz = st.st_size,
+				.beg = i * nchnk / nrng,
+				.end = (i + 1U) * nchnk / nrng,
+				.cnt = rcnt + i * npats,
+				.nmtch = &nmtch,
+			};
+			if (UNLIKELY(pthread_create(
+					     &r[i].thr, NULL,
+					     glep_ranger, r + i))) {
+				/* do it ourselves then */
+				glep_ranger(r + i);
+				r[i].fd = -1;
+			}
+		}
+		/* reduce, that's a sweep anyway */
+		rinse(c);
+		c->ntch = NTCH_ALL;
+		for (size_t i = 0U; i < nrng; i++) {
+			if (LIKELY(r[i].fd >= 0)) {
+				pthread_join(r[i].thr, NULL);
+			}
+			if (UNLIKELY(r[i].rc < 0)) {
+				res = -1;
+			}
+			for (size_t j = 0U; j < npats; j++) {
+				c->cnt[j] += r[i].cnt[j];
+			}
+		}
+		free(rcnt);
+		if (m.d != NULL) {
+			munmap(m.d, m.z);
+		}
+	}
+
+	if (LIKELY(res == 0)) {
+		pr_file(cc, c, fn, 0U, nmtch);
+	}
+	return res;
+}
+
+
+static int
+match_fd(struct gcnts_s *c, glepcc_t cc, int fd, const char *fn)
+{
+	int rc = 0;
+
+	if (split_p && njobs > 1U && rsep < 0 && !max_count) {
+		/* records might straddle ranges, hence no splitting then,
+		 * nor with -m whose N matches are the first N in the file */
+		if (match_split(c, cc, fd, fn) < 0) {
+			error("Error: cannot process `%s'", fn);
+			rc = -1;
+		}
+	} else if (match0(c, cc, fd, fn) < 0) {
+		error("Error: cannot process `%s'", fn);
+		rc = -1;
+	}
+	return rc;
+}
+
+static int
+match_landed(struct gcnts_s *c, glepcc_t cc, const struct uring_file_s *f,
+	     const char *fn)
+{
+/* scan the file F that came out of the ring, small ones are in F's
+ * buffer already, everything else takes the usual route */
+	struct gcap_s k;
+	int rc;
+
+	if (UNLIKELY(f->fd < 0)) {
+		errno = f->err;
+		error("Error: cannot open file `%s'", fn);
+		return -1;
+	}
+	cache_beg(&k, f->fd);
+	if (f->nrd < 0) {
+		rc = match_fd(c, cc, f->fd, fn);
+	} else if ((rc = match_buf(c, cc, f->fd, fn, f->buf, f->nrd)) < 0) {
+		error("Error: cannot process `%s'", fn);
+	}
+	close(f->fd);
+	return cache_end(&k, fn, rc);
+}
+
+static int
+match1(struct gcnts_s *c, glepcc_t cc, const char *fn)
+{
+	struct gcached_s h;
+	struct gcap_s k;
+	int rc;
+	int fd;
+
+	if (cache_get(fn, &h)) {
+		cache_replay(&h);
+		return 0;
+	} else if (UNLIKELY((fd = open(fn, O_RDONLY)) < 0)) {
+		error("Error: cannot open file `%s'", fn);
+		return -1;
+	}
+	cache_beg(&k, fd);
+	rc = match_fd(c, cc, fd, fn);
+	/* clean up */
+	close(fd);
+	return cache_end(&k, fn, rc);
+}
+
+
+/* parallel file processing */
+struct glepw_s {
+	pthread_t thr;
+	/* lane in the work-stealing queue */
+	size_t i;
+	wsq_t q;
+	glepcc_t cc;
+	/* items queued but not yet done, shared by all workers */
+	size_t *npend;
+	/* overall result */
+	int rc;
+};
+
+/* queue items, files to scan or, with -r, directories to walk */
+struct gitem_s {
+	bool dir_p;
+	/* descriptor to scan FN off, or -1 to open FN */
+	int fd;
+	char fn[];
+};
+
+static struct gitem_s*
+make_gitem(const char *dn, const char *fn, bool dir_p)
+{
+/* make an item for FN in directory DN, or just FN if DN is NULL */
+	size_t dz = dn != NULL ? strlen(dn) : 0U;
+	const size_t fz = strlen(fn);
+	struct gitem_s *res;
+
+	if (UNLIKELY((res = malloc(sizeof(*res) + dz + 1U + fz + 1U)) == NULL)) {
+		return NULL;
+	}
+	res->dir_p = dir_p;
+	res->fd = -1;
+	if (dz) {
+		memcpy(res->fn, dn, dz);
+		if (dn[dz - 1U] != '/') {
+			res->fn[dz++] = '/';
+		}
+	}
+	memcpy(res->fn + dz, fn, fz + 1U);
+	return res;
+}
+
+static void
+free_gitem(struct gitem_s *it)
+{
+	if (it->fd >= 0) {
+		close(it->fd);
+	}
+	free(it);
+	return;
+}
+
+static bool
+globp(char *const globs[], size_t nglobs, const char *fn)
+{
+/* check if FN matches any of GLOBS */
+	for (size_t i = 0U; i < nglobs; i++) {
+		if (!fnmatch(globs[i], fn, 0)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static unsigned char
+walk_dt(int dfd, const struct dirent *de)
+{
+/* return the type of DE in the directory DFD if it's one to walk or
+ * scan according to the globs, DT_UNKNOWN otherwise,
+ * d_type spares us the stat() for all but the odd file system,
+ * symlinks aren't followed, like grep -r */
+	unsigned char dt = de->d_type;
+
+	if (de->d_name[0U] == '.' &&
+	    (!de->d_name[1U] ||
+	     (de->d_name[1U] == '.' && !de->d_name[2U]))) {
+		return DT_UNKNOWN;
+	} else if (dt == DT_UNKNOWN) {
+		struct stat st;
+
+		if (fstatat(dfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+			return DT_UNKNOWN;
+		}
+		dt = S_ISDIR(st.st_mode) ? DT_DIR
+			: S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+	}
+
+	switch (dt) {
+	case DT_DIR:
+		if (globp(exclude_dirs, nexclude_dirs, de->d_name)) {
+			return DT_UNKNOWN;
+		}
+		break;
+	case DT_REG:
+		if (nincludes && !globp(includes, nincludes, de->d_name)) {
+			return DT_UNKNOWN;
+		} else if (globp(excludes, nexcludes, de->d_name)) {
+			return DT_UNKNOWN;
+		}
+		break;
+	default:
+		/* symlinks, devices, fifos and sockets */
+		return DT_UNKNOWN;
+	}
+	return dt;
+}
+
+static int
+walk(struct glepw_s *w, const char *dn)
+{
+/* queue the regular files and subdirectories of DN on our own lane */
+	struct dirent *de;
+	DIR *dp;
+	int fd;
+
+	if (UNLIKELY((fd = openat(AT_FDCWD, dn, O_RDONLY | O_DIRECTORY)) < 0)) {
+		error("Error: cannot open directory `%s'", dn);
+		return -1;
+	} else if (UNLIKELY((dp = fdopendir(fd)) == NULL)) {
+		error("Error: cannot open directory `%s'", dn);
+		close(fd);
+		return -1;
+	}
+	while ((de = readdir(dp)) != NULL && !quit_p()) {
+		const unsigned char dt = walk_dt(fd, de);
+		struct gitem_s *it;
+
+		if (dt == DT_UNKNOWN) {
+			continue;
+		} else if (UNLIKELY((it = make_gitem(dn, de->d_name,
+					      dt == DT_DIR)) == NULL)) {
+			closedir(dp);
+			return -1;
+		}
+		__atomic_add_fetch(w->npend, 1U, __ATOMIC_RELAXED);
+		if (UNLIKELY(wsq_push(w->q, w->i, it) < 0)) {
+			error("Error: cannot queue `%s'", it->fn);
+			__atomic_sub_fetch(w->npend, 1U, __ATOMIC_RELEASE);
+			free_gitem(it);
+			closedir(dp);
+			return -1;
+		}
+	}
+	closedir(dp);
+	return 0;
+}
+
+static void*
+glep_worker(void *arg)
+{
+	struct glepw_s *w = arg;
+	struct gcnts_s c;
+	/* files in flight, opened and read ahead of us */
+	uring_t u = NULL;
+	size_t ninfl = 0U;
+	size_t depth = 0U;
+	/* a cached file waiting for those in flight */
+	struct gitem_s *held = NULL;
+	struct gcached_s hh = {.z = 0U};
+
+	if (UNLIKELY(make_gcnts(&c, w->cc) < 0)) {
+		/* leave our lane to the thieves */
+		free_gcnts(&c);
+		w->rc = -1;
+		return NULL;
+	} else if (io_depth &&
+		   (u = make_uring(io_depth, CHUNKZ - MWNDWZ, MWNDWZ)) != NULL) {
+		depth = io_depth;
+	}
+
+	while (!quit_p()) {
+		struct gitem_s *it = NULL;
+		struct gcached_s h;
+
+		if (held == NULL && ninfl < depth &&
+		    (it = wsq_pop(w->q, w->i)) != NULL &&
+		    !it->dir_p && it->fd < 0 && cache_get(it->fn, &h)) {
+			/* no need to open it, but its results mustn't
+			 * overtake those of the files in flight */
+			if (ninfl) {
+				held = it;
+				hh = h;
+				continue;
+			}
+			cache_replay(&h);
+			free_gitem(it);
+			__atomic_sub_fetch(w->npend, 1U, __ATOMIC_RELEASE);
+			continue;
+		}
+		if (it != NULL && !it->dir_p && it->fd < 0 &&
+		    !uring_push(u, it->fn, it)) {
+			/* it's on its way */
+			ninfl++;
+			continue;
+		} else if (it == NULL && ninfl) {
+			const struct uring_file_s *f = uring_pop(u);
+
+			ninfl--;
+			it = f->clo;
+			if (match_landed(&c, w->cc, f, it->fn) < 0) {
+				w->rc = -1;
+			}
+			free_gitem(it);
+			__atomic_sub_fetch(w->npend, 1U, __ATOMIC_RELEASE);
+			continue;
+		} else if (it == NULL && held != NULL) {
+			cache_replay(&hh);
+			free_gitem(held);
+			held = NULL;
+			__atomic_sub_fetch(w->npend, 1U, __ATOMIC_RELEASE);
+			continue;
+		} else if (it == NULL && (it = wsq_pop(w->q, w->i)) == NULL) {
+			if (!__atomic_load_n(w->npend, __ATOMIC_ACQUIRE)) {
+				/* nothing queued, nothing being walked */
+				break;
+			}
+			/* someone's still walking, they might come up
+			 * with more items */
+			nanosleep(&(struct timespec){0, IDLE_NSEC}, NULL);
+			continue;
+		}
+		if (it->dir_p ? walk(w, it->fn) < 0
+		    : it->fd >= 0 ? match_fd(&c, w->cc, it->fd, it->fn) < 0
+		    : match1(&c, w->cc, it->fn) < 0) {
+			w->rc = -1;
+		}
+		free_gitem(it);
+		__atomic_sub_fetch(w->npend, 1U, __ATOMIC_RELEASE);
+	}
+	/* with -q there might be files in flight still */
+	for (const struct uring_file_s *f;
+	     u != NULL && (f = uring_pop(u)) != NULL;) {
+		if (f->fd >= 0) {
+			close(f->fd);
+		}
+		free_gitem(f->clo);
+		__atomic_sub_fetch(w->npend, 1U, __ATOMIC_RELEASE);
+	}
+	if (held != NULL) {
+		free_gitem(held);
+		__atomic_sub_fetch(w->npend, 1U, __ATOMIC_RELEASE);
+	}
+	free_uring(u);
+	free_gcnts(&c);
+	return NULL;
+}
+
+static int
+match_q(glepcc_t cc, wsq_t q, size_t *npend,
+	int(*feed)(wsq_t, size_t*, void*), void *clo)
+{
+/* have NJOBS workers scan, or walk, the NPEND items of Q, if FEED is
+ * non-NULL it's called with CLO to queue more items as the workers go,
+ * and it's to take back one of the NPEND it's been given upon return */
+	struct glepw_s w[njobs];
+	size_t nspawned = 0U;
+	int rc = 0;
+
+	for (size_t i = 0U; i < njobs; i++) {
+		w[nspawned] = (struct glepw_s){
+			.i = i, .q = q, .cc = cc, .npend = npend,
+		};
+		if (UNLIKELY(pthread_create(
+				     &w[nspawned].thr, NULL,
+				     glep_worker, w + nspawned))) {
+			error("Error: cannot spawn worker thread");
+			continue;
+		}
+		nspawned++;
+	}
+	if (feed != NULL && UNLIKELY(!nspawned)) {
+		/* feeding nobody is pointless */
+		__atomic_sub_fetch(npend, 1U, __ATOMIC_RELEASE);
+		rc = -1;
+	} else if (feed != NULL && feed(q, npend, clo) < 0) {
+		rc = -1;
+	}
+	if (UNLIKELY(!nspawned)) {
+		/* do the work ourselves then, we'd steal everything */
+		w[0U] = (struct glepw_s){
+			.i = 0U, .q = q, .cc = cc, .npend = npend,
+		};
+		glep_worker(w);
+		nspawned++;
+	} else {
+		for (size_t i = 0U; i < nspawned; i++) {
+			pthread_join(w[i].thr, NULL);
+		}
+	}
+	for (size_t i = 0U; i < nspawned; i++) {
+		if (w[i].rc) {
+			rc = -1;
+		}
+	}
+	/* items left behind by -q */
+	for (void *it; (it = wsq_pop(q, 0U)) != NULL; free_gitem(it));
+	return rc;
+}
+
+static int
+match_items(glepcc_t cc, struct gitem_s *const its[], size_t nits)
+{
+/* scan, or walk, ITS with NJOBS workers, the items are ours then */
+	size_t npend = 0U;
+	wsq_t q;
+	int rc = 0;
+
+	if (UNLIKELY((q = make_wsq(njobs)) == NULL)) {
+		for (size_t i = 0U; i < nits; i++) {
+			free_gitem(its[i]);
+		}
+		return -1;
+	}
+	/* hand out contiguous runs of files to the lanes, the owner
+	 * consumes from the front, thieves steal from the back */
+	for (size_t i = 0U; i < nits; i++) {
+		if (UNLIKELY(wsq_push(q, i * njobs / nits, its[i]) < 0)) {
+			error("Error: cannot queue `%s'", its[i]->fn);
+			free_gitem(its[i]);
+			rc = -1;
+			continue;
+		}
+		npend++;
+	}
+	if (match_q(cc, q, &npend, NULL, NULL) < 0) {
+		rc = -1;
+	}
+	free_wsq(q);
+	return rc;
+}
+
+static int
+match_par(glepcc_t cc, char *const fns[], size_t nfns)
+{
+	struct gitem_s **its = malloc(nfns * sizeof(*its) + 1U);
+	size_t nits = 0U;
+	int rc = 0;
+
+	if (UNLIKELY(its == NULL)) {
+		return -1;
+	}
+	for (size_t i = 0U; i < nfns; i++) {
+		struct stat st;
+		const bool dir_p = recursive_p &&
+			!stat(fns[i], &st) && S_ISDIR(st.st_mode);
+
+		its[nits] = make_gitem(NULL, fns[i], dir_p);
+		if (UNLIKELY(its[nits] == NULL)) {
+			rc = -1;
+			continue;
+		}
+		nits++;
+	}
+	if (match_items(cc, its, nits) < 0) {
+		rc = -1;
+	}
+	free(its);
+	return rc;
+}
+
+
+/* trigram indices, see glep index and --index */
+static int
+index_walk(gidxw_t x, const char *dn, const struct stat *ix)
+{
+/* add the regular files below DN to X, like walk() would find them,
+ * except for those in the index's directory IX */
+	struct dirent *de;
+	DIR *dp;
+	int fd;
+	int rc = 0;
+
+	if (UNLIKELY((fd = openat(AT_FDCWD, dn, O_RDONLY | O_DIRECTORY)) < 0)) {
+		error("Error: cannot open directory `%s'", dn);
+		return -1;
+	} else if (UNLIKELY((dp = fdopendir(fd)) == NULL)) {
+		error("Error: cannot open directory `%s'", dn);
+		close(fd);
+		return -1;
+	} else if (UNLIKELY(gidxw_add_dir(x, dn) < 0)) {
+		error("Error: cannot index directory `%s'", dn);
+		closedir(dp);
+		return -1;
+	}
+	while ((de = readdir(dp)) != NULL) {
+		const unsigned char dt = walk_dt(fd, de);
+		struct gitem_s *it;
+
+		if (dt == DT_UNKNOWN) {
+			continue;
+		} else if (dt == DT_DIR) {
+			struct stat st;
+
+			if (!fstatat(fd, de->d_name, &st, 0) &&
+			    st.st_dev == ix->st_dev && st.st_ino == ix->st_ino) {
+				continue;
+			}
+		}
+		if (UNLIKELY((it = make_gitem(dn, de->d_name,
+					      dt == DT_DIR)) == NULL)) {
+			rc = -1;
+			break;
+		}
+		if (it->dir_p) {
+			rc |= index_walk(x, it->fn, ix);
+		} else if (gidxw_add(x, it->fn) < 0) {
+			error("Error: cannot index file `%s'", it->fn);
+			rc = -1;
+		}
+		free_gitem(it);
+	}
+	closedir(dp);
+	return rc;
+}
+
+static int
+glep_index(const char *dir, char *const fns[], size_t nfns)
+{
+/* index FNS, directories recursively, or the current directory if
+ * there are none, into DIR */
+	gidxw_t x;
+	struct stat ix;
+	int rc = 0;
+
+	if (UNLIKELY((x = make_gidxw(dir)) == NULL)) {
+		error("Error: cannot create index in `%s'", dir);
+		return -1;
+	} else if (UNLIKELY(stat(dir, &ix) < 0)) {
+		/* no telling it apart then, it'll get indexed, too */
+		ix = (struct stat){.st_ino = 0U};
+	}
+	for (size_t i = 0U; i < (nfns ? nfns : 1U); i++) {
+		const char *fn = nfns ? fns[i] : ".";
+		struct stat st;
+
+		if (stat(fn, &st) < 0) {
+			error("Error: cannot index file `%s'", fn);
+			rc = -1;
+		} else if (S_ISDIR(st.st_mode)) {
+			rc |= index_walk(x, fn, &ix);
+		} else if (gidxw_add(x, fn) < 0) {
+			error("Error: cannot index file `%s'", fn);
+			rc = -1;
+		}
+	}
+	if (UNLIKELY(gidxw_fin(x) < 0)) {
+		error("Error: cannot write index to `%s'", dir);
+		rc = -1;
+	}
+	return rc;
+}
+
+static int
+match_index(glepcc_t cc, const char *dir)
+{
+/* scan the files of the index in DIR that might match, i.e. those with
+ * all trigrams of some pattern, those changed since their indexing and
+ * those whose trigrams weren't indexed, patterns too short to have
+ * trigrams make us scan everything */
+	gidx_t x;
+	size_t nf;
+	uint64_t *cand;
+	char **fns;
+	size_t nfns = 0U;
+	/* files not matching are a result, too, with -v */
+	bool all_p = invert_match_p;
+	int rc;
+
+	if (UNLIKELY((x = gidx_open(dir)) == NULL)) {
+		error("Error: cannot read index in `%s'", dir);
+		return -1;
+	}
+	with (const char *dn = gidx_stale(x)) {
+		if (dn != NULL) {
+			errno = 0;
+			error("Warning: directory `%s' changed since indexing, "
+			      "files added to it since aren't scanned", dn);
+		}
+	}
+	nf = gidx_nfiles(x);
+	cand = calloc(nf / 64U + 1U, sizeof(*cand));
+	fns = malloc((nf + 1U) * sizeof(*fns));
+	if (UNLIKELY(cand == NULL || fns == NULL)) {
+		rc = -1;
+		goto out;
+	}
+	for (size_t i = 0U; i < cc->orig->npats && !all_p; i++) {
+		const struct glod_pat_s *p = cc->orig->pats + i;
+
+		all_p = gidx_cand(cand, x, p->p, p->n, p->fl.ci) < 0;
+	}
+	for (size_t i = 0U; i < nf; i++) {
+		if (all_p || cand[i / 64U] >> (i % 64U) & 1U ||
+		    !gidx_fresh_p(x, i)) {
+			fns[nfns++] = deconst(gidx_file(x, i));
+		}
+	}
+	if (stats_p) {
+		fprintf(stderr, "index\tfiles\t%zu\n", nf);
+		fprintf(stderr, "index\tcandidates\t%zu\n", nfns);
+	}
+	rc = nfns ? match_par(cc, fns, nfns) : 0;
+out:
+	free(fns);
+	free(cand);
+	gidx_close(x);
+	return rc;
+}
+
+
+/* scan service, see glep-serve.h for the protocol */
+struct serve_s {
+	wsq_t q;
+	size_t *npend;
+	size_t nits;
+};
+
+static int
+serve_req(const char *fn, int fd, void *clo)
+{
+/* queue the request for FN, or descriptor FD, on the queue at CLO */
+	struct serve_s *sv = clo;
+	struct gitem_s *it;
+
+	/* don't let clients run away with our descriptors */
+	while (__atomic_load_n(sv->npend, __ATOMIC_ACQUIRE) > GSERVE_MAXFDS) {
+		nanosleep(&(struct timespec){0, IDLE_NSEC}, NULL);
+	}
+	if (UNLIKELY((it = make_gitem(NULL, fn, false)) == NULL)) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		return -1;
+	}
+	it->fd = fd;
+	__atomic_add_fetch(sv->npend, 1U, __ATOMIC_RELAXED);
+	if (UNLIKELY(wsq_push(sv->q, sv->nits++, it) < 0)) {
+		error("Error: cannot queue `%s'", it->fn);
+		__atomic_sub_fetch(sv->npend, 1U, __ATOMIC_RELEASE);
+		free_gitem(it);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+serve_feed(wsq_t q, size_t *npend, void *UNUSED(clo))
+{
+/* queue the requests read off the connection as they come */
+	struct serve_s sv = {.q = q, .npend = npend};
+	int rc = gserve_feed(STDOUT_FILENO, serve_req, &sv);
+
+	/* that's it from us */
+	__atomic_sub_fetch(npend, 1U, __ATOMIC_RELEASE);
+	return rc;
+}
+
+static int
+serve1(void *clo)
+{
+/* scan the requests of the connection on stdout as they come,
+ * with NJOBS workers, and send the results back */
+	glepcc_t cc = clo;
+	size_t npend = 1U;
+	wsq_t q;
+	int rc;
+
+	if (UNLIKELY((q = make_wsq(njobs)) == NULL)) {
+		return -1;
+	}
+	rc = match_q(cc, q, &npend, serve_feed, NULL);
+	free_wsq(q);
+	out_flush();
+	return rc < 0 || out_err() ? -1 : 0;
+}
+
+static int
+glep_serve(glepcc_t cc, const char *fn)
+{
+/* serve every connection on the unix socket FN in a child of its own,
+ * the compiled patterns are shared copy-on-write that way */
+
+	/* or the children would send our leftovers, too */
+	out_flush();
+	if (gserve(fn, serve1, deconst(cc)) < 0) {
+		error("Error: cannot listen on `%s'", fn);
+		return -1;
+	}
+	return 0;
+}
+
+static size_t
+pats_view(struct glod_pats_s *restrict v, glod_pats_t g,
+	  unsigned int thresh, bool long_p)
+{
+/* like glod_pats_filter() minus the interning, put G's patterns of up
+ * to THRESH octets, or the longer ones if LONG_P, into V, which must be
+ * able to hold all of G's patterns, return the number of patterns in V */
+	v->oa_pat = NULL;
+	v->oa_yld = g->oa_yld;
+	v->npats = 0U;
+	for (size_t i = 0U; i < g->npats; i++) {
+		if (short_p(g->pats[i], thresh) != long_p) {
+			v->pats[v->npats++] = g->pats[i];
+		}
+	}
+	return v->npats;
+}
+
+static glod_pats_t
+make_pats_view(glod_pats_t g, unsigned int thresh, bool long_p)
+{
+/* like pats_view() but on the heap, NULL if there's no such patterns,
+ * the patterns stay G's, the engines take them as they are */
+	struct glod_pats_s *res;
+
+	if (UNLIKELY((res = malloc(sizeof(*res) +
+				   g->npats * sizeof(*res->pats))) == NULL)) {
+		return NULL;
+	} else if (!pats_view(res, g, thresh, long_p)) {
+		free(res);
+		return NULL;
+	}
+	return res;
+}
+
+static int
+parse_rsep(const char *s)
+{
+/* turn S, a character or one of the usual escapes, into a separator */
+	static const char esc[] = "f\fn\nr\rt\tv\v0\0\\\\";
+
+	if (s[0U] && !s[1U]) {
+		return (unsigned char)s[0U];
+	} else if (s[0U] == '\\' && s[1U] && !s[2U]) {
+		for (size_t i = 0U; i < sizeof(esc) - 1U; i += 2U) {
+			if (s[1U] == esc[i]) {
+				return (unsigned char)esc[i + 1U];
+			}
+		}
+	}
+	return -1;
+}
+
+static struct plan_s
+glep_plan(glod_pats_t g)
+{
+/* split G into patterns of up to THRESH octets for the SIMD code and
+ * the rest for Wu-Manber or Rabin-Karp, the engines estimate their
+ * own costs and we go for the cheapest split */
+	struct plan_s best = {.thresh = 2U, .cost = SIZE_MAX};
+	struct glod_pats_s *lo, *hi;
+	size_t nlen[TD_MAXN + 1U] = {0U};
+	size_t nmid = 0U;
+
+	switch (engine) {
+	case ENGINE_SIMD:
+		/* what the SIMD code can't do goes to Wu-Manber */
+		return (struct plan_s){.thresh = TD_MAXN};
+	case ENGINE_WM:
+		return (struct plan_s){.thresh = 2U};
+	case ENGINE_RK:
+		/* Rabin-Karp wants 4 octets at least */
+		return (struct plan_s){.thresh = 3U, .rk_p = true};
+	default:
+		break;
+	}
+
+	lo = malloc(sizeof(*lo) + g->npats * sizeof(*lo->pats));
+	hi = malloc(sizeof(*hi) + g->npats * sizeof(*hi->pats));
+	if (UNLIKELY(lo == NULL || hi == NULL)) {
+		best.cost = 0U;
+		goto out;
+	}
+	for (size_t i = 0U; i < g->npats; i++) {
+		if (g->pats[i].n <= TD_MAXN) {
+			nlen[g->pats[i].n]++;
+		}
+	}
+	for (unsigned int t = 2U; t <= TD_MAXN; t++) {
+		size_t c;
+
+		if (t > 3U && !nlen[t]) {
+			/* same split as before, 3 is special because
+			 * that's where Rabin-Karp joins in */
+			continue;
+		}
+		nmid += t > 2U ? nlen[t] : 0U;
+		if (nmid > TD_MAXPATS) {
+			/* the fingerprint matcher's buckets would crowd */
+			break;
+		}
+		c = pats_view(lo, g, t, false) ? glep_simd_cost(lo) : 0U;
+		if (pats_view(hi, g, t, true)) {
+			const size_t wm = wu_manber_cost(hi);
+			const size_t rk = t >= 3U
+				? rabin_karp_cost(hi) : SIZE_MAX;
+
+			c += wm <= rk ? wm : rk;
+			if (c < best.cost) {
+				best = (struct plan_s){t, rk < wm, c};
+			}
+		} else if (c < best.cost) {
+			best = (struct plan_s){t, false, c};
+		}
+	}
+out:
+	free(lo);
+	free(hi);
+	return best;
+}
+
+glepcc_t
+glep_cc(glod_pats_t g)
+{
+/* compile patterns in G, i.e. preprocessing phase for the SIMD code,
+ * Wu-Manber or Rabin-Karp, or, for large pattern sets, Aho-Corasick
+ * whose throughput doesn't depend on the number of patterns */
+	struct glepcc_s *res = calloc(1, sizeof(*res));
+
+	if (UNLIKELY(res == NULL)) {
+		return NULL;
+	}
+	res->orig = g;
+
+	if (engine == ENGINE_AUTO && g->npats >= AC_MINPATS &&
+	    (res->aho_corasick_cc = aho_corasick_cc(g)) != NULL) {
+		return res;
+	}
+
+	/* short patterns hurt Wu-Manber's shifts, the planner decides
+	 * how many of them go to the SIMD code */
+	res->plan = glep_plan(g);
+
+	with (const unsigned int t = res->plan.thresh) {
+		glod_pats_t hi;
+
+		if ((res->glep_simd = make_pats_view(g, t, false)) != NULL) {
+			res->glep_simd_cc = glep_simd_cc(res->glep_simd);
+		}
+		if ((hi = make_pats_view(g, t, true)) != NULL &&
+		    res->plan.rk_p) {
+			res->rabin_karp = hi;
+			res->rabin_karp_cc = rabin_karp_cc(hi);
+		} else if (hi != NULL) {
+			res->wu_manber = hi;
+			res->wu_manber_cc = wu_manber_cc(hi);
+		}
+	}
+	return res;
+}
+
+static int
+glep_gr_stats(gcnt_t *restrict cnt, ghits_t hits,
+	      glepcc_t c, const char *buf, size_t bsz)
+{
+/* like glep_gr() but account for each engine's time and matches */
+	const struct {
+		glepcc_t cc;
+		int(*gr)(gcnt_t*restrict, ghits_t, glepcc_t, const char*, size_t);
+	} eng[NENGINES] = {
+		[EST_SIMD] = {c->glep_simd_cc, glep_simd_gr},
+		[EST_WM] = {c->wu_manber_cc, wu_manber_gr},
+		[EST_RK] = {c->rabin_karp_cc, rabin_karp_gr},
+		[EST_AC] = {c->aho_corasick_cc, aho_corasick_gr},
+	};
+	const size_t npr = bsz < CHUNKZ ? bsz : CHUNKZ - MWNDWZ;
+	struct estat_s *est = deconst(c->est);
+	int res = 0;
+
+	for (size_t i = 0U; i < NENGINES; i++) {
+		uint64_t t;
+		int n;
+
+		if (eng[i].cc == NULL) {
+			continue;
+		}
+		t = glep_ns();
+		n = eng[i].gr(cnt, hits, eng[i].cc, buf, bsz);
+		t = glep_ns() - t;
+		__atomic_add_fetch(&est[i].ncall, 1U, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&est[i].nbyte, npr, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&est[i].nsec, t, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&est[i].nmtch, n, __ATOMIC_RELAXED);
+		res += n;
+	}
+	return res;
+}
+
+int
+glep_gr(gcnt_t *restrict cnt, ghits_t hits,
+	glepcc_t c, const char *buf, size_t bsz)
+{
+	int res = 0;
+
+	if (UNLIKELY(engine_stats_p)) {
+		return glep_gr_stats(cnt, hits, c, buf, bsz);
+	}
+	if (LIKELY(c->glep_simd_cc != NULL)) {
+		res += glep_simd_gr(cnt, hits, c->glep_simd_cc, buf, bsz);
+	}
+	if (LIKELY(c->wu_manber_cc != NULL)) {
+		res += wu_manber_gr(cnt, hits, c->wu_manber_cc, buf, bsz);
+	}
+	if (c->rabin_karp_cc != NULL) {
+		res += rabin_karp_gr(cnt, hits, c->rabin_karp_cc, buf, bsz);
+	}
+	if (c->aho_corasick_cc != NULL) {
+		res += aho_corasick_gr(cnt, hits, c->aho_corasick_cc, buf, bsz);
+	}
+	return res;
+}
+
+void
+glep_fr(glepcc_t g)
+{
+	if (UNLIKELY(g == NULL)) {
+		return;
+	}
+	if (g->wu_manber_cc != NULL) {
+		wu_manber_fr(g->wu_manber_cc);
+	}
+	if (g->glep_simd_cc != NULL) {
+		glep_simd_fr(g->glep_simd_cc);
+	}
+	if (g->rabin_karp_cc != NULL) {
+		rabin_karp_fr(g->rabin_karp_cc);
+	}
+	if (g->aho_corasick_cc != NULL) {
+		aho_corasick_fr(g->aho_corasick_cc);
+	}
+
 	/* since we shared the oa_yld slot, free our references there */
 	with (struct glod_pats_s *pg = deconst(g->wu_manber)) {
 		if (pg != NULL) {
@@ -382,16 +2475,354 @@ glep_fr(glepcc_t g)
 			pg->oa_yld = NULL;
 		}
 	}
+	with (struct glod_pats_s *pg = deconst(g->rabin_karp)) {
+		if (pg != NULL) {
+			pg->oa_yld = NULL;
+		}
+	}
 	if (g->wu_manber != NULL) {
 		glod_free_pats(g->wu_manber);
 	}
+	if (g->rabin_karp != NULL) {
+		glod_free_pats(g->rabin_karp);
+	}
 	if (g->glep_simd != NULL) {
 		glod_free_pats(g->glep_simd);
 	}
+	if (g->db != NULL) {
+		gdb_close(g->db);
+	}
 	return;
 }
 
+
+/* compiled pattern databases */
+static size_t
+gdbw_put_oa(gdbw_t w, obarray_t oa, uint64_t *z)
+{
+	size_t o = 0U;
+
+	*z = obarray_dump(NULL, oa);
+	with (void *buf = malloc(*z)) {
+		if (UNLIKELY(buf == NULL)) {
+			break;
+		}
+		obarray_dump(buf, oa);
+		o = gdbw_put(w, buf, *z);
+		free(buf);
+	}
+	return o;
+}
+
+static size_t
+gdbw_put_pidx(gdbw_t w, glod_pats_t g, uint64_t *n)
+{
+/* store the indices of the patterns in subset G */
+	uint32_t *pidx = malloc(g->npats * sizeof(*pidx) + 1U);
+	size_t o;
+
+	if (UNLIKELY(pidx == NULL)) {
+		return 0U;
+	}
+	for (size_t i = 0U; i < g->npats; i++) {
+		pidx[i] = g->pats[i].idx;
+	}
+	*n = g->npats;
+	o = gdbw_put(w, pidx, g->npats * sizeof(*pidx));
+	free(pidx);
+	return o;
+}
+
+static int
+glep_wr(glepcc_t cc, const char *fn)
+{
+/* serialise CC into database FN */
+	const glod_pats_t g = cc->orig;
+	struct gdbroot_s r = {.npats = g->npats};
+	gdbw_t w;
+	int rc = -1;
+
+	if (UNLIKELY((w = make_gdbw()) == NULL)) {
+		return -1;
+	}
+	r.oa_pat = gdbw_put_oa(w, g->oa_pat, &r.oa_patz);
+	r.oa_yld = gdbw_put_oa(w, g->oa_yld, &r.oa_yldz);
+	if (UNLIKELY(!r.oa_pat || !r.oa_yld)) {
+		goto out;
+	}
+	with (struct gdbpat_s *p = malloc(g->npats * sizeof(*p) + 1U)) {
+		if (UNLIKELY(p == NULL)) {
+			goto out;
+		}
+		for (size_t i = 0U; i < g->npats; i++) {
+			p[i] = (struct gdbpat_s){
+				g->pats[i].fl.u, g->pats[i].n, g->pats[i].y,
+			};
+		}
+		r.pats = gdbw_put(w, p, g->npats * sizeof(*p));
+		free(p);
+	}
+	if (UNLIKELY(!r.pats)) {
+		goto out;
+	}
+
+	if (cc->glep_simd_cc != NULL &&
+	    UNLIKELY(!(r.glep_simd = glep_simd_wr(w, cc->glep_simd_cc)))) {
+		goto out;
+	}
+	if (cc->wu_manber_cc != NULL &&
+	    (UNLIKELY(!(r.wu_manber = wu_manber_wr(w, cc->wu_manber_cc))) ||
+	     UNLIKELY(!(r.wu_manber_pidx =
+			gdbw_put_pidx(w, cc->wu_manber, &r.nwu_manber))))) {
+		goto out;
+	}
+	if (cc->rabin_karp_cc != NULL &&
+	    (UNLIKELY(!(r.rabin_karp = rabin_karp_wr(w, cc->rabin_karp_cc))) ||
+	     UNLIKELY(!(r.rabin_karp_pidx =
+			gdbw_put_pidx(w, cc->rabin_karp, &r.nrabin_karp))))) {
+		goto out;
+	}
+	if (cc->aho_corasick_cc != NULL &&
+	    UNLIKELY(!(r.aho_corasick =
+		       aho_corasick_wr(w, cc->aho_corasick_cc)))) {
+		goto out;
+	}
+
+	with (size_t root = gdbw_put(w, &r, sizeof(r))) {
+		if (LIKELY(root)) {
+			rc = gdbw_write(w, root, fn);
+		}
+	}
+out:
+	free_gdbw(w);
+	return rc;
+}
+
+static glod_pats_t
+gdb_get_pidx(gdb_t d, size_t o, size_t n, glod_pats_t g)
+{
+/* reassemble the subset of G whose N indices are stored at O */
+	const uint32_t *pidx = gdb_get(d, o, n * sizeof(*pidx));
+	struct glod_pats_s *res;
+
+	if (UNLIKELY(pidx == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((res = malloc(sizeof(*res) +
+					  n * sizeof(*res->pats))) == NULL)) {
+		return NULL;
+	}
+	/* just like glod_pats_filter() minus the interning */
+	res->oa_pat = NULL;
+	res->oa_yld = g->oa_yld;
+	res->npats = 0U;
+	for (size_t i = 0U; i < n; i++) {
+		if (UNLIKELY(pidx[i] >= g->npats)) {
+			free(res);
+			return NULL;
+		}
+		res->pats[res->npats++] = g->pats[pidx[i]];
+	}
+	return res;
+}
+
+static glepcc_t
+glep_rd(const char *fn)
+{
+/* load compiled patterns from database FN, engine tables are used in
+ * place, only the pattern descriptors are reassembled */
+	const struct gdbroot_s *r;
+	const struct gdbpat_s *p;
+	struct glod_pats_s *g;
+	struct glepcc_s *res;
+	gdb_t d;
+
+	if (UNLIKELY((d = gdb_open(fn)) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((r = gdb_get(d, gdb_root(d), sizeof(*r))) == NULL)) {
+		goto clo;
+	} else if (UNLIKELY((p = gdb_get(d, r->pats,
+					 r->npats * sizeof(*p))) == NULL)) {
+		goto clo;
+	} else if (UNLIKELY((res = calloc(1, sizeof(*res))) == NULL)) {
+		goto clo;
+	}
+	res->db = d;
+	g = malloc(sizeof(*g) + r->npats * sizeof(*g->pats));
+	if (UNLIKELY((res->orig = g) == NULL)) {
+		goto bugger;
+	}
+	g->npats = r->npats;
+	g->oa_pat = obarray_load(gdb_get(d, r->oa_pat, r->oa_patz), r->oa_patz);
+	g->oa_yld = obarray_load(gdb_get(d, r->oa_yld, r->oa_yldz), r->oa_yldz);
+	if (UNLIKELY(g->oa_pat == NULL || g->oa_yld == NULL)) {
+		goto bugger;
+	}
+	/* materialise pattern strings */
+	for (size_t i = 0U; i < g->npats; i++) {
+		g->pats[i] = (struct glod_pat_s){
+			.fl.u = p[i].fl,
+			.n = p[i].n,
+			.p = obint_name(g->oa_pat, i + 1U),
+			.y = p[i].y,
+			.idx = (unsigned int)i,
+		};
+		if (UNLIKELY(g->pats[i].p == NULL)) {
+			goto bugger;
+		}
+	}
+
+	if (r->glep_simd &&
+	    UNLIKELY((res->glep_simd_cc = glep_simd_rd(d, r->glep_simd)) == NULL)) {
+		goto bugger;
+	}
+	if (r->wu_manber &&
+	    (UNLIKELY((res->wu_manber = gdb_get_pidx(
+			       d, r->wu_manber_pidx, r->nwu_manber, g)) == NULL) ||
+	     UNLIKELY((res->wu_manber_cc = wu_manber_rd(
+			       d, r->wu_manber, res->wu_manber)) == NULL))) {
+		goto bugger;
+	}
+	if (r->rabin_karp &&
+	    (UNLIKELY((res->rabin_karp = gdb_get_pidx(
+			       d, r->rabin_karp_pidx, r->nrabin_karp, g)) == NULL) ||
+	     UNLIKELY((res->rabin_karp_cc = rabin_karp_rd(
+			       d, r->rabin_karp, res->rabin_karp)) == NULL))) {
+		goto bugger;
+	}
+	if (r->aho_corasick &&
+	    UNLIKELY((res->aho_corasick_cc =
+		      aho_corasick_rd(d, r->aho_corasick, g)) == NULL)) {
+		goto bugger;
+	}
+	return res;
+
+bugger:
+	glep_fr(res);
+	if (g != NULL) {
+		glod_free_pats(g);
+	}
+	free(res);
+	return NULL;
+clo:
+	gdb_close(d);
+	return NULL;
+}
+
 
+static void
+pr_plan(glepcc_t cc)
+{
+/* print how patterns were split among the engines */
+	const struct {
+		const char *name;
+		glod_pats_t pats;
+	} eng[] = {
+		{"simd", cc->glep_simd},
+		{"wu-manber", cc->wu_manber},
+		{"rabin-karp", cc->rabin_karp},
+	};
+
+	if (cc->aho_corasick_cc != NULL) {
+		fprintf(stderr, "planner\taho-corasick\t%zu\n", cc->orig->npats);
+		return;
+	}
+	for (size_t i = 0U; i < countof(eng); i++) {
+		if (eng[i].pats != NULL) {
+			fprintf(stderr, "planner\t%s\t%zu\n",
+				eng[i].name, eng[i].pats->npats);
+		}
+	}
+	if (cc->plan.cost) {
+		fprintf(stderr, "planner\tcost\t%zu\n", cc->plan.cost);
+	}
+	return;
+}
+
+static int
+pst_cmp(const void *a, const void *b)
+{
+/* order pattern indices by verifications, then matches, descending */
+	const struct gpst_s x = pat_stats[*(const size_t*)a];
+	const struct gpst_s y = pat_stats[*(const size_t*)b];
+
+	if (x.nvrfy != y.nvrfy) {
+		return (x.nvrfy < y.nvrfy) - (x.nvrfy > y.nvrfy);
+	}
+	return (x.nmtch < y.nmtch) - (x.nmtch > y.nmtch);
+}
+
+static void
+pr_stats(glepcc_t cc)
+{
+/* print the hot path counters and timings gathered during the scan */
+	static const char *const name[NENGINES] = {
+		[EST_SIMD] = "simd",
+		[EST_WM] = "wu-manber",
+		[EST_RK] = "rabin-karp",
+		[EST_AC] = "aho-corasick",
+	};
+
+	fprintf(stderr, "io\treads\t%" PRIu64 "\n", hstat.nread);
+	fprintf(stderr, "io\tswitches\t%" PRIu64 "\n", hstat.nswtch);
+	if (hstat.nchit || hstat.ncmiss) {
+		fprintf(stderr, "cache\thits\t%" PRIu64 "\n", hstat.nchit);
+		fprintf(stderr, "cache\tmisses\t%" PRIu64 "\n", hstat.ncmiss);
+	}
+	for (size_t i = 0U; i < NENGINES; i++) {
+		const struct estat_s e = cc->est[i];
+
+		if (!e.ncall) {
+			continue;
+		}
+		fprintf(stderr, "engine\t%s\tcalls\t%" PRIu64 "\n",
+			name[i], e.ncall);
+		fprintf(stderr, "engine\t%s\tbytes\t%" PRIu64 "\n",
+			name[i], e.nbyte);
+		fprintf(stderr, "engine\t%s\ttime\t%" PRIu64 "ns\n",
+			name[i], e.nsec);
+		fprintf(stderr, "engine\t%s\tmatches\t%" PRIu64 "\n",
+			name[i], e.nmtch);
+		fprintf(stderr, "engine\t%s\tthroughput\t%.1fMB/s\n",
+			name[i], (double)(1000U * e.nbyte) /
+			(double)(e.nsec + !e.nsec));
+	}
+	if (cc->glep_simd_cc != NULL) {
+		glep_simd_stats(cc->glep_simd_cc);
+	}
+	if (cc->rabin_karp_cc != NULL) {
+		rabin_karp_stats(cc->rabin_karp_cc);
+	}
+	return;
+}
+
+static void
+pr_pat_stats(glepcc_t cc, size_t n)
+{
+/* print the N patterns most often verified */
+	const size_t npats = cc->orig->npats;
+	size_t *ix;
+
+	if (UNLIKELY((ix = malloc(npats * sizeof(*ix))) == NULL)) {
+		return;
+	}
+	for (size_t i = 0U; i < npats; i++) {
+		ix[i] = i;
+	}
+	qsort(ix, npats, sizeof(*ix), pst_cmp);
+	for (size_t k = 0U; k < n && k < npats; k++) {
+		const size_t i = ix[k];
+
+		if (!pat_stats[i].nvrfy && !pat_stats[i].nmtch) {
+			break;
+		}
+		fprintf(stderr, "pattern\t%s\t%" PRIu64 "\t%" PRIu64 "\n",
+			cc->orig->pats[i].p,
+			pat_stats[i].nvrfy, pat_stats[i].nmtch);
+	}
+	free(ix);
+	return;
+}
+
 #define yuck_post_help		glep_dsptch_nfo
 #define yuck_post_version	glep_dsptch_nfo
 #include "glep.yucc"
@@ -410,20 +2841,63 @@ main(int argc, char *argv[])
 {
 	yuck_t argi[1U];
 	glod_pats_t pf;
-	glepcc_t cc;
+	glepcc_t cc = NULL;
 	int rc = 0;
+	/* glep index is glep with --index naming the index to build */
+	const bool index_p = argc > 1 && !strcmp(argv[1U], "index");
 
+	if (index_p) {
+		argv[1U] = argv[0U];
+		argv++;
+		argc--;
+	}
 	if (yuck_parse(argi, argc, argv)) {
-		rc = 1;
+		rc = 2;
+		goto out;
+	}
+	/* -r's globs, glep index walks by them too */
+	includes = argi->include_args;
+	nincludes = argi->include_nargs;
+	excludes = argi->exclude_args;
+	nexcludes = argi->exclude_nargs;
+	exclude_dirs = argi->exclude_dir_args;
+	nexclude_dirs = argi->exclude_dir_nargs;
+	if (index_p) {
+		if (argi->index_arg == NULL) {
+			error("Error: glep index needs an --index directory");
+			rc = 2;
+		} else if (glep_index(argi->index_arg,
+				      argi->args, argi->nargs) < 0) {
+			rc = 2;
+		}
+		goto out;
+	} else if (argi->connect_arg != NULL) {
+		/* the server has the patterns already */
+		if (gserve_connect(argi->connect_arg,
+				   argi->args, argi->nargs, stdin_fn) < 0) {
+			rc = 2;
+		}
 		goto out;
+	} else if (argi->database_arg != NULL && !argi->compile_flag) {
+		if ((cc = glep_rd(argi->database_arg)) == NULL) {
+			error("Error: cannot read pattern database `%s'",
+			      argi->database_arg);
+			rc = 2;
+			goto out;
+		}
+		pf = cc->orig;
 	} else if (argi->pattern_file_arg == NULL) {
 		error("Error: -f|--pattern-file argument is mandatory");
-		rc = 1;
+		rc = 2;
+		goto out;
+	} else if (argi->compile_flag && argi->output_arg == NULL) {
+		error("Error: --compile needs an -o|--output file");
+		rc = 2;
 		goto out;
 	} else if ((pf = glod_read_pats(argi->pattern_file_arg)) == NULL) {
 		error("Error: cannot read pattern file `%s'",
 		      argi->pattern_file_arg);
-		rc = 1;
+		rc = 2;
 		goto out;
 	}
 
@@ -439,41 +2913,265 @@ main(int argc, char *argv[])
 	if (argi->non_ascii_wordsep_flag) {
 		non_ascii_wordsep_p = true;
 	}
+	if (argi->engine_stats_flag) {
+		engine_stats_p = true;
+	}
+	if (argi->stats_patterns_arg) {
+		char *on;
+
+		if (!(stats_npats = strtoul(argi->stats_patterns_arg, &on, 10)) ||
+		    *on) {
+			error("Error: invalid number of patterns `%s'",
+			      argi->stats_patterns_arg);
+			rc = 2;
+			goto fr_gl;
+		}
+		stats_p = 1;
+	}
+	if (argi->stats_flag || stats_p) {
+		stats_p = 1;
+		engine_stats_p = true;
+	}
+	if (argi->engine_arg == NULL || !strcmp(argi->engine_arg, "auto")) {
+		engine = ENGINE_AUTO;
+	} else if (!strcmp(argi->engine_arg, "simd")) {
+		engine = ENGINE_SIMD;
+	} else if (!strcmp(argi->engine_arg, "wm")) {
+		engine = ENGINE_WM;
+	} else if (!strcmp(argi->engine_arg, "rk")) {
+		engine = ENGINE_RK;
+	} else {
+		error("Error: unknown engine `%s'", argi->engine_arg);
+		rc = 2;
+		goto fr_gl;
+	}
+	if (argi->split_flag) {
+		split_p = 1;
+	}
+	if (argi->max_count_arg) {
+		char *on;
+
+		if (!(max_count = strtoul(argi->max_count_arg, &on, 10)) ||
+		    *on) {
+			error("Error: invalid number of matches `%s'",
+			      argi->max_count_arg);
+			rc = 2;
+			goto fr_gl;
+		}
+	}
+	if (argi->record_separator_arg) {
+		if ((rsep = parse_rsep(argi->record_separator_arg)) < 0) {
+			error("Error: invalid record separator `%s'",
+			      argi->record_separator_arg);
+			rc = 2;
+			goto fr_gl;
+		}
+	}
+	if (argi->files_with_matches_flag) {
+		/* the first match decides, unless there's records */
+		list_p = 1;
+		max_count = rsep < 0 ? 1U : max_count;
+	}
+	if (argi->quiet_flag) {
+		quiet_p = 1;
+		max_count = 1U;
+	}
+	if (argi->byte_offset_flag) {
+		offset_p = 1;
+	}
+	if (argi->line_number_flag) {
+		lineno_p = 1;
+	}
+	if (argi->no_decompress_flag) {
+		unpack_p = 0;
+	}
+	if (argi->recursive_flag) {
+		recursive_p = 1;
+	}
+	if (offset_p || lineno_p) {
+		/* offsets and line numbers want files in order */
+		split_p = 0;
+	} else if (argi->nargs != 1U || recursive_p ||
+		   argi->index_arg != NULL || argi->serve_arg != NULL) {
+		/* several files keep the workers busy as is, splitting
+		 * them on top would just oversubscribe the CPUs */
+		split_p = 0;
+	}
+	if (argi->format_arg == NULL || !strcmp(argi->format_arg, "tsv")) {
+		out_fmt = FMT_TSV;
+	} else if (!strcmp(argi->format_arg, "jsonl")) {
+		out_fmt = FMT_JSONL;
+	} else if (!strcmp(argi->format_arg, "bin") &&
+		   !offset_p && !lineno_p) {
+		out_fmt = FMT_BIN;
+	} else if (!strcmp(argi->format_arg, "bin")) {
+		error("Error: binary output has no room for -b or -n");
+		rc = 2;
+		goto fr_gl;
+	} else {
+		error("Error: unknown output format `%s'", argi->format_arg);
+		rc = 2;
+		goto fr_gl;
+	}
+	out_init(STDOUT_FILENO);
+	if (argi->io_depth_arg) {
+		char *on;
+
+		if ((io_depth = strtoul(argi->io_depth_arg, &on, 10)) > 4096U ||
+		    *on) {
+			error("Error: invalid io depth `%s'",
+			      argi->io_depth_arg);
+			rc = 2;
+			goto fr_gl;
+		}
+	}
+	if (argi->jobs_arg) {
+		char *on;
+
+		if (!(njobs = strtoul(argi->jobs_arg, &on, 10)) && !*on) {
+			/* one job per online cpu */
+			long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+			njobs = ncpu > 0 ? (size_t)ncpu : 1U;
+		} else if (*on || njobs > 1024U) {
+			error("Error: invalid number of jobs `%s'",
+			      argi->jobs_arg);
+			rc = 2;
+			goto fr_gl;
+		}
+	}
 
 	/* compile the patterns (opaquely) */
-	if (UNLIKELY((cc = glep_cc(pf)) == NULL)) {
+	if (cc != NULL) {
+		/* loaded from a database */
+		;
+	} else if (UNLIKELY((cc = glep_cc(pf)) == NULL)) {
 		error("Error: cannot compile patterns");
-		rc = 1;
+		rc = 2;
+		goto fr_gl;
+	} else if (argi->compile_flag) {
+		if (glep_wr(cc, argi->output_arg) < 0) {
+			error("Error: cannot write pattern database `%s'",
+			      argi->output_arg);
+			rc = 2;
+		}
+		goto fr_gl;
+	}
+
+	if (stats_npats &&
+	    UNLIKELY((pat_stats = calloc(
+			      cc->orig->npats, sizeof(*pat_stats))) == NULL)) {
+		error("Error: cannot allocate pattern statistics");
+		rc = 2;
 		goto fr_gl;
 	}
 
 	/* get the coroutines going */
 	initialise_cocore();
 
-	/* process stdin? */
-	if (!argi->nargs) {
-		if (match0(cc, STDIN_FILENO, stdin_fn) < 0) {
-			error("Error: processing stdin failed");
-			rc = 1;
+	if (argi->serve_arg != NULL) {
+		if (glep_serve(cc, argi->serve_arg) < 0) {
+			rc = 2;
 		}
-		goto fr_gl;
+		goto qt;
 	}
 
-	/* process files given on the command line */
-	for (size_t i = 0U; i < argi->nargs; i++) {
-		const char *file = argi->args[i];
-		int fd;
+	if (argi->cache_arg != NULL && out_fmt == FMT_BIN) {
+		/* file ids are handed out afresh by every run */
+		error("Error: binary output cannot be cached");
+		rc = 2;
+		goto qt;
+	} else if (argi->cache_arg != NULL &&
+		   (cache = gcache_open(argi->cache_arg,
+					cache_cookie(cc))) == NULL) {
+		error("Error: cannot open cache `%s'", argi->cache_arg);
+		rc = 2;
+		goto qt;
+	}
 
-		if (UNLIKELY((fd = open(file, O_RDONLY)) < 0)) {
-			error("Error: cannot open file `%s'", file);
-			rc = 1;
-			continue;
-		} else if (match0(cc, fd, file) < 0) {
-			error("Error: cannot process `%s'", file);
-			rc = 1;
+	if (argi->index_arg != NULL && argi->nargs) {
+		error("Error: --index scans the files of the index only");
+		rc = 2;
+		goto qt;
+	} else if (argi->index_arg != NULL) {
+		if (match_index(cc, argi->index_arg) < 0) {
+			rc = 2;
 		}
-		/* clean up */
-		close(fd);
+		goto qt;
+	} else if (recursive_p) {
+		/* the walkers feed the scanners */
+		static char *const dot[] = {"."};
+
+		if (match_par(cc, argi->nargs ? argi->args : dot,
+			      argi->nargs ? argi->nargs : 1U) < 0) {
+			rc = 2;
+		}
+		goto qt;
+	} else if (argi->nargs > 1U && (njobs > 1U || io_depth)) {
+		/* no point in having more workers than files, a single
+		 * one still gets its files opened and read ahead */
+		if (njobs > argi->nargs) {
+			njobs = argi->nargs;
+		}
+		if (match_par(cc, argi->args, argi->nargs) < 0) {
+			rc = 2;
+		}
+		goto qt;
+	}
+
+	with (struct gcnts_s c) {
+		if (UNLIKELY(make_gcnts(&c, cc) < 0)) {
+			error("Error: cannot allocate counters");
+			free_gcnts(&c);
+			rc = 2;
+			break;
+		}
+		/* process stdin? */
+		if (!argi->nargs) {
+			if (match0(&c, cc, STDIN_FILENO, stdin_fn) < 0) {
+				error("Error: processing stdin failed");
+				rc = 2;
+			}
+		}
+		/* process files given on the command line */
+		for (size_t i = 0U; i < argi->nargs && !quit_p(); i++) {
+			if (match1(&c, cc, argi->args[i]) < 0) {
+				rc = 2;
+			}
+		}
+		free_gcnts(&c);
+	}
+
+qt:
+	/* leftovers */
+	out_flush();
+	if (UNLIKELY(out_err())) {
+		errno = out_err();
+		error("Error: cannot write output");
+		rc = 2;
+	}
+	if (cache != NULL && gcache_close(cache) < 0) {
+		error("Error: cannot write cache `%s'", argi->cache_arg);
+		rc = 2;
+	}
+	cache = NULL;
+	if (engine_stats_p) {
+		pr_plan(cc);
+	}
+	if (engine_stats_p && cc->wu_manber_cc != NULL) {
+		wu_manber_stats(cc->wu_manber_cc);
+	}
+	if (stats_p) {
+		pr_stats(cc);
+	}
+	if (pat_stats != NULL) {
+		pr_pat_stats(cc, stats_npats);
+		free(pat_stats);
+		pat_stats = NULL;
+	}
+	if (quiet_p && (found_p || !rc)) {
+		/* like grep(1), a match counts even amidst errors */
+		rc = !found_p;
 	}
 
 fr_gl:
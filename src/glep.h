@@ -40,12 +40,42 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
 #include "pats.h"
 
 typedef uint_fast32_t gcnt_t;
 typedef struct glepcc_s *glepcc_t;
+typedef struct ghits_s *ghits_t;
+
+/* a match, offsets are relative to the buffer presented */
+struct ghit_s {
+	/** counter index of the pattern */
+	uint32_t idx;
+	/** offset of the start of the match */
+	uint32_t off;
+};
+
+/* hit buffer, filled by the grepping routines, emptied by the caller */
+struct ghits_s {
+	size_t n;
+	size_t z;
+	struct ghit_s *h;
+};
+
+/* per-pattern counters for --stats-patterns */
+struct gpst_s {
+	/** positions the pattern was checked at by an engine */
+	uint64_t nvrfy;
+	/** and the positions it matched at */
+	uint64_t nmtch;
+};
 
 extern bool non_ascii_wordsep_p;
+/* whether engines should keep counters for --engine-stats */
+extern bool engine_stats_p;
+/* per-pattern counters, by counter index, or NULL */
+extern struct gpst_s *pat_stats;
 
 /* maximum buffer size presented to grepping routines */
 #define CHUNKZ		(4U * 4096U)
@@ -59,11 +89,52 @@ extern bool non_ascii_wordsep_p;
 extern glepcc_t glep_cc(glod_pats_t);
 
 /**
- * Return the number of matches of C in BUF of size BSZ. */
-extern int glep_gr(gcnt_t *restrict, glepcc_t c, const char *buf, size_t bsz);
+ * Return the number of matches of C in BUF of size BSZ.
+ * If HITS is non-NULL record the matches there as well. */
+extern int glep_gr(gcnt_t *restrict, ghits_t hits,
+		   glepcc_t c, const char *buf, size_t bsz);
 
 /**
  * Finalise processing. */
 extern void glep_fr(glepcc_t);
 
+
+static inline void
+ghits_add(ghits_t h, size_t idx, size_t off)
+{
+	if (h->n >= h->z) {
+		const size_t nu = h->z ? 2U * h->z : 256U;
+		struct ghit_s *x = realloc(h->h, nu * sizeof(*x));
+
+		if (x == NULL) {
+			/* drop it */
+			return;
+		}
+		h->h = x;
+		h->z = nu;
+	}
+	h->h[h->n++] = (struct ghit_s){(uint32_t)idx, (uint32_t)off};
+	return;
+}
+
+static inline void
+gpst_vrfy(size_t idx)
+{
+/* note down that an engine checks the pattern with counter index IDX */
+	if (__builtin_expect(pat_stats != NULL, 0)) {
+		__atomic_add_fetch(&pat_stats[idx].nvrfy, 1U, __ATOMIC_RELAXED);
+	}
+	return;
+}
+
+static inline uint64_t
+glep_ns(void)
+{
+/* monotonic clock in nanoseconds, for --stats */
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec;
+}
+
 #endif	/* INCLUDED_glep_h_ */
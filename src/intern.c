@@ -80,6 +80,8 @@ struct obarray_s {
 #endif	/* ENUM_INTERNS */
 	struct vector_s *str;
 	struct vector_s *stk;
+	/* non-zero if the vectors live in memory we don't own */
+	int ro;
 };
 
 /* the beef table */
@@ -282,7 +284,13 @@ intern(obarray_t oa, const char *str, size_t len)
 			return sstk[off].ob;
 		} else if (!sstk[off].ob) {
 			/* found empty slot */
-			obint_t ob = make_obint(&oa->str, str, len);
+			obint_t ob;
+
+			if (UNLIKELY(oa->ro)) {
+				/* can't intern into a loaded obarray */
+				return 0U;
+			}
+			ob = make_obint(&oa->str, str, len);
 
 #if defined ENUM_INTERNS
 			ob = bang_obint(&oa->cnt, ob);
@@ -300,6 +308,11 @@ intern(obarray_t oa, const char *str, size_t len)
 
 		if (UNLIKELY(i >= zstk)) {
 			const size_t nu = i << 2U;
+
+			if (UNLIKELY(oa->ro)) {
+				/* not in here then */
+				break;
+			}
 			oa->stk = resz_vector(oa->stk, nu, obcell_t);
 
 			if (UNLIKELY(oa->stk == NULL)) {
@@ -317,7 +330,13 @@ intern(obarray_t oa, const char *str, size_t len)
 				return sstk[off].ob;
 			} else if (!sstk[off].ob) {
 				/* found empty slot */
-				obint_t ob = make_obint(&oa->str, str, len);
+				obint_t ob;
+
+				if (UNLIKELY(oa->ro)) {
+					/* can't intern into a loaded obarray */
+					return 0U;
+				}
+				ob = make_obint(&oa->str, str, len);
 
 #if defined ENUM_INTERNS
 				ob = bang_obint(&oa->cnt, ob);
@@ -365,20 +384,28 @@ clear_interns(obarray_t oa)
 	if (oa == NULL) {
 		oa = &dflt;
 	}
+	if (UNLIKELY(oa->ro)) {
+		/* not ours to free */
+		goto out;
+	}
 #if defined ENUM_INTERNS
 	if (LIKELY(oa->cnt != NULL)) {
 		free_vector(oa->cnt, obint_t);
 	}
-	oa->cnt = NULL;
 #endif	/* ENUM_INTERNS */
 	if (LIKELY(oa->stk != NULL)) {
 		free_vector(oa->stk, obcell_t);
 	}
-	oa->stk = NULL;
 	if (LIKELY(oa->str != NULL)) {
 		free_vector(oa->str, char);
 	}
+out:
+#if defined ENUM_INTERNS
+	oa->cnt = NULL;
+#endif	/* ENUM_INTERNS */
+	oa->stk = NULL;
 	oa->str = NULL;
+	oa->ro = 0;
 	return;
 }
 
@@ -419,4 +446,115 @@ ninterns(obarray_t oa)
 #endif	/* ENUM_INTERNS */
 }
 
+
+/* serialisation */
+static size_t
+dump_vector(char *restrict tgt, const struct vector_s *v, size_t n, size_t z)
+{
+/* serialise the first N elements (of size Z) of V to TGT, if non-NULL,
+ * return the number of bytes (needed) */
+	const size_t hz = offsetof(struct vector_s, beef);
+	const size_t res = (hz + n * z + 15U) / 16U * 16U;
+
+	if (v == NULL) {
+		return 0U;
+	} else if (tgt == NULL) {
+		return res;
+	}
+	memcpy(tgt, v, hz + n * z);
+	memset(tgt + hz + n * z, 0, res - hz - n * z);
+	/* loaded vectors don't grow, so trim them */
+	with (struct vector_s *tv = (void*)tgt) {
+		tv->obz = n;
+	}
+	return res;
+}
+
+static struct vector_s*
+load_vector(const char *buf, size_t bsz, size_t z)
+{
+	const size_t hz = offsetof(struct vector_s, beef);
+	const struct vector_s *v = (const void*)buf;
+
+	if (!bsz) {
+		return NULL;
+	} else if (UNLIKELY(bsz < hz || v->obz > (bsz - hz) / z)) {
+		/* doesn't look like a vector */
+		return NULL;
+	}
+	return deconst(v);
+}
+
+size_t
+obarray_dump(void *restrict buf, obarray_t oa)
+{
+	char *tgt = buf;
+	uint64_t z[3U];
+
+	if (oa == NULL) {
+		oa = &dflt;
+	}
+#if defined ENUM_INTERNS
+	z[0U] = dump_vector(NULL, oa->cnt,
+			    oa->cnt ? oa->cnt->obn : 0U, sizeof(obint_t));
+#else  /* !ENUM_INTERNS */
+	z[0U] = 0U;
+#endif	/* ENUM_INTERNS */
+	z[1U] = dump_vector(NULL, oa->str,
+			    oa->str ? oa->str->obn : 0U, sizeof(char));
+	/* the probe stack is needed in full */
+	z[2U] = dump_vector(NULL, oa->stk,
+			    oa->stk ? oa->stk->obz : 0U, sizeof(obcell_t));
+
+	if (tgt == NULL) {
+		return sizeof(z) + z[0U] + z[1U] + z[2U];
+	}
+	memcpy(tgt, z, sizeof(z));
+	tgt += sizeof(z);
+#if defined ENUM_INTERNS
+	tgt += dump_vector(tgt, oa->cnt,
+			   oa->cnt ? oa->cnt->obn : 0U, sizeof(obint_t));
+#endif	/* ENUM_INTERNS */
+	tgt += dump_vector(tgt, oa->str,
+			   oa->str ? oa->str->obn : 0U, sizeof(char));
+	tgt += dump_vector(tgt, oa->stk,
+			   oa->stk ? oa->stk->obz : 0U, sizeof(obcell_t));
+	return tgt - (char*)buf;
+}
+
+obarray_t
+obarray_load(const void *buf, size_t bsz)
+{
+	const char *bp = buf;
+	uint64_t z[3U];
+	obarray_t res;
+
+	if (UNLIKELY(bp == NULL || bsz < sizeof(z))) {
+		return NULL;
+	}
+	memcpy(z, bp, sizeof(z));
+	bp += sizeof(z);
+	bsz -= sizeof(z);
+	if (UNLIKELY(z[0U] > bsz || z[1U] > bsz - z[0U] ||
+		     z[2U] > bsz - z[0U] - z[1U])) {
+		return NULL;
+	}
+#if !defined ENUM_INTERNS
+	if (UNLIKELY(z[0U])) {
+		/* written by an enumerating obarray */
+		return NULL;
+	}
+#endif	/* !ENUM_INTERNS */
+	if (UNLIKELY((res = make_obarray()) == NULL)) {
+		return NULL;
+	}
+#if defined ENUM_INTERNS
+	res->cnt = load_vector(bp, z[0U], sizeof(obint_t));
+#endif	/* ENUM_INTERNS */
+	res->str = load_vector(bp + z[0U], z[1U], sizeof(char));
+	res->stk = load_vector(bp + z[0U] + z[1U], z[2U], sizeof(obcell_t));
+	res->ro = 1;
+	return res;
+}
+
 /* intern.c ends here */
@@ -82,4 +82,15 @@ extern void clear_interns(obarray_t);
  * Note, this is only accurate when ENUM_INTERNS is defined. */
 extern size_t ninterns(obarray_t);
 
+/**
+ * Serialise OA into BUF, return the number of bytes written.
+ * If BUF is NULL just return the number of bytes needed. */
+extern size_t obarray_dump(void *restrict buf, obarray_t oa);
+
+/**
+ * Return an obarray backed by the serialisation in BUF of size BSZ.
+ * BUF must be suitably aligned and stay valid as long as the obarray
+ * is used, strings cannot be interned into loaded obarrays. */
+extern obarray_t obarray_load(const void *buf, size_t bsz);
+
 #endif	/* INCLUDED_intern_h_ */
@@ -0,0 +1,343 @@
+/*** unpack.c -- decompression of gzip, xz and zstd streams
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#if defined HAVE_ZLIB
+# include <zlib.h>
+#endif	/* HAVE_ZLIB */
+#if defined HAVE_LZMA
+# include <lzma.h>
+#endif	/* HAVE_LZMA */
+#if defined HAVE_ZSTD
+# include <zstd.h>
+#endif	/* HAVE_ZSTD */
+#include "unpack.h"
+#include "nifty.h"
+
+/* size of the input and output buffers */
+#define BUFZ	(128U * 1024U)
+
+/* errno for input the decoders reject, corrupt or truncated */
+#define EDATA	EBADMSG
+
+/* state shared by all formats */
+struct unpack_s {
+	int fd;
+	int ofd;
+	/* input not yet read into IBUF */
+	const uint8_t *pre;
+	size_t prez;
+	uint8_t *ibuf;
+	uint8_t *obuf;
+};
+
+
+static ssize_t
+fill(struct unpack_s *u)
+{
+/* fill the input buffer, from the pre-read octets first */
+	ssize_t nrd;
+
+	if (u->prez) {
+		nrd = u->prez < BUFZ ? u->prez : BUFZ;
+		memcpy(u->ibuf, u->pre, nrd);
+		u->pre += nrd;
+		u->prez -= nrd;
+		return nrd;
+	}
+	while ((nrd = read(u->fd, u->ibuf, BUFZ)) < 0 && errno == EINTR);
+	return nrd;
+}
+
+static int
+flush(struct unpack_s *u, size_t z)
+{
+/* write the first Z octets of the output buffer */
+	for (size_t o = 0U; o < z;) {
+		ssize_t nwr = write(u->ofd, u->obuf + o, z - o);
+
+		if (UNLIKELY(nwr < 0 && errno == EINTR)) {
+			continue;
+		} else if (UNLIKELY(nwr <= 0)) {
+			return -1;
+		}
+		o += nwr;
+	}
+	return 0;
+}
+
+#if defined HAVE_ZLIB
+static int
+unpack_gzip(struct unpack_s *u)
+{
+/* gzip files may consist of several members, each one gets its own
+ * round of inflating */
+	z_stream z = {.next_in = NULL};
+	ssize_t nrd;
+	int rc = Z_OK;
+
+	/* 32 to auto-detect gzip or zlib headers */
+	if (UNLIKELY(inflateInit2(&z, 15 + 32) != Z_OK)) {
+		errno = ENOMEM;
+		return -1;
+	}
+	do {
+		if (UNLIKELY((nrd = fill(u)) < 0)) {
+			break;
+		}
+		z.next_in = u->ibuf;
+		z.avail_in = nrd;
+		/* inflate till the input's used up and the output drained */
+		do {
+			if (rc == Z_STREAM_END && z.avail_in) {
+				/* next member */
+				inflateReset(&z);
+			}
+			z.next_out = u->obuf;
+			z.avail_out = BUFZ;
+			rc = inflate(&z, Z_NO_FLUSH);
+			if (UNLIKELY(rc != Z_OK && rc != Z_STREAM_END &&
+				     rc != Z_BUF_ERROR)) {
+				errno = rc == Z_MEM_ERROR ? ENOMEM : EDATA;
+				nrd = -1;
+				break;
+			} else if (flush(u, BUFZ - z.avail_out) < 0) {
+				nrd = -1;
+				break;
+			}
+		} while (!z.avail_out || (rc == Z_STREAM_END && z.avail_in));
+	} while (nrd > 0);
+	inflateEnd(&z);
+	if (nrd < 0) {
+		return -1;
+	} else if (rc != Z_STREAM_END) {
+		/* truncated */
+		errno = EDATA;
+		return -1;
+	}
+	return 0;
+}
+#endif	/* HAVE_ZLIB */
+
+#if defined HAVE_LZMA
+static int
+unpack_xz(struct unpack_s *u)
+{
+	lzma_stream z = LZMA_STREAM_INIT;
+	lzma_action act = LZMA_RUN;
+	lzma_ret rc = LZMA_OK;
+	int res = 0;
+
+	if (UNLIKELY(lzma_stream_decoder(
+			     &z, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)) {
+		errno = ENOMEM;
+		return -1;
+	}
+	do {
+		if (!z.avail_in && act == LZMA_RUN) {
+			ssize_t nrd = fill(u);
+
+			if (UNLIKELY(nrd < 0)) {
+				res = -1;
+				break;
+			} else if (!nrd) {
+				/* no more streams */
+				act = LZMA_FINISH;
+			}
+			z.next_in = u->ibuf;
+			z.avail_in = nrd;
+		}
+		z.next_out = u->obuf;
+		z.avail_out = BUFZ;
+		rc = lzma_code(&z, act);
+		if (flush(u, BUFZ - z.avail_out) < 0) {
+			res = -1;
+			break;
+		}
+	} while (rc == LZMA_OK);
+	lzma_end(&z);
+	if (res < 0) {
+		return -1;
+	} else if (rc != LZMA_STREAM_END) {
+		errno = rc == LZMA_MEM_ERROR ? ENOMEM : EDATA;
+		return -1;
+	}
+	return 0;
+}
+#endif	/* HAVE_LZMA */
+
+#if defined HAVE_ZSTD
+static int
+unpack_zstd(struct unpack_s *u)
+{
+	ZSTD_DStream *z;
+	ZSTD_inBuffer in = {.src = u->ibuf};
+	ssize_t nrd;
+	/* 0 when the last frame is complete */
+	size_t rc = 0U;
+
+	if (UNLIKELY((z = ZSTD_createDStream()) == NULL)) {
+		errno = ENOMEM;
+		return -1;
+	}
+	while ((nrd = fill(u)) > 0) {
+		ZSTD_outBuffer out = {.dst = u->obuf, .size = BUFZ};
+
+		in.size = nrd;
+		in.pos = 0U;
+		/* a full output buffer means there might be more */
+		while (in.pos < in.size || out.pos == out.size) {
+			out.pos = 0U;
+			rc = ZSTD_decompressStream(z, &out, &in);
+			if (UNLIKELY(ZSTD_isError(rc))) {
+				errno = EDATA;
+				nrd = -1;
+				goto out;
+			} else if (flush(u, out.pos) < 0) {
+				nrd = -1;
+				goto out;
+			}
+		}
+	}
+out:
+	ZSTD_freeDStream(z);
+	if (nrd < 0) {
+		return -1;
+	} else if (rc) {
+		/* truncated */
+		errno = EDATA;
+		return -1;
+	}
+	return 0;
+}
+#endif	/* HAVE_ZSTD */
+
+
+unpack_fmt_t
+unpack_sniff(const void *buf, size_t z)
+{
+	const uint8_t *b = buf;
+
+	if (0) {
+		;
+#if defined HAVE_ZLIB
+	} else if (z >= 2U && b[0U] == 0x1fU && b[1U] == 0x8bU) {
+		return UNPACK_GZIP;
+#endif	/* HAVE_ZLIB */
+#if defined HAVE_LZMA
+	} else if (z >= 6U && !memcmp(b, "\xfd" "7zXZ\0", 6U)) {
+		return UNPACK_XZ;
+#endif	/* HAVE_LZMA */
+#if defined HAVE_ZSTD
+	} else if (z >= 4U && !memcmp(b, "\x28\xb5\x2f\xfd", 4U)) {
+		return UNPACK_ZSTD;
+#endif	/* HAVE_ZSTD */
+	}
+	(void)b;
+	return UNPACK_NONE;
+}
+
+const char*
+unpack_unsupp(const void *buf, size_t z)
+{
+	const uint8_t *b = buf;
+
+	if (0) {
+		;
+#if !defined HAVE_ZLIB
+	} else if (z >= 2U && b[0U] == 0x1fU && b[1U] == 0x8bU) {
+		return "gzip";
+#endif	/* !HAVE_ZLIB */
+#if !defined HAVE_LZMA
+	} else if (z >= 6U && !memcmp(b, "\xfd" "7zXZ\0", 6U)) {
+		return "xz";
+#endif	/* !HAVE_LZMA */
+#if !defined HAVE_ZSTD
+	} else if (z >= 4U && !memcmp(b, "\x28\xb5\x2f\xfd", 4U)) {
+		return "zstd";
+#endif	/* !HAVE_ZSTD */
+	}
+	(void)b;
+	return NULL;
+}
+
+int
+unpack_fd(int ofd, int fd, unpack_fmt_t fmt, const void *pre, size_t prez)
+{
+	struct unpack_s u = {
+		.fd = fd, .ofd = ofd,
+		.pre = pre, .prez = prez,
+	};
+	int rc = -1;
+
+	if (UNLIKELY((u.ibuf = malloc(2U * BUFZ)) == NULL)) {
+		return -1;
+	}
+	u.obuf = u.ibuf + BUFZ;
+
+	switch (fmt) {
+#if defined HAVE_ZLIB
+	case UNPACK_GZIP:
+		rc = unpack_gzip(&u);
+		break;
+#endif	/* HAVE_ZLIB */
+#if defined HAVE_LZMA
+	case UNPACK_XZ:
+		rc = unpack_xz(&u);
+		break;
+#endif	/* HAVE_LZMA */
+#if defined HAVE_ZSTD
+	case UNPACK_ZSTD:
+		rc = unpack_zstd(&u);
+		break;
+#endif	/* HAVE_ZSTD */
+	default:
+		errno = EINVAL;
+		break;
+	}
+	free(u.ibuf);
+	return rc;
+}
+
+/* unpack.c ends here */
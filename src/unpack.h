@@ -0,0 +1,75 @@
+/*** unpack.h -- decompression of gzip, xz and zstd streams
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_unpack_h_
+#define INCLUDED_unpack_h_
+
+#include <stddef.h>
+
+/**
+ * Compression formats, only those we've got a decompressor for. */
+typedef enum {
+	UNPACK_NONE,
+	UNPACK_GZIP,
+	UNPACK_XZ,
+	UNPACK_ZSTD,
+} unpack_fmt_t;
+
+/* number of leading octets unpack_sniff() wants to see */
+#define UNPACK_MAGICZ	(6U)
+
+
+/**
+ * Return the compression format of a stream beginning with BUF of
+ * size Z, as told by its magic bytes, or UNPACK_NONE if the format
+ * isn't one we can decompress. */
+extern unpack_fmt_t unpack_sniff(const void *buf, size_t z);
+
+/**
+ * Return the name of the compression format of a stream beginning with
+ * BUF of size Z if it is one unpack_sniff() can't tell for lack of a
+ * decompressor in this build, NULL otherwise. */
+extern const char *unpack_unsupp(const void *buf, size_t z);
+
+/**
+ * Decompress the FMT stream read from FD, the first PREZ octets of
+ * which have been read into PRE already, and write the result to OFD.
+ * Return 0 on success and -1 otherwise with errno set if possible,
+ * in particular EPIPE if OFD has been closed on the other end. */
+extern int unpack_fd(int ofd, int fd, unpack_fmt_t fmt,
+		     const void *pre, size_t prez);
+
+#endif	/* INCLUDED_unpack_h_ */
@@ -0,0 +1,405 @@
+/*** uring.c -- batched opens and reads
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#if defined HAVE_LINUX_IO_URING_H
+# include <linux/io_uring.h>
+# include <sys/syscall.h>
+# if defined __NR_io_uring_setup && defined __NR_io_uring_enter && \
+	defined __NR_io_uring_register
+#  define WITH_IO_URING
+# endif
+#endif	/* HAVE_LINUX_IO_URING_H */
+#include "uring.h"
+#include "nifty.h"
+
+#if defined WITH_IO_URING
+/* where a file is at */
+typedef enum {
+	ST_FREE,
+	ST_OPENING,
+	ST_READING,
+	ST_LANDED,
+} slot_st_t;
+
+struct slot_s {
+	struct uring_file_s f;
+	slot_st_t st;
+};
+
+struct uring_s {
+	int fd;
+	size_t depth;
+	size_t smallz;
+	/* files go in at TAIL and come out at HEAD, both count upwards */
+	size_t head;
+	size_t tail;
+	struct slot_s *slots;
+	char *bufs;
+
+	/* the kernel's rings */
+	void *sqr;
+	size_t sqrz;
+	void *cqr;
+	size_t cqrz;
+	struct io_uring_sqe *sqes;
+	size_t sqesz;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int cq_mask;
+	struct io_uring_cqe *cqes;
+	/* entries prepared but not submitted */
+	unsigned int nprep;
+};
+
+
+static int
+probe_ops(int fd)
+{
+/* check if the kernel knows how to open and read */
+	const size_t z = sizeof(struct io_uring_probe) +
+		256U * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *p;
+	int rc = -1;
+
+	if (UNLIKELY((p = calloc(1U, z)) == NULL)) {
+		return -1;
+	} else if (syscall(__NR_io_uring_register, fd,
+			   IORING_REGISTER_PROBE, p, 256U) < 0) {
+		goto out;
+	} else if (p->last_op < IORING_OP_OPENAT ||
+		   p->last_op < IORING_OP_READ) {
+		goto out;
+	} else if (!(p->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) ||
+		   !(p->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)) {
+		goto out;
+	}
+	rc = 0;
+out:
+	free(p);
+	return rc;
+}
+
+static struct io_uring_sqe*
+get_sqe(struct uring_s *u, size_t i)
+{
+/* prepare a fresh submission on behalf of slot I */
+	const unsigned int t = *u->sq_tail;
+	struct io_uring_sqe *sqe = u->sqes + (t & u->sq_mask);
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = i;
+	u->sq_array[t & u->sq_mask] = t & u->sq_mask;
+	return sqe;
+}
+
+static void
+put_sqe(struct uring_s *u)
+{
+/* publish the submission prepared last */
+	__atomic_store_n(u->sq_tail, *u->sq_tail + 1U, __ATOMIC_RELEASE);
+	u->nprep++;
+	return;
+}
+
+static int
+enter(struct uring_s *u, unsigned int min_complete)
+{
+/* submit what's been prepared, wait for MIN_COMPLETE completions */
+	const unsigned int fl = min_complete ? IORING_ENTER_GETEVENTS : 0U;
+	long n;
+
+	while ((n = syscall(__NR_io_uring_enter, u->fd,
+			    u->nprep, min_complete, fl, NULL, 0)) < 0) {
+		if (errno != EINTR) {
+			return -1;
+		}
+	}
+	u->nprep -= (unsigned int)n;
+	return 0;
+}
+
+static void
+land(struct uring_s *u, size_t i, int res)
+{
+/* digest the completion RES of slot I */
+	struct slot_s *s = u->slots + i;
+	struct stat st;
+
+	switch (s->st) {
+	case ST_OPENING:
+		if (res < 0) {
+			s->f.fd = -1;
+			s->f.err = -res;
+			break;
+		}
+		s->f.fd = res;
+		/* the inode's been loaded for the open, this one's cheap */
+		if (fstat(res, &st) < 0 || !S_ISREG(st.st_mode) ||
+		    !st.st_size || (size_t)st.st_size >= u->smallz) {
+			/* the caller's got better ways for those, empty ones
+			 * included, /proc and sysfs files claim to be */
+			break;
+		}
+		with (struct io_uring_sqe *sqe = get_sqe(u, i)) {
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = res;
+			sqe->addr = (uintptr_t)s->f.buf;
+			sqe->len = (unsigned int)st.st_size;
+			sqe->off = 0U;
+			put_sqe(u);
+		}
+		s->st = ST_READING;
+		return;
+	case ST_READING:
+		/* upon errors let the caller read it again and complain */
+		s->f.nrd = res >= 0 ? res : -1;
+		break;
+	default:
+		return;
+	}
+	s->st = ST_LANDED;
+	return;
+}
+
+static void
+reap(struct uring_s *u)
+{
+	unsigned int h = *u->cq_head;
+	const unsigned int t = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+	for (; h != t; h++) {
+		const struct io_uring_cqe *cqe = u->cqes + (h & u->cq_mask);
+
+		land(u, cqe->user_data, cqe->res);
+	}
+	__atomic_store_n(u->cq_head, h, __ATOMIC_RELEASE);
+	return;
+}
+
+
+uring_t
+make_uring(size_t depth, size_t smallz, size_t padz)
+{
+	struct io_uring_params p = {0U};
+	struct uring_s *u;
+	size_t bz;
+	char *r;
+
+	if (UNLIKELY(!depth || depth > 4096U)) {
+		return NULL;
+	} else if (UNLIKELY((u = calloc(1U, sizeof(*u))) == NULL)) {
+		return NULL;
+	}
+	u->fd = -1;
+	u->depth = depth;
+	u->smallz = smallz;
+	/* keep buffers apart by whole cache lines */
+	bz = (smallz + padz + 63U) & ~(size_t)63U;
+	if (UNLIKELY((u->slots = calloc(depth, sizeof(*u->slots))) == NULL)) {
+		goto nope;
+	} else if (posix_memalign((void**)&u->bufs, 64U, depth * bz)) {
+		u->bufs = NULL;
+		goto nope;
+	}
+	for (size_t i = 0U; i < depth; i++) {
+		u->slots[i].f.buf = u->bufs + i * bz;
+	}
+
+	if ((u->fd = syscall(__NR_io_uring_setup, depth, &p)) < 0) {
+		/* seccomp'd or too old */
+		goto nope;
+	} else if (probe_ops(u->fd) < 0) {
+		goto nope;
+	}
+
+	u->sqrz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	u->cqrz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP && u->cqrz > u->sqrz) {
+		u->sqrz = u->cqrz;
+	}
+	u->sqr = mmap(NULL, u->sqrz, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (u->sqr == MAP_FAILED) {
+		u->sqr = NULL;
+		goto nope;
+	} else if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		u->cqr = u->sqr;
+	} else if ((u->cqr = mmap(NULL, u->cqrz, PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_POPULATE,
+				  u->fd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+		u->cqr = NULL;
+		goto nope;
+	}
+	u->sqesz = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqesz, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		u->sqes = NULL;
+		goto nope;
+	}
+
+	r = u->sqr;
+	u->sq_head = (unsigned int*)(r + p.sq_off.head);
+	u->sq_tail = (unsigned int*)(r + p.sq_off.tail);
+	u->sq_mask = *(unsigned int*)(r + p.sq_off.ring_mask);
+	u->sq_array = (unsigned int*)(r + p.sq_off.array);
+	r = u->cqr;
+	u->cq_head = (unsigned int*)(r + p.cq_off.head);
+	u->cq_tail = (unsigned int*)(r + p.cq_off.tail);
+	u->cq_mask = *(unsigned int*)(r + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe*)(r + p.cq_off.cqes);
+	return u;
+
+nope:
+	free_uring(u);
+	return NULL;
+}
+
+void
+free_uring(uring_t u)
+{
+	if (UNLIKELY(u == NULL)) {
+		return;
+	}
+	if (u->sqes != NULL) {
+		munmap(u->sqes, u->sqesz);
+	}
+	if (u->cqr != NULL && u->cqr != u->sqr) {
+		munmap(u->cqr, u->cqrz);
+	}
+	if (u->sqr != NULL) {
+		munmap(u->sqr, u->sqrz);
+	}
+	if (u->fd >= 0) {
+		close(u->fd);
+	}
+	free(u->bufs);
+	free(u->slots);
+	free(u);
+	return;
+}
+
+int
+uring_push(uring_t u, const char *fn, void *clo)
+{
+	const size_t i = u->tail % u->depth;
+	struct slot_s *s = u->slots + i;
+
+	if (u->tail - u->head >= u->depth) {
+		return -1;
+	}
+	s->f = (struct uring_file_s){
+		.clo = clo, .fd = -1, .nrd = -1, .buf = s->f.buf,
+	};
+	with (struct io_uring_sqe *sqe = get_sqe(u, i)) {
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t)fn;
+		sqe->open_flags = O_RDONLY;
+		put_sqe(u);
+	}
+	s->st = ST_OPENING;
+	u->tail++;
+	return 0;
+}
+
+const struct uring_file_s*
+uring_pop(uring_t u)
+{
+	struct slot_s *s;
+
+	if (u->head == u->tail) {
+		return NULL;
+	}
+	s = u->slots + u->head % u->depth;
+	for (reap(u); s->st != ST_LANDED; reap(u)) {
+		if (UNLIKELY(enter(u, 1U) < 0)) {
+			/* ring's broken, that's a file we couldn't open */
+			s->f.err = errno;
+			break;
+		}
+	}
+	if (u->nprep) {
+		/* keep the kernel busy while the caller scans */
+		(void)enter(u, 0U);
+	}
+	s->st = ST_FREE;
+	u->head++;
+	return &s->f;
+}
+
+#else  /* !WITH_IO_URING */
+uring_t
+make_uring(size_t UNUSED(depth), size_t UNUSED(smallz), size_t UNUSED(padz))
+{
+	return NULL;
+}
+
+void
+free_uring(uring_t UNUSED(u))
+{
+	return;
+}
+
+int
+uring_push(uring_t UNUSED(u), const char *UNUSED(fn), void *UNUSED(clo))
+{
+	return -1;
+}
+
+const struct uring_file_s*
+uring_pop(uring_t UNUSED(u))
+{
+	return NULL;
+}
+#endif	/* WITH_IO_URING */
+
+/* uring.c ends here */
@@ -0,0 +1,90 @@
+/*** uring.h -- batched opens and reads
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_uring_h_
+#define INCLUDED_uring_h_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * A ring of files being opened, and read if they're small, ahead of
+ * their scanning.  Files come out of the ring in the order they went
+ * in.  Backed by io_uring where the kernel has it. */
+typedef struct uring_s *uring_t;
+
+/**
+ * A file that made it through the ring. */
+struct uring_file_s {
+	/** the cookie given to uring_push() */
+	void *clo;
+	/** the opened descriptor, or -1 with errno in ERR */
+	int fd;
+	int err;
+	/** number of octets in BUF, which is then the whole file,
+	 * or -1 if the file wasn't read */
+	ssize_t nrd;
+	char *buf;
+};
+
+
+/**
+ * Create a ring keeping up to DEPTH files in flight, regular files of
+ * fewer than SMALLZ octets are read, too, into buffers with room for
+ * PADZ octets past SMALLZ.
+ * Return NULL if the kernel can't do it, callers should fall back to
+ * open() and read() then. */
+extern uring_t make_uring(size_t depth, size_t smallz, size_t padz);
+
+/**
+ * Free resources associated with U, which mustn't have files in
+ * flight anymore. */
+extern void free_uring(uring_t u);
+
+/**
+ * Queue the file FN, which must stay valid until the file comes out
+ * of the ring, CLO is handed back along with the file.
+ * Return -1 if the ring is full already. */
+extern int uring_push(uring_t u, const char *fn, void *clo);
+
+/**
+ * Return the next file in the order of uring_push(), waiting for it
+ * to be opened and read if need be, or NULL if there's no files in
+ * flight.  The file's buffer is valid until the next uring_push(),
+ * closing its descriptor is up to the caller. */
+extern const struct uring_file_s *uring_pop(uring_t u);
+
+#endif	/* INCLUDED_uring_h_ */
@@ -0,0 +1,164 @@
+/*** wsq.c -- work-stealing queues
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "wsq.h"
+#include "nifty.h"
+
+#define LANE_INIZ	(64U)
+
+struct lane_s {
+	pthread_mutex_t mtx;
+	/** index of the next item to hand to the owner */
+	size_t head;
+	/** index past the last item, thieves take from here */
+	size_t tail;
+	/** allocation size of ITEMS */
+	size_t z;
+	void **items;
+} __attribute__((aligned(64U)));
+
+struct wsq_s {
+	size_t nlanes;
+	struct lane_s lanes[];
+};
+
+
+wsq_t
+make_wsq(size_t n)
+{
+	struct wsq_s *res;
+
+	if (UNLIKELY(!n)) {
+		return NULL;
+	} else if (posix_memalign((void**)&res, 64U,
+				  sizeof(*res) + n * sizeof(*res->lanes))) {
+		return NULL;
+	}
+	res->nlanes = n;
+	for (size_t i = 0U; i < n; i++) {
+		struct lane_s *l = res->lanes + i;
+
+		pthread_mutex_init(&l->mtx, NULL);
+		l->head = l->tail = l->z = 0U;
+		l->items = NULL;
+	}
+	return res;
+}
+
+void
+free_wsq(wsq_t q)
+{
+	if (UNLIKELY(q == NULL)) {
+		return;
+	}
+	for (size_t i = 0U; i < q->nlanes; i++) {
+		struct lane_s *l = q->lanes + i;
+
+		pthread_mutex_destroy(&l->mtx);
+		if (l->items != NULL) {
+			free(l->items);
+		}
+	}
+	free(q);
+	return;
+}
+
+int
+wsq_push(wsq_t q, size_t i, void *item)
+{
+	struct lane_s *l = q->lanes + i % q->nlanes;
+	int rc = 0;
+
+	pthread_mutex_lock(&l->mtx);
+	if (UNLIKELY(l->tail >= l->z)) {
+		if (l->head > 0U) {
+			/* compact what's left */
+			memmove(l->items, l->items + l->head,
+				(l->tail - l->head) * sizeof(*l->items));
+			l->tail -= l->head;
+			l->head = 0U;
+		}
+		if (l->tail >= l->z) {
+			const size_t nuz = l->z ? l->z * 2U : LANE_INIZ;
+			void **nu = realloc(l->items, nuz * sizeof(*nu));
+
+			if (UNLIKELY(nu == NULL)) {
+				rc = -1;
+				goto out;
+			}
+			l->items = nu;
+			l->z = nuz;
+		}
+	}
+	l->items[l->tail++] = item;
+out:
+	pthread_mutex_unlock(&l->mtx);
+	return rc;
+}
+
+void*
+wsq_pop(wsq_t q, size_t i)
+{
+	void *res = NULL;
+
+	/* own lane first, from the front */
+	with (struct lane_s *l = q->lanes + i % q->nlanes) {
+		pthread_mutex_lock(&l->mtx);
+		if (l->head < l->tail) {
+			res = l->items[l->head++];
+		}
+		pthread_mutex_unlock(&l->mtx);
+	}
+	/* otherwise go stealing from the back of the other lanes */
+	for (size_t k = 1U; res == NULL && k < q->nlanes; k++) {
+		struct lane_s *l = q->lanes + (i + k) % q->nlanes;
+
+		pthread_mutex_lock(&l->mtx);
+		if (l->head < l->tail) {
+			res = l->items[--l->tail];
+		}
+		pthread_mutex_unlock(&l->mtx);
+	}
+	return res;
+}
+
+/* wsq.c ends here */
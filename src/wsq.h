@@ -0,0 +1,66 @@
+/*** wsq.h -- work-stealing queues
+ *
+ * Copyright (C) 2013-2015 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of glod.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_wsq_h_
+#define INCLUDED_wsq_h_
+
+#include <stddef.h>
+
+/**
+ * A work-stealing queue is a set of lanes, one per worker.
+ * Workers take items from the front of their own lane and, once that
+ * is exhausted, steal items from the back of other lanes. */
+typedef struct wsq_s *wsq_t;
+
+
+/**
+ * Create a work-stealing queue with N lanes. */
+extern wsq_t make_wsq(size_t n);
+
+/**
+ * Free resources associated with Q, items are not freed. */
+extern void free_wsq(wsq_t q);
+
+/**
+ * Append ITEM to lane I of Q. */
+extern int wsq_push(wsq_t q, size_t i, void *item);
+
+/**
+ * Return the next item of lane I, steal from other lanes if lane I
+ * is empty.  Return NULL if all lanes are empty. */
+extern void *wsq_pop(wsq_t q, size_t i);
+
+#endif	/* INCLUDED_wsq_h_ */
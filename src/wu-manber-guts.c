@@ -43,7 +43,13 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
 #include <assert.h>
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__) && \
+	defined HAVE_IMMINTRIN_H
+# include <immintrin.h>
+#endif
 #include "nifty.h"
 #include "glep.h"
 #include "wu-manber-guts.h"
@@ -53,26 +59,89 @@ typedef uint_fast32_t hx_t;
 /* index type */
 typedef uint_fast8_t ix_t;
 
-#define TBL_INIZ	(32768U)
+/* bounds for the size of the SHIFT and HASH tables, as powers of 2 */
+#define TBL_MINB	(15U)
+#define TBL_MAXB	(22U)
+
+/* cost model for the planner, in ns per KiB of text as measured on
+ * english news text, a constant per scan, the price of a window and
+ * the surcharge for a window that turns out to be a candidate */
+#define COST_SCAN	(100U)
+#define COST_WNDW	(9U)
+#define COST_CAND	(20U)
+
+/* case handling of a pattern set, the scanner is specialised for each,
+ * case-sensitive windows are hashed as they are, case-insensitive ones
+ * in lower case and mixed sets need both */
+enum {
+	CASE_SENS,
+	CASE_INS,
+	CASE_MIXED,
+};
+
+/* counters for --engine-stats */
+struct wmst_s {
+	/** number of windows looked at and the sum of their shifts */
+	uint64_t nstep;
+	uint64_t nshift;
+	/** windows with shift 0, i.e. candidates */
+	uint64_t ncand;
+	/** chain entries looked at for candidates */
+	uint64_t nchain;
+	/** chain entries whose prefix matched, i.e. verifications */
+	uint64_t nvrfy;
+	uint64_t nmtch;
+};
 
 struct glepcc_s {
-	/** rolling hash window size (2 or 3) */
+	/** rolling hash window size (2, 3 or 4) */
 	unsigned int B;
 	/** length of shortest pattern */
 	unsigned int m;
-	/** allocation size of the tables below */
+	/** case handling, CASE_* */
+	unsigned int cas;
+	/** size of the SHIFT and HASH tables, as power of 2, and as such */
+	unsigned int zb;
 	size_t z;
 	/** table with shift values */
 	ix_t *SHIFT;
-	/** table with pattern hashes */
+	/** table with pattern hashes, Z + 1 entries */
 	hx_t *HASH;
-	/** table with pattern prefixes */
+	/** table with pattern prefixes, one per pattern */
 	hx_t *PREFIX;
-	/** table with pointers into actual pattern array */
+	/** table with pointers into actual pattern array, one per pattern */
 	hx_t *PATPTR;
+	size_t npats;
+	/** what the verifiers need of the patterns, by chain position so
+	 * the patterns of a bucket are adjacent: their octets, packed,
+	 * NUL-terminated, lower-cased if case insensitive and followed by
+	 * VPADZ octets of padding, offsets thereto, one extra so lengths
+	 * follow from consecutive offsets, VFL_* flags and counter
+	 * indices */
+	unsigned char *VPAT;
+	uint32_t *VOFF;
+	uint8_t *VFL;
+	uint32_t *VIDX;
 
 	/* the original pats */
 	glod_pats_t p;
+	/* non-zero if the tables live in a database */
+	int mapped;
+
+	/* counters for --engine-stats */
+	struct wmst_s st;
+};
+
+/* database record of the above, tables by offset */
+struct ccrec_s {
+	uint32_t B;
+	uint32_t m;
+	uint64_t z;
+	uint64_t npats;
+	uint64_t SHIFT;
+	uint64_t HASH;
+	uint64_t PREFIX;
+	uint64_t PATPTR;
 };
 
 #if defined __INTEL_COMPILER
@@ -93,6 +162,7 @@ static uint_fast8_t xlcase[] = {
 	y('Z' + 6U + 32U), y('Z' + 6U + 48U),
 	y('Z' + 6U + 64U), y('Z' + 6U + 80U),
 	y('Z' + 6U + 96U), y('Z' + 6U + 112U),
+	y('Z' + 6U + 128U), y('Z' + 6U + 144U),
 #undef x
 #undef y
 };
@@ -172,6 +242,174 @@ xicmp(const char *s1, const unsigned char *s2)
 # pragma warning (default:593)
 #endif	/* __INTEL_COMPILER */
 
+/* the vector verifiers load whole vectors off the text and the packed
+ * patterns, which are followed by VPADZ octets of padding for the
+ * purpose, case-insensitive patterns are kept in lower case and the
+ * text is folded in-register, like ptolower() does in the simd guts */
+#define VPADZ		(32U)
+
+/* pattern flags in the compiled layout */
+#define VFL_CI		(1U)
+#define VFL_LEFT	(2U)
+#define VFL_RIGHT	(4U)
+
+static inline size_t
+vpad(size_t n)
+{
+	return (n + VPADZ - 1U) & ~(size_t)(VPADZ - 1U);
+}
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__) && \
+	defined HAVE_IMMINTRIN_H
+# define HAVE_VCMP_INTRIN
+
+static __attribute__((target("sse2"))) bool
+vcmp128(const unsigned char *vp, const unsigned char *sp, size_t n, bool ci)
+{
+/* compare the N octets at SP to the padded pattern at VP */
+	for (size_t k = 0U; k < n; k += 16U) {
+		__m128i t = _mm_loadu_si128((const void*)(sp + k));
+		const __m128i p = _mm_loadu_si128((const void*)(vp + k));
+		unsigned int m;
+
+		if (ci) {
+			const __m128i x0 = _mm_cmpgt_epi8(t, _mm_set1_epi8('A' - 1));
+			const __m128i x1 = _mm_cmplt_epi8(t, _mm_set1_epi8('Z' + 1));
+			const __m128i y0 = _mm_and_si128(x0, x1);
+
+			t = _mm_add_epi8(t, _mm_and_si128(y0, _mm_set1_epi8(32)));
+		}
+		m = ~_mm_movemask_epi8(_mm_cmpeq_epi8(t, p)) & 0xffffU;
+		if (n - k < 16U) {
+			m &= (1U << (n - k)) - 1U;
+		}
+		if (m) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static __attribute__((target("avx2"))) bool
+vcmp256(const unsigned char *vp, const unsigned char *sp, size_t n, bool ci)
+{
+/* compare the N octets at SP to the padded pattern at VP */
+	for (size_t k = 0U; k < n; k += 32U) {
+		__m256i t = _mm256_loadu_si256((const void*)(sp + k));
+		const __m256i p = _mm256_loadu_si256((const void*)(vp + k));
+		uint32_t m;
+
+		if (ci) {
+			const __m256i x0 =
+				_mm256_cmpgt_epi8(t, _mm256_set1_epi8('A' - 1));
+			const __m256i x1 =
+				_mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), t);
+			const __m256i y0 = _mm256_and_si256(x0, x1);
+
+			t = _mm256_add_epi8(
+				t, _mm256_and_si256(y0, _mm256_set1_epi8(32)));
+		}
+		m = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(t, p));
+		if (n - k < 32U) {
+			m &= (1U << (n - k)) - 1U;
+		}
+		if (m) {
+			return false;
+		}
+	}
+	return true;
+}
+#endif	/* __GNUC__ && x86 && HAVE_IMMINTRIN_H */
+
+/* the verifier in use, or NULL for the byte-wise xcmp() and xicmp(),
+ * and its variant name, see wu_manber_pin() */
+static bool(*vcmp)(const unsigned char*, const unsigned char*, size_t, bool);
+static const char *vcmpv = "seq";
+static bool vcmp_pinned;
+
+static void
+vcmp_dispatch(void)
+{
+	if (vcmp_pinned) {
+		return;
+	}
+#if defined HAVE_VCMP_INTRIN
+	if (__builtin_cpu_supports("avx2")) {
+		vcmp = vcmp256;
+		vcmpv = "256";
+	} else if (__builtin_cpu_supports("sse2")) {
+		vcmp = vcmp128;
+		vcmpv = "128";
+	}
+#endif	/* HAVE_VCMP_INTRIN */
+	return;
+}
+
+static int
+make_layout(struct glepcc_s *restrict ctx, glod_pats_t g)
+{
+/* lay out the patterns of G in chain order for the verifiers,
+ * the chains, i.e. PATPTR, must be in place */
+	const size_t np = ctx->npats;
+	size_t tot = 0U;
+	size_t o = 0U;
+
+	for (size_t i = 0U; i < g->npats; i++) {
+		tot += g->pats[i].n + 1U;
+	}
+	if (UNLIKELY(tot > UINT32_MAX)) {
+		return -1;
+	}
+	ctx->VOFF = malloc((np + 1U) * sizeof(*ctx->VOFF));
+	ctx->VFL = malloc((np + 1U) * sizeof(*ctx->VFL));
+	ctx->VIDX = malloc((np + 1U) * sizeof(*ctx->VIDX));
+	if (UNLIKELY(posix_memalign((void**)&ctx->VPAT, 64U, tot + VPADZ))) {
+		ctx->VPAT = NULL;
+		return -1;
+	} else if (UNLIKELY(ctx->VOFF == NULL) ||
+		   UNLIKELY(ctx->VFL == NULL) ||
+		   UNLIKELY(ctx->VIDX == NULL)) {
+		return -1;
+	}
+	for (size_t pi = 0U; pi < np; pi++) {
+		glod_pat_t pat;
+
+		if (UNLIKELY(ctx->PATPTR[pi] >= g->npats)) {
+			/* not G's chains */
+			return -1;
+		}
+		pat = g->pats[ctx->PATPTR[pi]];
+		if (UNLIKELY(o + pat.n + 1U > tot)) {
+			return -1;
+		}
+		ctx->VOFF[pi] = o;
+		ctx->VFL[pi] = (uint8_t)((pat.fl.ci ? VFL_CI : 0U) |
+					 (pat.fl.left ? VFL_LEFT : 0U) |
+					 (pat.fl.right ? VFL_RIGHT : 0U));
+		ctx->VIDX[pi] = pat.idx;
+		for (size_t j = 0U; j < pat.n; j++) {
+			const unsigned char c = pat.p[j];
+
+			ctx->VPAT[o + j] = !pat.fl.ci ? c : xlcase[c];
+		}
+		ctx->VPAT[o + pat.n] = '\0';
+		o += pat.n + 1U;
+	}
+	ctx->VOFF[np] = o;
+	memset(ctx->VPAT + o, 0, VPADZ);
+	return 0;
+}
+
+static void
+free_layout(struct glepcc_s *restrict ctx)
+{
+	free(ctx->VPAT);
+	free(ctx->VOFF);
+	free(ctx->VFL);
+	free(ctx->VIDX);
+	return;
+}
+
 static size_t
 find_m(glod_pats_t g)
 {
@@ -196,49 +434,133 @@ find_m(glod_pats_t g)
 	return res;
 }
 
+static unsigned int
+find_cas(glod_pats_t g)
+{
+/* determine whether G's patterns need case-sensitive windows, case
+ * insensitive ones, or both */
+	size_t nci = 0U;
+
+	for (size_t i = 0U; i < g->npats; i++) {
+		nci += g->pats[i].fl.ci;
+	}
+	return !nci ? CASE_SENS : nci == g->npats ? CASE_INS : CASE_MIXED;
+}
+
+static double
+find_alpha(glod_pats_t g)
+{
+/* the effective alphabet size of the patterns, i.e. the inverse of the
+ * probability that two of their characters coincide, case-insensitive
+ * patterns are counted in lower case as that's how they're hashed */
+	uint64_t cnt[256U] = {0U};
+	uint64_t tot = 0U;
+	uint64_t sq = 0U;
+
+	for (size_t i = 0U; i < g->npats; i++) {
+		const glod_pat_t p = g->pats[i];
+		const unsigned char *s = (const unsigned char*)p.p;
+
+		for (size_t j = 0U; j < p.n; j++) {
+			cnt[!p.fl.ci ? s[j] : xlcase[s[j]]]++;
+		}
+		tot += p.n;
+	}
+	for (size_t i = 0U; i < countof(cnt); i++) {
+		sq += cnt[i] * cnt[i];
+	}
+	return (double)(tot * tot) / (double)(sq + !sq);
+}
+
 static size_t
-find_B(glod_pats_t g, size_t UNUSED(m))
+find_B(glod_pats_t g, size_t m)
+{
+/* the window of B characters has to tell the pattern blocks apart
+ * from random text, there are npats * (m - B + 1) of them, so go for
+ * alpha^B exceeding that comfortably, a larger B costs us shift
+ * distance but for short patterns a selective window is worth more
+ * than a long shift */
+	const double alpha = find_alpha(g);
+	size_t B = 2U;
+
+	for (double aB = alpha * alpha; B < 4U && B < m; B++) {
+		if (aB >= (double)(2U * g->npats * (m - B + 1U))) {
+			break;
+		}
+		aB *= alpha;
+	}
+	return B;
+}
+
+static unsigned int
+find_zb(glod_pats_t g, size_t m, size_t B)
 {
-	/* just use agrep's heuristics
-	 * they used to conditionalise on m>2 but we *know* that
-	 * m is greater than 2 because we provisioned the maps like that */
-	if (g->npats >= 400U) {
-		return 3U;
+/* size the tables so that no more than an eighth of the SHIFT entries
+ * is taken by pattern blocks, there's no point in exceeding the
+ * 5 bits per character that sufh_c() produces though */
+	const size_t nblk = g->npats * (m - B + 1U);
+	unsigned int zb = TBL_MINB < 5U * B ? TBL_MINB : 5U * B;
+
+	while (zb < TBL_MAXB && zb < 5U * B && ((size_t)1U << zb) < 8U * nblk) {
+		zb++;
 	}
-	return 2U;
+	return zb;
 }
 
 static inline hx_t
-sufh_c(const unsigned char c0, const unsigned char c1, const unsigned char c2)
+sufh_c(glepcc_t ctx, const unsigned int B,
+       const unsigned char c0, const unsigned char c1,
+       const unsigned char c2, const unsigned char c3)
 {
-/* suffix hashing, c0 is the rightmost char, c1 the char left thereof, etc. */
-	hx_t res = c2;
+/* suffix hashing, c0 is the rightmost char, c1 the char left thereof, etc.
+ * 5 bits per char keep letters apart, for text this beats scrambling
+ * the bits, what doesn't fit the table is folded back in */
+	hx_t res = c3;
 
+	res <<= 5U;
+	res += c2;
 	res <<= 5U;
 	res += c1;
 	res <<= 5U;
 	res += c0;
-	return res;
+	if (B >= 4U) {
+		res ^= res >> ctx->zb;
+	}
+	return res & (ctx->z - 1U);
+}
+
+static inline hx_t
+sufh_B(glepcc_t ctx, const unsigned int B, const unsigned char *cp)
+{
+/* suffix hashing, B is passed on so scanners can fix it at compile time */
+	return sufh_c(
+		ctx, B, cp[0], cp[-1],
+		(unsigned char)(B >= 3U ? cp[-2] : 0U),
+		(unsigned char)(B >= 4U ? cp[-3] : 0U));
+}
+
+static inline hx_t
+sufh_ci_B(glepcc_t ctx, const unsigned int B, const unsigned char *cp)
+{
+/* suffix hashing, case insensitive */
+	return sufh_c(
+		ctx, B, xlcase[cp[0]], xlcase[cp[-1]],
+		(unsigned char)(B >= 3U ? xlcase[cp[-2]] : 0U),
+		(unsigned char)(B >= 4U ? xlcase[cp[-3]] : 0U));
 }
 
 static inline hx_t
-sufh(glepcc_t ctx, const unsigned char cp[static 1])
+sufh(glepcc_t ctx, const unsigned char *cp)
 {
 /* suffix hashing */
-	hx_t hraw =  sufh_c(
-		cp[0], cp[-1],
-		(unsigned char)(ctx->B == 3U ? cp[-2] : 0U));
-	return hraw & (ctx->z - 1U);
+	return sufh_B(ctx, ctx->B, cp);
 }
 
 static inline hx_t
-sufh_ci(glepcc_t ctx, const unsigned char cp[static 1])
+sufh_ci(glepcc_t ctx, const unsigned char *cp)
 {
 /* suffix hashing, case insensitive */
-	hx_t hraw = sufh_c(
-		xlcase[cp[0]], xlcase[cp[-1]],
-		(unsigned char)(ctx->B == 3U ? xlcase[cp[-2]] : 0U));
-	return hraw & (ctx->z - 1U);
+	return sufh_ci_B(ctx, ctx->B, cp);
 }
 
 static inline hx_t
@@ -253,7 +575,7 @@ prfh_c(const unsigned char c0, const unsigned char c1)
 }
 
 static inline hx_t
-prfh(glepcc_t ctx, const unsigned char cp[static 1])
+prfh(glepcc_t ctx, const unsigned char *cp)
 {
 /* prefix hashing */
 	hx_t hraw = prfh_c(cp[0U], cp[1U]);
@@ -261,24 +583,44 @@ prfh(glepcc_t ctx, const unsigned char cp[static 1])
 }
 
 static inline hx_t
-prfh_ci(glepcc_t ctx, const unsigned char cp[static 1])
+prfh_ci(glepcc_t ctx, const unsigned char *cp)
 {
 /* prefix hashing, case insensitive */
 	hx_t hraw = prfh_c(xlcase[cp[0U]], xlcase[cp[1U]]);
 	return hraw & (ctx->z - 1U);
 }
 
-static inline size_t
-next_2power(size_t n)
-{
-	size_t cand;
-
-	for (cand = TBL_INIZ; cand < n; cand <<= 2U);
-	return cand;
-}
 
 
 /* glep.h engine api */
+size_t
+wu_manber_cost(glod_pats_t g)
+{
+/* estimate the scanning cost of G in ns per KiB of text, a window is
+ * a block of some pattern at a given offset with probability
+ * Q = npats / alpha^B, a shift of K or more requires the K windows
+ * before to be none, so the expected step is the sum of (1 - Q)^k
+ * for k below m - B + 1, and Q of the windows are candidates */
+	const size_t m = find_m(g);
+	const size_t B = find_B(g, m);
+	const double alpha = find_alpha(g);
+	double aB = 1, q, pk = 1, step = 0;
+
+	if (UNLIKELY(!m)) {
+		return 0U;
+	}
+	for (size_t i = 0U; i < B; i++) {
+		aB *= alpha;
+	}
+	q = (double)g->npats / aB;
+	q = q < 1 ? q : 1;
+	for (size_t k = 0U; k < (m > B ? m - B + 1U : 1U); k++) {
+		step += pk;
+		pk *= 1 - q;
+	}
+	return COST_SCAN + (size_t)(1024U / step * (COST_WNDW + q * COST_CAND));
+}
+
 glepcc_t
 wu_manber_cc(glod_pats_t g)
 {
@@ -289,12 +631,20 @@ wu_manber_cc(glod_pats_t g)
 		return NULL;
 	}
 	res->m = find_m(g);
+	res->cas = find_cas(g);
 	res->B = find_B(g, res->m);
-	res->z = next_2power(g->npats);
+	res->zb = find_zb(g, res->m, res->B);
+	res->z = (size_t)1U << res->zb;
+	res->npats = g->npats;
 	res->SHIFT = malloc(res->z * sizeof(*res->SHIFT));
-	res->HASH = calloc(res->z, sizeof(*res->HASH));
-	res->PREFIX = calloc(res->z, sizeof(*res->PREFIX));
-	res->PATPTR = calloc(res->z, sizeof(*res->PATPTR));
+	res->HASH = calloc(res->z + 1U, sizeof(*res->HASH));
+	res->PREFIX = calloc(res->npats + 1U, sizeof(*res->PREFIX));
+	res->PATPTR = calloc(res->npats + 1U, sizeof(*res->PATPTR));
+	res->VPAT = NULL;
+	res->VOFF = NULL;
+	res->VFL = NULL;
+	res->VIDX = NULL;
+	memset(&res->st, 0, sizeof(res->st));
 
 	if (UNLIKELY(res->SHIFT == NULL) ||
 	    UNLIKELY(res->HASH == NULL) ||
@@ -303,13 +653,13 @@ wu_manber_cc(glod_pats_t g)
 		if (res->SHIFT != NULL) {
 			free(res->SHIFT);
 		}
-		if (res->HASH == NULL) {
+		if (res->HASH != NULL) {
 			free(res->HASH);
 		}
-		if(res->PREFIX == NULL) {
+		if (res->PREFIX != NULL) {
 			free(res->PREFIX);
 		}
-		if (res->PATPTR == NULL) {
+		if (res->PATPTR != NULL) {
 			free(res->PATPTR);
 		}
 		free(res);
@@ -361,11 +711,11 @@ wu_manber_cc(glod_pats_t g)
 		add_pat(pat, p);
 	}
 
-	/* finalise (integrate) the HASH table */
-	for (size_t i = 1; i < res->z; i++) {
+	/* finalise (integrate) the HASH table, the extra slot at the end
+	 * makes HASH[h + 1] the end of h's chain for every h */
+	for (size_t i = 1; i <= res->z; i++) {
 		res->HASH[i] += res->HASH[i - 1];
 	}
-	res->HASH[0] = 0U;
 
 	/* prefix handling */
 	for (size_t i = 0; i < g->npats; i++) {
@@ -377,6 +727,14 @@ wu_manber_cc(glod_pats_t g)
 	}
 
 	res->p = g;
+	res->mapped = 0;
+
+	/* the verifiers' view of the chains */
+	if (UNLIKELY(make_layout(res, g) < 0)) {
+		wu_manber_fr(res);
+		return NULL;
+	}
+	vcmp_dispatch();
 
 	/* yay, bang the mock into the gleps object */
 	return res;
@@ -388,6 +746,11 @@ void
 wu_manber_fr(glepcc_t g)
 {
 	with (struct glepcc_s *pg = deconst(g)) {
+		free_layout(pg);
+		if (pg->mapped) {
+			free(pg);
+			break;
+		}
 		free(pg->SHIFT);
 		free(pg->HASH);
 		free(pg->PREFIX);
@@ -397,12 +760,89 @@ wu_manber_fr(glepcc_t g)
 	return;
 }
 
+size_t
+wu_manber_wr(gdbw_t w, glepcc_t g)
+{
+	const size_t np = g->npats + 1U;
+	struct ccrec_s r = {
+		.B = g->B,
+		.m = g->m,
+		.z = g->z,
+		.npats = g->npats,
+		.SHIFT = gdbw_put(w, g->SHIFT, g->z * sizeof(*g->SHIFT)),
+		.HASH = gdbw_put(w, g->HASH, (g->z + 1U) * sizeof(*g->HASH)),
+		.PREFIX = gdbw_put(w, g->PREFIX, np * sizeof(*g->PREFIX)),
+		.PATPTR = gdbw_put(w, g->PATPTR, np * sizeof(*g->PATPTR)),
+	};
+
+	if (UNLIKELY(!r.SHIFT || !r.HASH || !r.PREFIX || !r.PATPTR)) {
+		return 0U;
+	}
+	return gdbw_put(w, &r, sizeof(r));
+}
+
+glepcc_t
+wu_manber_rd(gdb_t d, size_t o, glod_pats_t g)
+{
+/* G must be the patterns that were compiled into the record at O */
+	const struct ccrec_s *r;
+	struct glepcc_s *res;
+
+	if (UNLIKELY((r = gdb_get(d, o, sizeof(*r))) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY(!r->z || r->z & (r->z - 1U) ||
+			    r->z >> TBL_MAXB > 1U)) {
+		/* not a power of 2 */
+		return NULL;
+	} else if (UNLIKELY((res = calloc(1, sizeof(*res))) == NULL)) {
+		return NULL;
+	}
+	res->B = r->B;
+	res->m = r->m;
+	res->cas = find_cas(g);
+	res->z = r->z;
+	res->zb = __builtin_ctzll(r->z);
+	res->npats = r->npats;
+	res->SHIFT = deconst(gdb_get(d, r->SHIFT, r->z * sizeof(*res->SHIFT)));
+	res->HASH = deconst(
+		gdb_get(d, r->HASH, (r->z + 1U) * sizeof(*res->HASH)));
+	res->PREFIX = deconst(
+		gdb_get(d, r->PREFIX, (r->npats + 1U) * sizeof(*res->PREFIX)));
+	res->PATPTR = deconst(
+		gdb_get(d, r->PATPTR, (r->npats + 1U) * sizeof(*res->PATPTR)));
+	res->p = g;
+	res->mapped = 1;
+
+	if (UNLIKELY(res->SHIFT == NULL) ||
+	    UNLIKELY(res->HASH == NULL) ||
+	    UNLIKELY(res->PREFIX == NULL) ||
+	    UNLIKELY(res->PATPTR == NULL) ||
+	    UNLIKELY(make_layout(res, g) < 0)) {
+		free_layout(res);
+		free(res);
+		return NULL;
+	}
+	vcmp_dispatch();
+	return res;
+}
+
 int
-wu_manber_gr(gcnt_t *restrict cnt, glepcc_t g, const char *buf, size_t bsz)
+wu_manber_gr(gcnt_t *restrict cnt, ghits_t hits,
+	     glepcc_t g, const char *buf, size_t bsz)
 {
 	const unsigned char *bp = (const unsigned char*)buf + g->m - 1;
+	/* matches must start before EP, the rest belongs to the next chunk */
 	const unsigned char *const ep = (const unsigned char*)buf +
 		(bsz < CHUNKZ ? bsz : CHUNKZ - MWNDWZ);
+	const unsigned char *const eb = (const unsigned char*)buf + bsz;
+	/* so windows may end up to m - 1 octets past EP */
+	const unsigned char *const ez =
+		ep + g->m - 1U < eb ? ep + g->m - 1U : eb;
+	const unsigned char *const bp0 = bp;
+	struct wmst_s st = {0U};
+	uint_fast64_t nstep = 0U;
+	uint_fast64_t ncand = 0U;
+	int nmtch = 0;
 
 	auto inline const unsigned char *prfs(const unsigned char *xp)
 	{
@@ -411,22 +851,28 @@ wu_manber_gr(gcnt_t *restrict cnt, glepcc_t g, const char *buf, size_t bsz)
 	}
 
 	auto bool
-	matchp(const glod_pat_t pat, const unsigned char *const sp, size_t z)
+	matchp(const unsigned int fl, const unsigned char *const sp, size_t z)
 	{
-		/* check if PAT is a whole-word match */
-		if (UNLIKELY(pat.fl.left && pat.fl.right)) {
+		/* check if a pattern with flags FL is a whole-word match */
+		const bool left = fl & VFL_LEFT;
+		const bool right = fl & VFL_RIGHT;
+
+		if (UNLIKELY(sp + z > eb)) {
+			/* compared past the end of the buffer */
+			return false;
+		} else if (UNLIKELY(left && right)) {
 			/* we're looking at *foo*, trivial match */
 			return true;
 		}
-		if (!pat.fl.right && UNLIKELY(pat.fl.left)) {
+		if (!right && UNLIKELY(left)) {
 			/* we're looking at *foo,
 			 * so check the right side for word boundaries */
-			if (UNLIKELY(sp + z >= ep)) {
+			if (UNLIKELY(sp + z >= eb)) {
 				return true;
 			} else if (xpuncsp(sp[z])) {
 				return true;
 			}
-		} else if (!pat.fl.left && UNLIKELY(pat.fl.right)) {
+		} else if (!left && UNLIKELY(right)) {
 			/* we're looking at foo*, so check the left side */
 			if (UNLIKELY(sp == (const unsigned char*)buf)) {
 				return true;
@@ -437,35 +883,51 @@ wu_manber_gr(gcnt_t *restrict cnt, glepcc_t g, const char *buf, size_t bsz)
 			/* we're looking at foo, so check both boundaries */
 			if ((UNLIKELY(sp == (const unsigned char*)buf) ||
 			     xpuncsp(sp[-1])) &&
-			    (UNLIKELY(sp + z >= ep) || xpuncsp(sp[z]))) {
+			    (UNLIKELY(sp + z >= eb) || xpuncsp(sp[z]))) {
 				return true;
 			}
 		}
 		return false;
 	}
 
-	auto ix_t
-	match_prfx(const unsigned char *sp, hx_t pbeg, hx_t pend, const hx_t p)
+	auto void
+	match_prfx(const unsigned char *sp, hx_t pbeg, hx_t pend, const hx_t p,
+		   const unsigned int ci)
 	{
-		/* loop through all patterns that hash to P */
+		/* loop through all patterns that hash to P, case-sensitive
+		 * ones or, if CI, case-insensitive ones */
 		for (hx_t pi = pbeg; pi < pend; pi++) {
-			if (p == g->PREFIX[pi]) {
-				const hx_t i = g->PATPTR[pi];
-				const glod_pat_t pat = g->p->pats[i];
-				const char *s = pat.p;
+			st.nchain++;
+			if (p == g->PREFIX[pi] &&
+			    (g->VFL[pi] & VFL_CI) == ci) {
+				/* all from arrays indexed by chain position,
+				 * neighbours in memory */
+				const unsigned int fl = g->VFL[pi];
+				const unsigned int idx = g->VIDX[pi];
+				const unsigned char *s = g->VPAT + g->VOFF[pi];
+				const size_t n = g->VOFF[pi + 1U] - g->VOFF[pi] - 1U;
 				size_t l;
 
+				st.nvrfy++;
+				gpst_vrfy(idx);
 				/* check the word */
 				if (0) {
 				match:
 					/* MATCH */
-					cnt[pat.idx]++;
-					return l;
+					cnt[idx]++;
+					nmtch++;
+					if (UNLIKELY(hits != NULL)) {
+						const size_t o =
+							(const char*)sp - buf;
+
+						ghits_add(hits, idx, o);
+					}
+					continue;
 				} else if (!s[g->m - 2U]) {
 					/* small pattern */
 					sp++;
 
-					switch ((pat.fl.ci << 4U) |
+					switch (((fl & VFL_CI) << 4U) |
 						(l = g->m - 2U)) {
 					case (0U << 4U) | 3U:
 						if (sp[2U] != s[2U]) {
@@ -501,64 +963,192 @@ wu_manber_gr(gcnt_t *restrict cnt, glepcc_t g, const char *buf, size_t bsz)
 					default:
 						break;
 					}
-				} else if (pat.fl.ci &&
-					   (l = xicmp(s, sp)) &&
-					   matchp(pat, sp, l)) {
+				} else if (vcmp != NULL &&
+					   vpad(n) <= (size_t)(eb - sp)) {
+					/* whole vectors fit the buffer */
+					if (vcmp(s, sp, n, fl & VFL_CI) &&
+					    matchp(fl, sp, n)) {
+						goto match;
+					}
+				} else if (fl & VFL_CI &&
+					   (l = xicmp((const char*)s, sp)) &&
+					   matchp(fl, sp, l)) {
 					goto match;
-				} else if (!pat.fl.ci &&
-					   (l = xcmp(s, sp)) &&
-					   matchp(pat, sp, l)) {
+				} else if (!(fl & VFL_CI) &&
+					   (l = xcmp((const char*)s, sp)) &&
+					   matchp(fl, sp, l)) {
 					goto match;
 				}
 			}
 		}
-		return 0U;
+		return;
 	}
 
-	for (ix_t shift; bp < ep; bp += shift) {
-		const unsigned char *sp;
-		ix_t shci;
-		hx_t h;
-		hx_t hci;
-		hx_t pbeg;
-		hx_t pend;
-
-		/* the next two can be parallelised, no? */
-		h = sufh(g, bp);
-		hci = sufh_ci(g, bp);
-
-		/* check suffix */
-		if ((shift = g->SHIFT[h]) && (shci = g->SHIFT[hci])) {
-			if (shci < shift) {
-				shift = shci;
+	auto inline __attribute__((always_inline)) void
+	scan(const unsigned int B, const unsigned int cas)
+	{
+		for (ix_t shift; bp < ez; bp += shift) {
+			const unsigned char *sp;
+			ix_t shci;
+			hx_t h = 0U;
+			hx_t hci = 0U;
+
+			/* hash the window as is and/or in lower case */
+			if (cas != CASE_INS) {
+				h = sufh_B(g, B, bp);
+			}
+			if (cas != CASE_SENS) {
+				hci = sufh_ci_B(g, B, bp);
+			}
+			nstep++;
+
+			/* check suffix */
+			if (cas == CASE_SENS && (shift = g->SHIFT[h])) {
+				continue;
+			} else if (cas == CASE_INS && (shift = g->SHIFT[hci])) {
+				continue;
+			} else if (cas == CASE_MIXED &&
+				   (shift = g->SHIFT[h]) &&
+				   (shci = g->SHIFT[hci])) {
+				if (shci < shift) {
+					shift = shci;
+				}
+				continue;
 			}
-			continue;
-		}
 
-		/* check prefix */
-		sp = prfs(bp);
+			/* check prefix */
+			sp = prfs(bp);
+			ncand++;
 
-		/* try case aware variant first */
-		pbeg = g->HASH[h + 0U];
-		pend = g->HASH[h + 1U];
+			/* try case aware patterns first, they're filed under
+			 * the hash of the window as is */
+			if (cas != CASE_INS) {
+				match_prfx(sp, g->HASH[h + 0U], g->HASH[h + 1U],
+					   prfh(g, sp), 0U);
+			}
+			/* and the case insensitive ones */
+			if (cas != CASE_SENS) {
+				match_prfx(sp, g->HASH[hci + 0U],
+					   g->HASH[hci + 1U],
+					   prfh_ci(g, sp), 1U);
+			}
 
-		if ((shift = match_prfx(sp, pbeg, pend, prfh(g, sp)))) {
-			continue;
+			/* be careful with the stepping then, matches
+			 * may overlap */
+			shift = 1U;
 		}
+		return;
+	}
 
-		/* try the case insensitive case */
-		if (h != hci) {
-			pbeg = g->HASH[hci + 0U];
-			pend = g->HASH[hci + 1U];
-		}
-		if ((shift = match_prfx(sp, pbeg, pend, prfh_ci(g, sp)))) {
-			continue;
+	auto inline __attribute__((always_inline)) void
+	scan_B(const unsigned int B)
+	{
+		/* sets without case-insensitive patterns, the common case,
+		 * hash each window once only, as do those without
+		 * case-sensitive ones */
+		switch (g->cas) {
+		case CASE_SENS:
+			scan(B, CASE_SENS);
+			break;
+		case CASE_INS:
+			scan(B, CASE_INS);
+			break;
+		default:
+			scan(B, CASE_MIXED);
+			break;
 		}
+		return;
+	}
+
+	/* one instance of the scanner per block size and case handling */
+	switch (g->B) {
+	case 2U:
+		scan_B(2U);
+		break;
+	case 3U:
+		scan_B(3U);
+		break;
+	default:
+		scan_B(4U);
+		break;
+	}
+	if (UNLIKELY(engine_stats_p)) {
+		const uint_fast64_t nshift = bp > bp0 ? bp - bp0 : 0U;
+
+		__atomic_add_fetch(&g->st.nstep, nstep, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g->st.nshift, nshift, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g->st.ncand, ncand, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g->st.nchain, st.nchain, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g->st.nvrfy, st.nvrfy, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g->st.nmtch, nmtch, __ATOMIC_RELAXED);
+	}
+	return nmtch;
+}
 
-		/* be careful with the stepping then */
-		shift = 1U;
+int
+wu_manber_pin(const char *variant)
+{
+/* verify candidates with the verifier of VARIANT (seq, 128 or 256)
+ * instead of the best one the cpu has to offer,
+ * return -1 if VARIANT isn't compiled in or not supported */
+	if (0) {
+		;
+	} else if (!strcmp(variant, "seq")) {
+		vcmp = NULL;
+		vcmpv = "seq";
+#if defined HAVE_VCMP_INTRIN
+	} else if (!strcmp(variant, "128") && __builtin_cpu_supports("sse2")) {
+		vcmp = vcmp128;
+		vcmpv = "128";
+	} else if (!strcmp(variant, "256") && __builtin_cpu_supports("avx2")) {
+		vcmp = vcmp256;
+		vcmpv = "256";
+#endif	/* HAVE_VCMP_INTRIN */
+	} else {
+		return -1;
 	}
+	vcmp_pinned = true;
 	return 0;
 }
 
+uint64_t
+wu_manber_ncand(glepcc_t g)
+{
+/* number of shift-0 windows, requires engine_stats_p */
+	return g->st.ncand;
+}
+
+void
+wu_manber_stats(glepcc_t g)
+{
+	const struct wmst_s st = g->st;
+	size_t nzero = 0U;
+
+	for (size_t i = 0U; i < g->z; i++) {
+		nzero += !g->SHIFT[i];
+	}
+	fprintf(stderr, "wu-manber\tpatterns\t%zu\n", g->npats);
+	fprintf(stderr, "wu-manber\tm\t%u\n", g->m);
+	fprintf(stderr, "wu-manber\tB\t%u\n", g->B);
+	fprintf(stderr, "wu-manber\ttable\t%zu\n", g->z);
+	fprintf(stderr, "wu-manber\tcase\t%s\n",
+		g->cas == CASE_SENS ? "sensitive" :
+		g->cas == CASE_INS ? "insensitive" : "mixed");
+	fprintf(stderr, "wu-manber\tverifier\t%s\n", vcmpv);
+	fprintf(stderr, "wu-manber\tshift-0 entries\t%zu\t%.2f%%\n",
+		nzero, (double)(100U * nzero) / (double)g->z);
+	fprintf(stderr, "wu-manber\twindows\t%" PRIu64 "\n", st.nstep);
+	fprintf(stderr, "wu-manber\tmean shift\t%.3f\n",
+		(double)st.nshift / (double)(st.nstep + !st.nstep));
+	fprintf(stderr, "wu-manber\tcandidates\t%" PRIu64 "\t%.2f%%\n",
+		st.ncand,
+		(double)(100U * st.ncand) / (double)(st.nstep + !st.nstep));
+	fprintf(stderr, "wu-manber\tchain per candidate\t%.3f\n",
+		(double)st.nchain / (double)(st.ncand + !st.ncand));
+	fprintf(stderr, "wu-manber\tverified per candidate\t%.3f\n",
+		(double)st.nvrfy / (double)(st.ncand + !st.ncand));
+	fprintf(stderr, "wu-manber\tmatches\t%" PRIu64 "\n", st.nmtch);
+	return;
+}
+
 /* wu-manber-guts.c ends here */
@@ -2,9 +2,17 @@
 #define INCLUDED_wu_manber_guts_h_
 
 #include "glep.h"
+#include "glep-db.h"
 
 extern glepcc_t wu_manber_cc(glod_pats_t);
-extern int wu_manber_gr(gcnt_t *restrict, glepcc_t, const char *b, size_t z);
+extern int wu_manber_gr(gcnt_t *restrict, ghits_t, glepcc_t, const char *b, size_t z);
 extern void wu_manber_fr(glepcc_t);
+extern size_t wu_manber_cost(glod_pats_t);
+extern void wu_manber_stats(glepcc_t);
+extern uint64_t wu_manber_ncand(glepcc_t);
+extern int wu_manber_pin(const char *variant);
+
+extern size_t wu_manber_wr(gdbw_t, glepcc_t);
+extern glepcc_t wu_manber_rd(gdb_t, size_t o, glod_pats_t);
 
 #endif	/* INCLUDED_wu_manber_guts_h_ */